@@ -0,0 +1,404 @@
+#include "Benchmark.h"
+#include "MeshCache.h"
+#include "SceneGraph.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+bool createOffscreenTarget(OffscreenTarget& target, int width, int height)
+{
+    glGenFramebuffers(1, &target.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+
+    //colour attachment
+    glGenRenderbuffers(1, &target.colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, target.colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target.colorBuffer);
+
+    //depth attachment so depth testing matches the windowed path
+    glGenRenderbuffers(1, &target.depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, target.depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, target.depthBuffer);
+
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (!complete) {
+        std::cerr << "Offscreen framebuffer is incomplete" << std::endl;
+    }
+
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    return complete;
+}
+
+void destroyOffscreenTarget(OffscreenTarget& target)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteRenderbuffers(1, &target.colorBuffer);
+    glDeleteRenderbuffers(1, &target.depthBuffer);
+    glDeleteFramebuffers(1, &target.fbo);
+    target = OffscreenTarget();
+}
+
+//runs one load + upload and returns how long it took in milliseconds
+static double timeModelLoad(const std::string& path, bool useCache)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    LoadedModel model;
+    bool loaded = false;
+    if (useCache) {
+        loaded = loadMeshCache(path, model);
+    }
+    else {
+        loaded = loadModel(path, model.parsed);
+        model.view = meshView(model.parsed);
+    }
+    if (!loaded) {
+        return -1.0;
+    }
+
+    //include the upload and wait for it so both paths are measured the same way
+    GpuMesh gpuMesh;
+    uploadMesh(model.view, gpuMesh);
+    glFinish();
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    destroyMesh(gpuMesh);
+    return elapsed.count();
+}
+
+bool writeBenchmarkJson(const std::string& json, const std::string& path)
+{
+    if (path == "-") {
+        std::cout << json;
+        return true;
+    }
+
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Failed to write benchmark results to " << path << std::endl;
+        return false;
+    }
+    file << json;
+    return true;
+}
+
+std::string benchmarkModelLoads(const std::vector<std::string>& paths)
+{
+    const int runs = 3;
+    std::ostringstream out;
+    out << "{\n  \"models\": [\n";
+
+    for (size_t p = 0; p < paths.size(); ++p) {
+        const std::string& path = paths[p];
+
+        //make sure a fresh cache exists before the warm runs
+        MeshData mesh;
+        if (!loadModel(path, mesh) || !writeMeshCache(path, mesh)) {
+            std::cerr << "Could not build the mesh cache for " << path << std::endl;
+            return std::string();
+        }
+
+        //median of a few runs keeps one slow disk read from skewing the result
+        std::vector<double> cold, warm;
+        for (int run = 0; run < runs; ++run) {
+            cold.push_back(timeModelLoad(path, false));
+            warm.push_back(timeModelLoad(path, true));
+        }
+        std::sort(cold.begin(), cold.end());
+        std::sort(warm.begin(), warm.end());
+
+        out << "    { \"path\": \"" << path << "\""
+            << ", \"cold_ms\": " << cold[runs / 2]
+            << ", \"warm_ms\": " << warm[runs / 2]
+            << ", \"speedup\": " << (warm[runs / 2] > 0.0 ? cold[runs / 2] / warm[runs / 2] : 0.0)
+            << " }" << (p + 1 < paths.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+    return out.str();
+}
+
+void FrameTimer::init()
+{
+    glGenQueries(QueryCount, queries);
+}
+
+void FrameTimer::destroy()
+{
+    glDeleteQueries(QueryCount, queries);
+}
+
+void FrameTimer::beginFrame()
+{
+    //reuse the oldest query, reading back whatever it measured first
+    int slot = frameIndex % QueryCount;
+    collect(slot);
+
+    frameStart = std::chrono::steady_clock::now();
+    glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+    pendingFrame[slot] = frameIndex;
+
+    cpuMs.push_back(0.0);
+    gpuMs.push_back(0.0);
+    drawCounts.push_back(0.0);
+    stateChanges.push_back(0.0);
+    triangleCounts.push_back(0.0);
+    visibleCounts.push_back(0.0);
+    culledCounts.push_back(0.0);
+    lightReferences.push_back(0.0);
+    lightBinUs.push_back(0.0);
+    occludedCounts.push_back(0.0);
+    drawnCounts.push_back(0.0);
+    occludedTriangleCounts.push_back(0.0);
+    occlusionUs.push_back(0.0);
+    pickUs.push_back(0.0);
+}
+
+void FrameTimer::endFrame()
+{
+    glEndQuery(GL_TIME_ELAPSED);
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - frameStart;
+    cpuMs[frameIndex] = elapsed.count();
+    ++frameIndex;
+}
+
+void FrameTimer::recordRenderStats(int draws, int changes, long long triangles)
+{
+    drawCounts[frameIndex] = draws;
+    stateChanges[frameIndex] = changes;
+    triangleCounts[frameIndex] = (double)triangles;
+}
+
+void FrameTimer::recordCullStats(int visible, int culled)
+{
+    visibleCounts[frameIndex] = visible;
+    culledCounts[frameIndex] = culled;
+}
+
+void FrameTimer::recordLightStats(int references, double binMicroseconds)
+{
+    lightReferences[frameIndex] = references;
+    lightBinUs[frameIndex] = binMicroseconds;
+}
+
+void FrameTimer::recordOcclusionStats(int occluded, int drawn, long long occludedTriangles, double microseconds)
+{
+    occludedCounts[frameIndex] = occluded;
+    drawnCounts[frameIndex] = drawn;
+    occludedTriangleCounts[frameIndex] = (double)occludedTriangles;
+    occlusionUs[frameIndex] = microseconds;
+}
+
+void FrameTimer::recordPickStats(double microseconds)
+{
+    pickUs[frameIndex] = microseconds;
+}
+
+void FrameTimer::finish()
+{
+    for (int slot = 0; slot < QueryCount; ++slot) {
+        collect(slot);
+    }
+}
+
+void FrameTimer::collect(int slot)
+{
+    if (pendingFrame[slot] < 0) {
+        return;
+    }
+    //blocks only if the gpu is more than QueryCount frames behind
+    GLuint64 nanoseconds = 0;
+    glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &nanoseconds);
+    gpuMs[pendingFrame[slot]] = nanoseconds / 1.0e6;
+    pendingFrame[slot] = -1;
+}
+
+//nearest rank percentile of an already sorted list
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t rank = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+//writes a {"mean","p50","p95","p99","max"} block for one set of timings
+static void writeSummary(std::ostream& out, const char* name, std::vector<double> times)
+{
+    std::sort(times.begin(), times.end());
+    double total = 0.0;
+    for (double t : times) {
+        total += t;
+    }
+    double mean = times.empty() ? 0.0 : total / times.size();
+
+    out << "  \"" << name << "\": { "
+        << "\"mean\": " << mean
+        << ", \"p50\": " << percentile(times, 50.0)
+        << ", \"p95\": " << percentile(times, 95.0)
+        << ", \"p99\": " << percentile(times, 99.0)
+        << ", \"max\": " << (times.empty() ? 0.0 : times.back())
+        << " },\n";
+}
+
+std::string FrameTimer::json(const std::string& renderer) const
+{
+    std::ostringstream out;
+
+    //time saved by occlusion is an estimate: the hidden triangles at the run's average gpu cost per triangle,
+    //less what the occlusion test itself took
+    double totalGpuMs = 0.0;
+    double totalTriangles = 0.0;
+    for (size_t i = 0; i < gpuMs.size(); ++i) {
+        totalGpuMs += gpuMs[i];
+        totalTriangles += triangleCounts[i];
+    }
+    double msPerTriangle = totalTriangles > 0.0 ? totalGpuMs / totalTriangles : 0.0;
+    std::vector<double> occlusionSavedMs(cpuMs.size());
+    for (size_t i = 0; i < occlusionSavedMs.size(); ++i) {
+        occlusionSavedMs[i] = occludedTriangleCounts[i] * msPerTriangle - occlusionUs[i] / 1000.0;
+    }
+
+    //strip characters that would break the json string
+    std::string safeRenderer = renderer;
+    safeRenderer.erase(std::remove_if(safeRenderer.begin(), safeRenderer.end(),
+        [](char c) { return c == '"' || c == '\\'; }), safeRenderer.end());
+
+    out << "{\n";
+    out << "  \"renderer\": \"" << safeRenderer << "\",\n";
+    out << "  \"frames\": " << cpuMs.size() << ",\n";
+    writeSummary(out, "cpu_ms", cpuMs);
+    writeSummary(out, "gpu_ms", gpuMs);
+    writeSummary(out, "draws", drawCounts);
+    writeSummary(out, "state_changes", stateChanges);
+    writeSummary(out, "triangles", triangleCounts);
+    writeSummary(out, "visible", visibleCounts);
+    writeSummary(out, "culled", culledCounts);
+    writeSummary(out, "light_refs", lightReferences);
+    writeSummary(out, "light_bin_us", lightBinUs);
+    writeSummary(out, "occluded", occludedCounts);
+    writeSummary(out, "drawn", drawnCounts);
+    writeSummary(out, "occlusion_us", occlusionUs);
+    writeSummary(out, "occlusion_saved_ms", occlusionSavedMs);
+    writeSummary(out, "pick_us", pickUs);
+    out << "  \"per_frame\": [\n";
+    for (size_t i = 0; i < cpuMs.size(); ++i) {
+        out << "    { \"cpu_ms\": " << cpuMs[i] << ", \"gpu_ms\": " << gpuMs[i]
+            << ", \"draws\": " << drawCounts[i] << ", \"state_changes\": " << stateChanges[i]
+            << ", \"triangles\": " << triangleCounts[i]
+            << ", \"visible\": " << visibleCounts[i] << ", \"culled\": " << culledCounts[i]
+            << ", \"light_refs\": " << lightReferences[i] << ", \"light_bin_us\": " << lightBinUs[i]
+            << ", \"occluded\": " << occludedCounts[i] << ", \"drawn\": " << drawnCounts[i]
+            << ", \"occlusion_us\": " << occlusionUs[i] << ", \"occlusion_saved_ms\": " << occlusionSavedMs[i]
+            << ", \"pick_us\": " << pickUs[i] << " }"
+            << (i + 1 < cpuMs.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n";
+    out << "}\n";
+    return out.str();
+}
+
+//parent * translate * rotate * scale for every node, recomputed whether it moved or not
+static void rebuildWorlds(const SceneGraph& graph, std::vector<glm::mat4>& worlds)
+{
+    for (SceneNode node = 0; node < (SceneNode)graph.size(); ++node) {
+        glm::mat4 local = glm::translate(glm::mat4(1.0f), graph.translation(node)) * glm::mat4_cast(graph.rotation(node));
+        local = glm::scale(local, graph.scale(node));
+        SceneNode parent = graph.parent(node);
+        worlds[node] = parent == NoSceneNode ? local : worlds[parent] * local;
+    }
+}
+
+std::string benchmarkSceneGraph(int nodeCount)
+{
+    const int runs = 50;
+    const int groupSize = 1000;
+
+    //laid out like a loaded scene: a root every groupSize nodes, every other node parented to a random earlier one
+    //of its group, which keeps the hierarchy a handful of levels deep
+    SceneGraph graph;
+    graph.reserve(nodeCount);
+    std::vector<SceneNode> roots;
+    uint32_t random = 12345;
+    auto next = [&random]() {
+        random = random * 1664525u + 1013904223u;
+        return random >> 8;
+    };
+    for (int i = 0; i < nodeCount; ++i) {
+        int inGroup = i % groupSize;
+        SceneNode parent = inGroup == 0 ? NoSceneNode : (SceneNode)(i - inGroup + (int)(next() % inGroup));
+        glm::vec3 axis = glm::normalize(glm::vec3(1.0f + next() % 7, 1.0f + next() % 5, 1.0f + next() % 3));
+        glm::quat rotation = glm::angleAxis((next() % 628) / 100.0f, axis);
+        graph.addNode(parent, glm::vec3(next() % 100 / 50.0f, next() % 100 / 50.0f, next() % 100 / 50.0f),
+            rotation, glm::vec3(0.9f + (next() % 20) / 100.0f));
+        if (parent == NoSceneNode) {
+            roots.push_back((SceneNode)i);
+        }
+    }
+    graph.update();
+
+    typedef std::chrono::duration<double, std::micro> Microseconds;
+    std::vector<double> full, onePercent, singleLeaf, unchanged, glmRebuild;
+    size_t onePercentUpdated = 0;
+    std::vector<glm::mat4> reference(nodeCount);
+    for (int run = 0; run < runs; ++run) {
+        //every root moves, so everything is recomputed
+        for (SceneNode root : roots) {
+            graph.setTranslation(root, glm::vec3((float)run, 0.0f, 0.0f));
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        graph.update();
+        full.push_back(Microseconds(std::chrono::steady_clock::now() - start).count());
+
+        //1% of the nodes turn, along with whatever hangs off them
+        for (int i = 0; i < nodeCount / 100; ++i) {
+            SceneNode node = (SceneNode)(next() % nodeCount);
+            graph.setRotation(node, glm::angleAxis(run * 0.01f, glm::vec3(0.0f, 1.0f, 0.0f)));
+        }
+        start = std::chrono::steady_clock::now();
+        onePercentUpdated = graph.update();
+        onePercent.push_back(Microseconds(std::chrono::steady_clock::now() - start).count());
+
+        graph.setScale((SceneNode)(nodeCount - 1), glm::vec3(1.0f + run * 0.01f));
+        start = std::chrono::steady_clock::now();
+        graph.update();
+        singleLeaf.push_back(Microseconds(std::chrono::steady_clock::now() - start).count());
+
+        start = std::chrono::steady_clock::now();
+        graph.update();
+        unchanged.push_back(Microseconds(std::chrono::steady_clock::now() - start).count());
+
+        start = std::chrono::steady_clock::now();
+        rebuildWorlds(graph, reference);
+        glmRebuild.push_back(Microseconds(std::chrono::steady_clock::now() - start).count());
+    }
+
+    //the dirty updates have to land on the same matrices as rebuilding everything
+    float maxError = 0.0f;
+    for (int i = 0; i < nodeCount; ++i) {
+        for (int c = 0; c < 4; ++c) {
+            glm::vec4 difference = glm::abs(graph.world((SceneNode)i)[c] - reference[i][c]);
+            maxError = std::max(maxError, std::max(std::max(difference.x, difference.y), std::max(difference.z, difference.w)));
+        }
+    }
+
+    std::ostringstream out;
+    out << "{\n";
+    out << "  \"nodes\": " << nodeCount << ",\n";
+    out << "  \"one_percent_updated\": " << onePercentUpdated << ",\n";
+    writeSummary(out, "full_us", full);
+    writeSummary(out, "one_percent_us", onePercent);
+    writeSummary(out, "single_leaf_us", singleLeaf);
+    writeSummary(out, "unchanged_us", unchanged);
+    writeSummary(out, "glm_rebuild_us", glmRebuild);
+    out << "  \"max_error\": " << maxError << "\n";
+    out << "}\n";
+    return out.str();
+}
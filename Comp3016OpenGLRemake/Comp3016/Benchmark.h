@@ -0,0 +1,80 @@
+#pragma once
+#include <GL/glew.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+//colour + depth framebuffer that headless runs render into
+struct OffscreenTarget {
+    GLuint fbo = 0;
+    GLuint colorBuffer = 0;
+    GLuint depthBuffer = 0;
+};
+
+//creates the framebuffer, returns false if it is incomplete
+bool createOffscreenTarget(OffscreenTarget& target, int width, int height);
+void destroyOffscreenTarget(OffscreenTarget& target);
+
+//writes a benchmark report to a file, "-" writes to stdout
+bool writeBenchmarkJson(const std::string& json, const std::string& path);
+
+//loads each model cold (assimp) and warm (mesh cache) including the gpu upload
+//returns the timings as json, empty if a model failed to load
+std::string benchmarkModelLoads(const std::vector<std::string>& paths);
+
+//times SceneGraph::update over nodeCount nodes with everything, 1% and one leaf moved, against rebuilding
+//every matrix with glm the way the props used to be placed, returns the timings as json
+std::string benchmarkSceneGraph(int nodeCount);
+
+//records cpu time and gpu time (timer queries) for every frame of a run
+class FrameTimer {
+public:
+    //creates the timer queries, needs a current GL context
+    void init();
+    void destroy();
+
+    void beginFrame();
+    void endFrame();
+    //draws, GL state changes and triangles the render queue issued this frame, call before endFrame
+    void recordRenderStats(int draws, int stateChanges, long long triangles);
+    //scene items the frustum culling kept and dropped this frame
+    void recordCullStats(int visible, int culled);
+    //(cluster, light) references the light binning wrote and how long the binning took
+    void recordLightStats(int lightReferences, double binMicroseconds);
+    //frustum visible items the occlusion test hid and drew, the triangles it saved and what the test cost
+    void recordOcclusionStats(int occluded, int drawn, long long occludedTriangles, double microseconds);
+    //how long the cursor pick took
+    void recordPickStats(double microseconds);
+    //waits for the last gpu results to come back
+    void finish();
+
+    //per frame times and p50/p95/p99 as json
+    std::string json(const std::string& renderer) const;
+
+private:
+    //enough queries in flight that reading one back never stalls the gpu
+    static const int QueryCount = 4;
+
+    void collect(int slot);
+
+    GLuint queries[QueryCount] = {};
+    int pendingFrame[QueryCount] = { -1, -1, -1, -1 };
+    int frameIndex = 0;
+    std::chrono::steady_clock::time_point frameStart;
+
+    std::vector<double> cpuMs;
+    std::vector<double> gpuMs;
+    std::vector<double> drawCounts;
+    std::vector<double> stateChanges;
+    std::vector<double> triangleCounts;
+    std::vector<double> visibleCounts;
+    std::vector<double> culledCounts;
+    std::vector<double> lightReferences;
+    std::vector<double> lightBinUs;
+    std::vector<double> occludedCounts;
+    std::vector<double> drawnCounts;
+    std::vector<double> occludedTriangleCounts;
+    std::vector<double> occlusionUs;
+    std::vector<double> pickUs;
+};
@@ -0,0 +1,214 @@
+#include "BlockCompression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static uint16_t packRgb565(const float* colour)
+{
+    int r = (int)std::lround(std::min(std::max(colour[0], 0.0f), 255.0f) * 31.0f / 255.0f);
+    int g = (int)std::lround(std::min(std::max(colour[1], 0.0f), 255.0f) * 63.0f / 255.0f);
+    int b = (int)std::lround(std::min(std::max(colour[2], 0.0f), 255.0f) * 31.0f / 255.0f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+//expands back to 8 bits the way the decoder does, top bits copied into the bottom
+static void unpackRgb565(uint16_t packed, int* colour)
+{
+    int r = (packed >> 11) & 31;
+    int g = (packed >> 5) & 63;
+    int b = packed & 31;
+    colour[0] = (r << 3) | (r >> 2);
+    colour[1] = (g << 2) | (g >> 4);
+    colour[2] = (b << 3) | (b >> 2);
+}
+
+static void writeLittleEndian(uint8_t* out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i) {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+void compressBc1Block(const uint8_t* rgba, uint8_t* out)
+{
+    //endpoints lie along the main axis of the block's colours, found by power iteration on the covariance
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            mean[c] += rgba[i * 4 + c] / 16.0f;
+        }
+    }
+    float covariance[6] = {};
+    for (int i = 0; i < 16; ++i) {
+        float r = rgba[i * 4] - mean[0], g = rgba[i * 4 + 1] - mean[1], b = rgba[i * 4 + 2] - mean[2];
+        covariance[0] += r * r;
+        covariance[1] += r * g;
+        covariance[2] += r * b;
+        covariance[3] += g * g;
+        covariance[4] += g * b;
+        covariance[5] += b * b;
+    }
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+        float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+        float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+        float length = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+        if (length == 0.0f) {
+            break;
+        }
+        axis[0] = x / length;
+        axis[1] = y / length;
+        axis[2] = z / length;
+    }
+
+    //the two pixels furthest apart along that axis become the endpoints
+    float minProjection = 1e30f, maxProjection = -1e30f;
+    int minPixel = 0, maxPixel = 0;
+    for (int i = 0; i < 16; ++i) {
+        float projection = rgba[i * 4] * axis[0] + rgba[i * 4 + 1] * axis[1] + rgba[i * 4 + 2] * axis[2];
+        if (projection < minProjection) {
+            minProjection = projection;
+            minPixel = i;
+        }
+        if (projection > maxProjection) {
+            maxProjection = projection;
+            maxPixel = i;
+        }
+    }
+    float maxColour[3] = { (float)rgba[maxPixel * 4], (float)rgba[maxPixel * 4 + 1], (float)rgba[maxPixel * 4 + 2] };
+    float minColour[3] = { (float)rgba[minPixel * 4], (float)rgba[minPixel * 4 + 1], (float)rgba[minPixel * 4 + 2] };
+    uint16_t colour0 = packRgb565(maxColour);
+    uint16_t colour1 = packRgb565(minColour);
+
+    //colour0 > colour1 selects the 4 colour mode, equal endpoints just use index 0 everywhere
+    if (colour0 < colour1) {
+        std::swap(colour0, colour1);
+    }
+
+    int palette[4][3];
+    unpackRgb565(colour0, palette[0]);
+    unpackRgb565(colour1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    uint32_t indices = 0;
+    if (colour0 != colour1) {
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            int bestDistance = 1 << 30;
+            for (int entry = 0; entry < 4; ++entry) {
+                int dr = rgba[i * 4] - palette[entry][0];
+                int dg = rgba[i * 4 + 1] - palette[entry][1];
+                int db = rgba[i * 4 + 2] - palette[entry][2];
+                int distance = dr * dr + dg * dg + db * db;
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = entry;
+                }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+
+    writeLittleEndian(out, colour0, 2);
+    writeLittleEndian(out + 2, colour1, 2);
+    writeLittleEndian(out + 4, indices, 4);
+}
+
+//BC3 alpha half: two 8 bit endpoints and a 3 bit index per pixel
+static void compressAlphaBlock(const uint8_t* rgba, uint8_t* out)
+{
+    int alpha0 = 0, alpha1 = 255;
+    for (int i = 0; i < 16; ++i) {
+        alpha0 = std::max(alpha0, (int)rgba[i * 4 + 3]);
+        alpha1 = std::min(alpha1, (int)rgba[i * 4 + 3]);
+    }
+
+    uint64_t indices = 0;
+    if (alpha0 != alpha1) {
+        //alpha0 > alpha1 gives 8 evenly spaced values
+        int palette[8];
+        palette[0] = alpha0;
+        palette[1] = alpha1;
+        for (int step = 1; step < 7; ++step) {
+            palette[step + 1] = ((7 - step) * alpha0 + step * alpha1) / 7;
+        }
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            int bestDistance = 256;
+            for (int entry = 0; entry < 8; ++entry) {
+                int distance = std::abs(rgba[i * 4 + 3] - palette[entry]);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = entry;
+                }
+            }
+            indices |= (uint64_t)best << (3 * i);
+        }
+    }
+
+    out[0] = (uint8_t)alpha0;
+    out[1] = (uint8_t)alpha1;
+    writeLittleEndian(out + 2, indices, 6);
+}
+
+void compressBc3Block(const uint8_t* rgba, uint8_t* out)
+{
+    compressAlphaBlock(rgba, out);
+    compressBc1Block(rgba, out + 8);
+}
+
+std::vector<uint8_t> compressImage(const uint8_t* rgba, int width, int height, bool withAlpha)
+{
+    int blocksWide = (width + 3) / 4;
+    int blocksHigh = (height + 3) / 4;
+    int blockBytes = withAlpha ? Bc3BlockBytes : Bc1BlockBytes;
+    std::vector<uint8_t> compressed((size_t)blocksWide * blocksHigh * blockBytes);
+
+    uint8_t block[64];
+    for (int by = 0; by < blocksHigh; ++by) {
+        for (int bx = 0; bx < blocksWide; ++bx) {
+            for (int y = 0; y < 4; ++y) {
+                int sourceY = std::min(by * 4 + y, height - 1);
+                for (int x = 0; x < 4; ++x) {
+                    int sourceX = std::min(bx * 4 + x, width - 1);
+                    std::memcpy(block + (y * 4 + x) * 4, rgba + ((size_t)sourceY * width + sourceX) * 4, 4);
+                }
+            }
+            uint8_t* out = compressed.data() + ((size_t)by * blocksWide + bx) * blockBytes;
+            if (withAlpha) {
+                compressBc3Block(block, out);
+            }
+            else {
+                compressBc1Block(block, out);
+            }
+        }
+    }
+    return compressed;
+}
+
+std::vector<uint8_t> downsampleImage(const uint8_t* rgba, int width, int height, int& halfWidth, int& halfHeight)
+{
+    halfWidth = std::max(1, width / 2);
+    halfHeight = std::max(1, height / 2);
+    std::vector<uint8_t> half((size_t)halfWidth * halfHeight * 4);
+
+    for (int y = 0; y < halfHeight; ++y) {
+        int y0 = std::min(y * 2, height - 1);
+        int y1 = std::min(y * 2 + 1, height - 1);
+        for (int x = 0; x < halfWidth; ++x) {
+            int x0 = std::min(x * 2, width - 1);
+            int x1 = std::min(x * 2 + 1, width - 1);
+            for (int c = 0; c < 4; ++c) {
+                int sum = rgba[((size_t)y0 * width + x0) * 4 + c] + rgba[((size_t)y0 * width + x1) * 4 + c] +
+                    rgba[((size_t)y1 * width + x0) * 4 + c] + rgba[((size_t)y1 * width + x1) * 4 + c];
+                half[((size_t)y * halfWidth + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+            }
+        }
+    }
+    return half;
+}
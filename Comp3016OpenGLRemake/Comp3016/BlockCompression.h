@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//cpu encoders for the S3TC block formats, every 4x4 pixel block becomes 8 (BC1) or 16 (BC3) bytes
+const int Bc1BlockBytes = 8;
+const int Bc3BlockBytes = 16;
+
+//one 4x4 block, rgba = 16 pixels * 4 bytes in row order
+void compressBc1Block(const uint8_t* rgba, uint8_t* out);
+void compressBc3Block(const uint8_t* rgba, uint8_t* out);
+
+//compresses a whole rgba8 image, edges of sizes that are not a multiple of 4 repeat the last pixel
+//withAlpha picks BC3 over BC1
+std::vector<uint8_t> compressImage(const uint8_t* rgba, int width, int height, bool withAlpha);
+
+//half size rgba8 image made by averaging 2x2 pixels, odd edges reuse the last row/column
+std::vector<uint8_t> downsampleImage(const uint8_t* rgba, int width, int height, int& halfWidth, int& halfHeight);
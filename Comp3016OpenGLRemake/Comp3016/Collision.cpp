@@ -0,0 +1,465 @@
+#include "Collision.h"
+
+#include <algorithm>
+#include <cmath>
+
+static Aabb mergeAabb(const Aabb& a, const Aabb& b)
+{
+    Aabb merged;
+    merged.min = glm::min(a.min, b.min);
+    merged.max = glm::max(a.max, b.max);
+    return merged;
+}
+
+static float surfaceArea(const Aabb& box)
+{
+    glm::vec3 size = box.max - box.min;
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+static bool overlaps(const Aabb& a, const Aabb& b)
+{
+    return a.min.x <= b.max.x && a.max.x >= b.min.x &&
+        a.min.y <= b.max.y && a.max.y >= b.min.y &&
+        a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+static bool contains(const Aabb& outer, const Aabb& inner)
+{
+    return glm::all(glm::lessThanEqual(outer.min, inner.min)) && glm::all(glm::greaterThanEqual(outer.max, inner.max));
+}
+
+int AabbTree::insert(const Aabb& box, uint32_t item)
+{
+    int leaf = allocateNode();
+    nodes[leaf].box.min = box.min - glm::vec3(AabbTreeMargin);
+    nodes[leaf].box.max = box.max + glm::vec3(AabbTreeMargin);
+    nodes[leaf].item = item;
+    insertLeaf(leaf);
+    return leaf;
+}
+
+void AabbTree::remove(int proxy)
+{
+    removeLeaf(proxy);
+    freeNode(proxy);
+}
+
+bool AabbTree::move(int proxy, const Aabb& box)
+{
+    if (contains(nodes[proxy].box, box)) {
+        return false;
+    }
+    removeLeaf(proxy);
+    nodes[proxy].box.min = box.min - glm::vec3(AabbTreeMargin);
+    nodes[proxy].box.max = box.max + glm::vec3(AabbTreeMargin);
+    insertLeaf(proxy);
+    return true;
+}
+
+void AabbTree::query(const Aabb& box, std::vector<uint32_t>& items) const
+{
+    if (root < 0) {
+        return;
+    }
+    //the stack never holds more than the tree is tall plus one, and balancing keeps that near log2 of the leaves
+    int stack[64];
+    int count = 0;
+    stack[count++] = root;
+    while (count > 0) {
+        const Node& node = nodes[stack[--count]];
+        if (!overlaps(node.box, box)) {
+            continue;
+        }
+        if (node.left < 0) {
+            items.push_back(node.item);
+        }
+        else {
+            stack[count++] = node.left;
+            stack[count++] = node.right;
+        }
+    }
+}
+
+int AabbTree::allocateNode()
+{
+    if (freeList < 0) {
+        nodes.push_back(Node());
+        return (int)nodes.size() - 1;
+    }
+    int node = freeList;
+    freeList = nodes[node].next;
+    nodes[node] = Node();
+    return node;
+}
+
+void AabbTree::freeNode(int node)
+{
+    nodes[node].next = freeList;
+    nodes[node].height = -1;
+    freeList = node;
+}
+
+void AabbTree::insertLeaf(int leaf)
+{
+    nodes[leaf].parent = -1;
+    if (root < 0) {
+        root = leaf;
+        return;
+    }
+
+    //branch and bound for the sibling that costs least: pairing with a node costs the new parent's area plus the
+    //growth of every ancestor, and nothing under a node can cost less than the leaf's own area plus that growth
+    Aabb leafBox = nodes[leaf].box;
+    float leafArea = surfaceArea(leafBox);
+    int sibling = root;
+    float bestCost = surfaceArea(mergeAabb(nodes[root].box, leafBox));
+    searchStack.clear();
+    searchStack.push_back(std::make_pair(root, 0.0f));
+    while (!searchStack.empty()) {
+        int index = searchStack.back().first;
+        float inheritedCost = searchStack.back().second;
+        searchStack.pop_back();
+        const Node& node = nodes[index];
+        float combinedArea = surfaceArea(mergeAabb(node.box, leafBox));
+        if (combinedArea + inheritedCost < bestCost) {
+            bestCost = combinedArea + inheritedCost;
+            sibling = index;
+        }
+        if (node.left >= 0) {
+            float childInheritedCost = inheritedCost + combinedArea - surfaceArea(node.box);
+            if (leafArea + childInheritedCost < bestCost) {
+                searchStack.push_back(std::make_pair(node.left, childInheritedCost));
+                searchStack.push_back(std::make_pair(node.right, childInheritedCost));
+            }
+        }
+    }
+
+    //a new parent over the sibling and the leaf takes the sibling's place
+    int oldParent = nodes[sibling].parent;
+    int newParent = allocateNode();
+    nodes[newParent].parent = oldParent;
+    nodes[newParent].box = mergeAabb(leafBox, nodes[sibling].box);
+    nodes[newParent].height = nodes[sibling].height + 1;
+    nodes[newParent].left = sibling;
+    nodes[newParent].right = leaf;
+    nodes[sibling].parent = newParent;
+    nodes[leaf].parent = newParent;
+    if (oldParent < 0) {
+        root = newParent;
+    }
+    else if (nodes[oldParent].left == sibling) {
+        nodes[oldParent].left = newParent;
+    }
+    else {
+        nodes[oldParent].right = newParent;
+    }
+
+    for (int index = nodes[leaf].parent; index >= 0; index = nodes[index].parent) {
+        index = balance(index);
+        refit(index);
+    }
+}
+
+void AabbTree::removeLeaf(int leaf)
+{
+    if (leaf == root) {
+        root = -1;
+        return;
+    }
+
+    //the sibling takes the parent's place
+    int parent = nodes[leaf].parent;
+    int grandParent = nodes[parent].parent;
+    int sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+    freeNode(parent);
+    nodes[sibling].parent = grandParent;
+    if (grandParent < 0) {
+        root = sibling;
+        return;
+    }
+    if (nodes[grandParent].left == parent) {
+        nodes[grandParent].left = sibling;
+    }
+    else {
+        nodes[grandParent].right = sibling;
+    }
+    for (int index = grandParent; index >= 0; index = nodes[index].parent) {
+        index = balance(index);
+        refit(index);
+    }
+}
+
+void AabbTree::refit(int node)
+{
+    Node& parent = nodes[node];
+    parent.box = mergeAabb(nodes[parent.left].box, nodes[parent.right].box);
+    parent.height = 1 + std::max(nodes[parent.left].height, nodes[parent.right].height);
+}
+
+int AabbTree::balance(int a)
+{
+    if (nodes[a].left < 0 || nodes[a].height < 2) {
+        return a;
+    }
+    int b = nodes[a].left;
+    int c = nodes[a].right;
+    int difference = nodes[c].height - nodes[b].height;
+    if (difference >= -1 && difference <= 1) {
+        return a;
+    }
+
+    //the taller child comes up to a's place, a keeps its other child and the shorter of the taller child's children
+    int up = difference > 1 ? c : b;
+    int kept = difference > 1 ? b : c;
+    int first = nodes[up].left;
+    int second = nodes[up].right;
+    int taller = nodes[first].height > nodes[second].height ? first : second;
+    int shorter = taller == first ? second : first;
+
+    nodes[up].parent = nodes[a].parent;
+    nodes[a].parent = up;
+    if (nodes[up].parent < 0) {
+        root = up;
+    }
+    else if (nodes[nodes[up].parent].left == a) {
+        nodes[nodes[up].parent].left = up;
+    }
+    else {
+        nodes[nodes[up].parent].right = up;
+    }
+
+    nodes[up].left = a;
+    nodes[up].right = taller;
+    nodes[a].left = kept;
+    nodes[a].right = shorter;
+    nodes[shorter].parent = a;
+    refit(a);
+    refit(up);
+    return up;
+}
+
+//0 inside the box
+static float distanceToBox(const glm::vec3& point, const Aabb& box)
+{
+    return glm::length(point - glm::clamp(point, box.min, box.max));
+}
+
+//away from the nearest point of the box, or out through the nearest face when the point is inside it
+static glm::vec3 contactNormal(const glm::vec3& point, const Aabb& box)
+{
+    glm::vec3 away = point - glm::clamp(point, box.min, box.max);
+    float length = glm::length(away);
+    if (length > 1e-6f) {
+        return away / length;
+    }
+    glm::vec3 normal(0.0f);
+    float nearest = 1e30f;
+    for (int axis = 0; axis < 3; ++axis) {
+        if (point[axis] - box.min[axis] < nearest) {
+            nearest = point[axis] - box.min[axis];
+            normal = glm::vec3(0.0f);
+            normal[axis] = -1.0f;
+        }
+        if (box.max[axis] - point[axis] < nearest) {
+            nearest = box.max[axis] - point[axis];
+            normal = glm::vec3(0.0f);
+            normal[axis] = 1.0f;
+        }
+    }
+    return normal;
+}
+
+//first time in 0..1 the moving sphere touches the box
+static bool sweepSphereBox(const glm::vec3& start, const glm::vec3& motion, float radius, const Aabb& box,
+    float& time, glm::vec3& normal)
+{
+    if (distanceToBox(start, box) <= radius) {
+        normal = contactNormal(start, box);
+        time = 0.0f;
+        return glm::dot(motion, normal) < 0.0f;
+    }
+
+    //the centre has to be inside the box grown by radius to touch, the slab test says when it is
+    float enter = 0.0f;
+    float exit = 1.0f;
+    for (int axis = 0; axis < 3; ++axis) {
+        float low = box.min[axis] - radius;
+        float high = box.max[axis] + radius;
+        if (std::fabs(motion[axis]) < 1e-8f) {
+            if (start[axis] < low || start[axis] > high) {
+                return false;
+            }
+            continue;
+        }
+        float t0 = (low - start[axis]) / motion[axis];
+        float t1 = (high - start[axis]) / motion[axis];
+        enter = std::max(enter, std::min(t0, t1));
+        exit = std::min(exit, std::max(t0, t1));
+        if (enter > exit) {
+            return false;
+        }
+    }
+
+    //through a face that is the contact, past an edge or corner the grown box is really rounded there:
+    //distance to a box is convex along a line, so find its minimum and then the first crossing before it
+    auto gap = [&](float t) { return distanceToBox(start + motion * t, box) - radius; };
+    const float tolerance = radius * 1e-3f;
+    if (gap(enter) > tolerance) {
+        float low = enter;
+        float high = exit;
+        for (int i = 0; i < 40; ++i) {
+            float a = low + (high - low) / 3.0f;
+            float b = high - (high - low) / 3.0f;
+            if (gap(a) < gap(b)) {
+                high = b;
+            }
+            else {
+                low = a;
+            }
+        }
+        float closest = (low + high) * 0.5f;
+        if (gap(closest) > 0.0f) {
+            return false;
+        }
+        //gap(enter) > 0 >= gap(closest), keep the side still clear of the box
+        low = enter;
+        high = closest;
+        for (int i = 0; i < 30; ++i) {
+            float middle = (low + high) * 0.5f;
+            if (gap(middle) > 0.0f) {
+                low = middle;
+            }
+            else {
+                high = middle;
+            }
+        }
+        enter = low;
+    }
+    time = enter;
+    normal = contactNormal(start + motion * time, box);
+    return true;
+}
+
+uint32_t CollisionWorld::addBox(const Aabb& box)
+{
+    uint32_t collider = (uint32_t)boxes.size();
+    boxes.push_back(box);
+    proxies.push_back(tree.insert(box, collider));
+    colliderMeshes.push_back(-1);
+    return collider;
+}
+
+void CollisionWorld::moveBox(uint32_t collider, const Aabb& box)
+{
+    boxes[collider] = box;
+    tree.move(proxies[collider], box);
+}
+
+void CollisionWorld::removeBox(uint32_t collider)
+{
+    //ids stay stable, the slot is just left empty
+    tree.remove(proxies[collider]);
+    proxies[collider] = -1;
+    boxes[collider] = Aabb();
+}
+
+void CollisionWorld::addRoom(const Aabb& room, float thickness)
+{
+    for (int axis = 0; axis < 3; ++axis) {
+        Aabb low;
+        low.min = room.min - glm::vec3(thickness);
+        low.max = room.max + glm::vec3(thickness);
+        Aabb high = low;
+        low.max[axis] = room.min[axis];
+        high.min[axis] = room.max[axis];
+        addBox(low);
+        addBox(high);
+    }
+}
+
+uint32_t CollisionWorld::addMesh(const TriangleBvh& mesh, const glm::mat4& model)
+{
+    MeshCollider collider;
+    collider.bvh = &mesh;
+    collider.model = model;
+    collider.inverse = glm::inverse(model);
+    collider.scale = glm::length(glm::vec3(model[0]));
+    uint32_t id = addBox(transformAabb(mesh.bounds(), model));
+    colliderMeshes[id] = (int)meshes.size();
+    meshes.push_back(collider);
+    return id;
+}
+
+bool CollisionWorld::sweepSphere(const glm::vec3& start, const glm::vec3& motion, float radius, SweepHit& hit) const
+{
+    //only colliders the box around the whole move touches can be hit
+    Aabb swept;
+    swept.min = glm::min(start, start + motion) - glm::vec3(radius);
+    swept.max = glm::max(start, start + motion) + glm::vec3(radius);
+    candidates.clear();
+    tree.query(swept, candidates);
+
+    bool found = false;
+    for (uint32_t collider : candidates) {
+        if (colliderMeshes[collider] >= 0) {
+            //swept in the mesh's own space, where the sphere is scaled with it
+            const MeshCollider& mesh = meshes[colliderMeshes[collider]];
+            TriangleSweep meshHit;
+            meshHit.time = found ? hit.time : 1.0f;
+            glm::vec3 localStart = glm::vec3(mesh.inverse * glm::vec4(start, 1.0f));
+            glm::vec3 localMotion = glm::mat3(mesh.inverse) * motion;
+            if (mesh.bvh->sweepSphere(localStart, localMotion, radius / mesh.scale, meshHit)) {
+                hit.time = meshHit.time;
+                hit.normal = glm::normalize(glm::mat3(mesh.model) * meshHit.normal);
+                hit.collider = collider;
+                hit.triangle = meshHit.triangle;
+                found = true;
+            }
+            continue;
+        }
+        float time;
+        glm::vec3 normal;
+        if (sweepSphereBox(start, motion, radius, boxes[collider], time, normal) && (!found || time < hit.time)) {
+            hit.time = time;
+            hit.normal = normal;
+            hit.collider = collider;
+            found = true;
+        }
+    }
+    return found;
+}
+
+glm::vec3 CollisionWorld::slideSphere(const glm::vec3& start, const glm::vec3& motion, float radius, const glm::vec3& lockedAxis) const
+{
+    //a few slides is enough to walk into a corner and stop
+    const int MaxSlides = 4;
+    //left between the sphere and what it hit, so the next sweep starts clear of it
+    const float skin = 1e-4f;
+
+    glm::vec3 position = start;
+    glm::vec3 remaining = motion - lockedAxis * glm::dot(motion, lockedAxis);
+    for (int slide = 0; slide < MaxSlides; ++slide) {
+        if (glm::dot(remaining, remaining) < 1e-12f) {
+            break;
+        }
+        SweepHit hit;
+        if (!sweepSphere(position, remaining, radius, hit)) {
+            position += remaining;
+            break;
+        }
+        //slide along the surface as seen from the plane the sphere moves in, e.g. a step's edge becomes a wall
+        glm::vec3 normal = hit.normal - lockedAxis * glm::dot(hit.normal, lockedAxis);
+        float length = glm::length(normal);
+        position += remaining * hit.time;
+        if (length < 1e-4f) {
+            break;
+        }
+        normal /= length;
+        position += normal * skin;
+        //what is left of the move, minus the part pushing into the surface
+        remaining *= 1.0f - hit.time;
+        remaining -= normal * glm::dot(remaining, normal);
+    }
+    return position;
+}
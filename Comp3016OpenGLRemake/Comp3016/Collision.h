@@ -0,0 +1,114 @@
+#pragma once
+
+#include "Culling.h"
+#include "TriangleBvh.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+//radius of the sphere the camera walks around as
+const float CameraRadius = 0.1f;
+//leaves are stored this much bigger, so a collider nudged about doesn't need reinserting every time
+const float AabbTreeMargin = 0.02f;
+
+//bounding volume hierarchy that colliders can be added to, moved in and removed from at any time
+//leaves go under the sibling that grows the tree's surface area least and rotations keep it height balanced,
+//so a query visits O(log n) nodes however the colliders were added
+class AabbTree {
+public:
+    //returns the leaf's proxy, item is what queries report for it
+    int insert(const Aabb& box, uint32_t item);
+    void remove(int proxy);
+    //reinserts only once the box leaves the leaf's fattened bounds, true if it did
+    bool move(int proxy, const Aabb& box);
+
+    //appends the item of every leaf overlapping box
+    void query(const Aabb& box, std::vector<uint32_t>& items) const;
+
+    //0 for a single leaf, -1 when empty
+    int height() const { return root < 0 ? -1 : nodes[root].height; }
+
+private:
+    struct Node {
+        Aabb box;
+        int parent = -1;
+        //-1 on a leaf
+        int left = -1;
+        int right = -1;
+        int height = 0;
+        uint32_t item = 0;
+        //next free node while unused
+        int next = -1;
+    };
+
+    int allocateNode();
+    void freeNode(int node);
+    void insertLeaf(int leaf);
+    void removeLeaf(int leaf);
+    //rotates the taller grandchild up when node's children differ in height by more than one, returns the subtree's new root
+    int balance(int node);
+    void refit(int node);
+
+    std::vector<Node> nodes;
+    int root = -1;
+    int freeList = -1;
+    //node and the area its ancestors grow by, for the sibling search in insertLeaf
+    std::vector<std::pair<int, float>> searchStack;
+};
+
+//where a swept sphere first touches a collider
+struct SweepHit {
+    //fraction of the motion covered before touching
+    float time = 1.0f;
+    //out of the collider at the contact
+    glm::vec3 normal = glm::vec3(0.0f);
+    uint32_t collider = 0;
+    //which of a mesh collider's triangles
+    uint32_t triangle = 0;
+};
+
+//box and triangle mesh colliders in an AabbTree, queried by spheres moving through them
+class CollisionWorld {
+public:
+    //returns the collider's id
+    uint32_t addBox(const Aabb& box);
+    //box colliders only
+    void moveBox(uint32_t collider, const Aabb& box);
+    void removeBox(uint32_t collider);
+    //the walls, floor and ceiling around room, thickness deep, keep whatever is inside it in
+    void addRoom(const Aabb& room, float thickness);
+    //static mesh placed by model, which may only rotate, translate and scale evenly so spheres stay spheres
+    //the bvh is referenced, not copied
+    uint32_t addMesh(const TriangleBvh& mesh, const glm::mat4& model);
+
+    //earliest contact of a sphere moving from start by motion, false if the whole move is clear
+    //a sphere already touching a collider only hits it while moving further in
+    bool sweepSphere(const glm::vec3& start, const glm::vec3& motion, float radius, SweepHit& hit) const;
+    //moves the sphere as far as it can, then slides the rest of the motion along whatever it touched
+    //never moves along lockedAxis (unit length, or zero for no lock), so a walking camera keeps its height
+    glm::vec3 slideSphere(const glm::vec3& start, const glm::vec3& motion, float radius,
+        const glm::vec3& lockedAxis = glm::vec3(0.0f)) const;
+
+    size_t colliderCount() const { return boxes.size(); }
+
+private:
+    struct MeshCollider {
+        const TriangleBvh* bvh;
+        glm::mat4 model;
+        glm::mat4 inverse;
+        float scale;
+    };
+
+    //world bounds of every collider, meshes included
+    std::vector<Aabb> boxes;
+    std::vector<int> proxies;
+    //index into meshes, -1 for a box
+    std::vector<int> colliderMeshes;
+    std::vector<MeshCollider> meshes;
+    AabbTree tree;
+    //broad phase results, the world is only ever queried from one thread
+    mutable std::vector<uint32_t> candidates;
+};
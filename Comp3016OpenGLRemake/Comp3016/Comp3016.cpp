@@ -5,21 +5,44 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
-#include <Assimp\Importer.hpp>
-#include <Assimp/scene.h>
-#include <Assimp/postprocess.h>
 
-#include "Shader.h"
+#include "ShaderProgram.h"
+#include "ShaderManager.h"
 #include "ModelLoader.h"
-
+#include "MeshCache.h"
+#include "MeshLod.h"
+#include "Options.h"
+#include "Benchmark.h"
+#include "InstanceBuffer.h"
+#include "StreamBuffer.h"
+#include "RenderQueue.h"
+#include "Culling.h"
+#include "Lighting.h"
+#include "Shadows.h"
+#include "Simulation.h"
+#include "FramePipeline.h"
+#include "GpuScene.h"
+#include "Occlusion.h"
+#include "SceneGraph.h"
+#include "Collision.h"
+#include "Picking.h"
+#include "Profiler.h"
+
+#include "TextureLoader.h"
+#include "TextureCache.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <thread>
 #include <vector>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
-
 // variables for camera + time
+//length of the simulation step processInput is advancing
 float deltaTime = 0.0f;
-float lastFrame = 0.0f;
 
 //camera parameters
 float fov = 125.0f;
@@ -37,107 +60,123 @@ glm::mat4 view;
 glm::mat4 projection;
 
 //lighting parameters
-glm::vec3 lightDirection(-1.0f, -1.0f, -1.0f); // Directional light from the top-left
 glm::vec3 lightAmbient(0.2f, 0.2f, 0.2f);
+glm::vec3 lightPosition(0.0f, 0.0f, 0.0f); // Point light used for diffuse + specular
 
 double lastX = 400, lastY = 300;
 bool firstMouse = true;
 
-//GLFW window and shader program
+//GLFW window
 GLFWwindow* window;
-GLuint shaderProgram;
 
 
+//simulation stage state, only ever touched by the thread running the simulation
+struct SceneSimulation {
+    FixedTimestep timestep;
+    SimulationState previousState;
+    SimulationState currentState;
+    double lastFrameTime = 0.0;
+
+    //static scene the visibility pass culls against
+    const SceneBvh* sceneBvh = nullptr;
+    const std::vector<InstanceData>* podiumGrid = nullptr;
+    uint32_t canItem = 0;
+    uint32_t wallItem = 0;
+    uint32_t shopItem = 0;
+    glm::mat4 propModel = glm::mat4(1.0f);
+    std::vector<uint32_t> visibleItems;
+
+    //the podiums and wall hide whatever is behind them, the frustum visible ones nearest the camera are
+    //rasterised into a software depth buffer each frame and every other visible item is tested against it
+    bool occlusionEnabled = true;
+    OcclusionBuffer occlusion;
+    const std::vector<Aabb>* itemBounds = nullptr;
+    OccluderMesh podiumOccluder;
+    OccluderMesh wallOccluder;
+    //(screen coverage, item) of this frame's occluder candidates
+    std::vector<std::pair<float, uint32_t>> occluderCandidates;
+    //triangles each prop draws, for counting what occlusion saved
+    long long podiumTriangles = 0;
+    long long canTriangles = 0;
+    long long wallTriangles = 0;
+    long long shopTriangles = 0;
+
+    //bonsais are scene items bonsaiItem onwards, each drawn at the coarsest level its screen size allows
+    uint32_t bonsaiItem = 0;
+    const std::vector<InstanceData>* bonsais = nullptr;
+    glm::vec3 bonsaiCentre = glm::vec3(0.0f);
+    float bonsaiLodErrors[MaxMeshLods] = {};
+    long long bonsaiLodTriangles[MaxMeshLods] = {};
+    int bonsaiLodCount = 1;
+    //level each bonsai drew at last frame, where the hysteresis starts from
+    std::vector<int> bonsaiLods;
+    //screen error the levels are picked against, raised while the bonsais go over the triangle budget
+    float lodPixelError = LodPixelError;
+    long long triangleBudget = 0;
+
+    //grow lamps, binned into the view's clusters every frame
+    const std::vector<PointLight>* lights = nullptr;
+    LightClusters lightClusters;
+
+    //sun shadow cascades, fitted around everything that casts
+    Aabb casterBounds;
+    CascadeFitter cascadeFitter;
+
+    //the shop's walls and every prop, the camera slides along them
+    CollisionWorld collision;
+    //what is under the cursor each frame
+    PickScene picking;
+};
+
 //Functions
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-void processInput(GLFWwindow* window);
+InputState sampleInput(GLFWwindow* window);
+void processInput(const InputState& input, const CollisionWorld& collision);
+void simulateFrame(SceneSimulation& simulation, const InputState& input, double frameTime, int frame, RenderPacket& packet);
+//frustum + occlusion culls the scene into the packet's visibility lists, picking each visible bonsai's level
+void cullVisible(SceneSimulation& simulation, const InputState& input, const glm::mat4& frameView, const glm::vec3& eye, RenderPacket& packet);
+//drops the visible items the podiums + wall hide from this view
+void cullOccluded(SceneSimulation& simulation, const glm::mat4& viewProjection, const glm::vec3& eye, OcclusionStats& stats);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void updateCameraVectors();
-void renderPodium(GLuint& VAO, GLuint& VBO, GLuint& EBO);
-void renderWall(GLuint& wallVAO, GLuint& wallVBO, GLuint& wallEBO);
-void renderCan(GLuint& canVAO, GLuint& canVBO, GLuint& canEBO);
-
-
-bool isInsideCube(const glm::vec3& point);
-
-//Model Loading Function
-bool loadModel(const std::string& filePath, std::vector<GLfloat>& vertices, std::vector<GLfloat>& colors, std::vector<GLfloat>& texCords) {
-    Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(filePath, aiProcess_Triangulate | aiProcess_FlipUVs);
-
-    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
-        std::cerr << "Assimp Error: " << importer.GetErrorString() << std::endl;
-        return false;
+void renderPodium(GLuint& VAO, GLuint& VBO, GLuint& EBO, Aabb& podiumBounds);
+void renderWall(GLuint& wallVAO, GLuint& wallVBO, GLuint& wallEBO, Aabb& wallBounds);
+void renderCan(GLuint& canVAO, GLuint& canVBO, GLuint& canEBO, Aabb& canBounds);
+//reads a prop's position + colour buffers back into a single submesh mesh in the model vertex layout
+void readPropMesh(GLuint VBO, GLuint EBO, MeshData& mesh);
+void buildPodiumGrid(int count, SceneGraph& graph, SceneNode parent, std::vector<SceneNode>& nodes, std::vector<InstanceData>& instances);
+//spreads count grow lamps in a grid just above area
+void buildGrowLamps(int count, const Aabb& area, std::vector<PointLight>& lights);
+//names the picked item and where on it the cursor is
+void printPick(const PickHit& hit, uint32_t canItem, uint32_t wallItem, uint32_t bonsaiItem, uint32_t shopItem);
+
+
+int main(int argc, char** argv) {
+    //read command line flags (headless benchmark etc)
+    LaunchOptions options;
+    if (!parseLaunchOptions(argc, argv, options)) {
+        return -1;
     }
 
-    std::cout << "Loading Asset " << filePath.c_str() << "\n";
-
-    const aiMesh* mesh = scene->mMeshes[0]; // Assuming the model has only one mesh
-
-    //increases the size of the 3d model
-    
-   
-    for (unsigned int i = 0; i < mesh->mNumVertices; ++i) {
-        // Add vertex positions
-        vertices.push_back(mesh->mVertices[i].x);
-        vertices.push_back(mesh->mVertices[i].y);
-        vertices.push_back(mesh->mVertices[i].z);
-
-        // Add vertex colors (assuming the model has colors)
-        if (mesh->HasVertexColors(0)) {
-            vertices.push_back(mesh->mColors[0][i].r);
-            vertices.push_back(mesh->mColors[0][i].g);
-            vertices.push_back(mesh->mColors[0][i].b);
-        }
-        else {
-            // If the model doesn't have colors, you can set a default color here.
-            vertices.push_back(1.0f); // Red
-            vertices.push_back(1.0f); // Green
-			vertices.push_back(1.0f); // Blue
-        }
-
-        if (mesh->HasTextureCoords(0)){
-            aiVector3D texCor = mesh->mTextureCoords[0][i];
-
-			vertices.push_back(texCor[0]);
-			vertices.push_back(texCor[1]);
-        }
+    //benchmark runs keep stdout for the json, so send logging to stderr
+    bool benchmarkRun = options.headless || options.benchLoad;
+    std::streambuf* consoleOut = std::cout.rdbuf();
+    if (benchmarkRun && options.jsonPath == "-") {
+        std::cout.rdbuf(std::cerr.rdbuf());
     }
 
-    return true;
-}
-// Number of Colour Channels to OpenGL
-const int ColourChanels[]{ 0 , GL_R, GL_RG, GL_RGB, GL_RGBA };
+    //scene graph update benchmark, cpu only so it runs before any window exists
+    if (options.benchScene) {
+        std::string json = benchmarkSceneGraph(100000);
+        return writeBenchmarkJson(json, options.jsonPath) ? 0 : -1;
+    }
 
-//Load Texture Function
-void loadTexture(GLuint& texture, std::string texturepath)
-{
-	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
-	// set the texture wrapping parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// set texture wrapping to GL_REPEAT (default wrapping method)
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	// set texture filtering parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	// load image, create texture and generate mipmaps
-	GLint width, height, nrChannels;
-	stbi_set_flip_vertically_on_load(true); // tell stb_image.h to flip loaded texture's on the y-axis.
-	unsigned char* data = stbi_load(texturepath.c_str(), &width, &height, &nrChannels, 0);
-	if (data)
-	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, ColourChanels[nrChannels], GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-		std::cout << "Loaded texture " << texturepath.c_str() << std::endl;
-	}
-	else
-	{
-		std::cout << "Failed to load texture" << std::endl;
-	}
-	stbi_image_free(data);
-}
+    //--profile records from here, so the loading shows up too
+    setProfilerThreadName("GL");
+    if (options.profile) {
+        startProfiler();
+    }
 
-int main() {
     //Setting scrollback function
     glfwSetScrollCallback(window, scroll_callback);
 
@@ -146,13 +185,36 @@ int main() {
         std::cerr << "GLFW initialization failed\n";
         return -1;
     }
-    //Configure GLFW window properties
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    //Configure GLFW window properties, the gpu driven path needs compute shaders from 4.3
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, options.gpuDriven ? 4 : 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-    //Create GLFW window
-    window = glfwCreateWindow(800, 600, "OpenGL Bonsai Model Loader", nullptr, nullptr);
+    //headless window is never shown, the scene goes to an offscreen framebuffer
+    if (benchmarkRun) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
+
+    //Create GLFW window at the hinted version, benchmark runs with no usable native driver (build farm)
+    //fall back to a software OSMesa context at the same version
+    auto createWindow = [benchmarkRun]() {
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_NATIVE_CONTEXT_API);
+        GLFWwindow* created = glfwCreateWindow(800, 600, "OpenGL Bonsai Model Loader", nullptr, nullptr);
+        if (!created && benchmarkRun) {
+            std::cerr << "Native context failed, retrying with OSMesa\n";
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+            created = glfwCreateWindow(800, 600, "OpenGL Bonsai Model Loader", nullptr, nullptr);
+        }
+        return created;
+    };
+    window = createWindow();
+    //the gpu driven path only gives up once neither the native driver nor llvmpipe can make a 4.3 context
+    if (!window && options.gpuDriven) {
+        std::cerr << "No OpenGL 4.3 context, drawing without the gpu driven path\n";
+        options.gpuDriven = false;
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        window = createWindow();
+    }
     if (!window) {
         std::cerr << "Failed to create GLFW window\n";
         glfwTerminate();
@@ -176,266 +238,828 @@ int main() {
         glfwTerminate();
         return -1;
     }
+    if (options.gpuDriven && !GpuScene::supported()) {
+        std::cerr << "Driver can't run the gpu driven path, drawing without it\n";
+        options.gpuDriven = false;
+    }
 
-    //load room model
-    std::vector<GLfloat> roomVertices, roomColors, roomTex;
-    if (!loadModel("./Models/shop2.obj", roomVertices, roomColors, roomTex)) {
-        std::cerr << "Failed to load model" << std::endl;
-        glfwTerminate();
-        return -1;
-	}
-
-    //load bonsai model
-    std::vector<GLfloat> bonsaiVertices, bonsaiColors, bonsaiTex;
-    if (!loadModel("./Models/Bonsai.obj", bonsaiVertices, bonsaiColors, bonsaiTex)) {
-        std::cerr << "Failed to load model" << std::endl;
+    //cold vs warm model load benchmark, no scene needed
+    if (options.benchLoad) {
+        std::vector<std::string> models = { "./Models/Shop2.obj", "./Models/Bonsai.obj" };
+        std::string json = benchmarkModelLoads(models);
+        std::cout.rdbuf(consoleOut);
+        bool written = !json.empty() && writeBenchmarkJson(json, options.jsonPath);
         glfwTerminate();
-        return -1;
+        return written ? 0 : -1;
+    }
+    initGpuProfiler();
+
+    //offscreen target + frame timing for headless benchmark runs
+    OffscreenTarget offscreen;
+    FrameTimer frameTimer;
+    if (options.headless) {
+        if (!createOffscreenTarget(offscreen, 800, 600)) {
+            glfwTerminate();
+            return -1;
+        }
+        glViewport(0, 0, 800, 600);
+        //never wait on vsync, we want the raw frame cost
+        glfwSwapInterval(0);
+        frameTimer.init();
+        std::cout << "Headless run of " << options.frames << " frames on " << glGetString(GL_RENDERER) << std::endl;
     }
- 
-    //Create + Load textures for shop model
-	GLuint shopVAO, shopVBO;
-	GLuint shopTexture;
-    //load texture for bonsai model from file path
-	loadTexture(shopTexture, "./Models/Textures/brick.jpg");
-
-    glGenVertexArrays(1, &shopVAO);
-    glGenBuffers(1, &shopVBO);
-
-    //Setup VAO for room model
-    glBindVertexArray(shopVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, shopVBO);
-    glBufferData(GL_ARRAY_BUFFER, roomVertices.size() * sizeof(GLfloat), roomVertices.data(), GL_STATIC_DRAW);
-
-    // Vertex attribute for position
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)0);
-    glEnableVertexAttribArray(0);
-
-    // Vertex attribute for color
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(1);
-
-	// Vertex attribute for texture coords
-	glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(6 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(3);
-
-    // Unbind the VAO to prevent accidental changes
-    glBindVertexArray(0);
-
-
-    //create + Load textures for bonsai model
-    GLuint bonsaiVAO, bonsaiVBO;
-	GLuint bonsaiTexture;
-    
-    //load texture for bonsai model from filepath
-	loadTexture(bonsaiTexture, "./Models/Textures/tree.jpg");
-
-    glGenVertexArrays(1, &bonsaiVAO);
-    glGenBuffers(1, &bonsaiVBO);
-
-    //set up VAO for bonsai model
-    glBindVertexArray(bonsaiVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, bonsaiVBO);
-    glBufferData(GL_ARRAY_BUFFER, bonsaiVertices.size() * sizeof(GLfloat), bonsaiVertices.data(), GL_STATIC_DRAW);
-
-    // Vertex attribute for position
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)0);
-    glEnableVertexAttribArray(0);
 
-    // Vertex attribute for color
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(1);
+    //shop + bonsai models and their textures, filled in by the loader jobs
+    LoadedModel roomMesh, bonsaiMesh;
+    //triangles the camera walks into (the shop) and the cursor picks (every model)
+    TriangleBvh shopBvh, bonsaiBvh;
+    GpuMesh shopGpuMesh, bonsaiGpuMesh;
+    DecodedImage shopImage, bonsaiImage;
+    LoadedTexture shopCompressed, bonsaiCompressed;
+    GLuint shopTexture = 0, bonsaiTexture = 0;
+
+    //assets parse/decode on worker threads, GL uploads come back to this thread through the completion queue
+    //declared after the assets so the workers are joined before anything they write to is destroyed
+    std::chrono::steady_clock::time_point loadStart = std::chrono::steady_clock::now();
+    CompletionQueue uploads;
+    JobSystem jobs;
+    std::atomic<int> pendingAssets(0);
+    std::atomic<bool> assetFailed(false);
+
+    //queues a model: assimp or mesh cache on a worker, buffer upload on the GL thread
+    //its triangle bvh is built from (or read from its cache next to) the model on the same worker
+    auto queueModel = [&](const std::string& path, LoadedModel* model, GpuMesh* gpuMesh, TriangleBvh* bvh) {
+        ++pendingAssets;
+        jobs.submit([path, model, gpuMesh, bvh, &uploads, &pendingAssets, &assetFailed]() {
+            if (!loadModelCached(path, *model)) {
+                std::cerr << "Failed to load model " << path << std::endl;
+                assetFailed = true;
+                --pendingAssets;
+                return;
+            }
+            //without it the model can't be picked and only its bounds are collided with
+            if (!loadTriangleBvhCached(path, model->view, *bvh)) {
+                std::cerr << "No collision mesh for " << path << std::endl;
+            }
+            uploads.push([model, gpuMesh, &pendingAssets]() {
+                uploadMesh(model->view, *gpuMesh);
+                --pendingAssets;
+            });
+        });
+    };
 
-	// Vertex attribute for texture coords
-	glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(6 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(3);
+    //queues a texture: BC1/BC3 mip chain from the texture cache (baked on first run) when the driver
+    //can sample S3TC, otherwise jpeg decode on a worker, texture upload on the GL thread either way
+    bool compressedTextures = GLEW_EXT_texture_compression_s3tc != 0;
+    auto queueTexture = [&](const std::string& path, DecodedImage* image, LoadedTexture* compressed, GLuint* texture) {
+        ++pendingAssets;
+        jobs.submit([path, image, compressed, texture, compressedTextures, &uploads, &pendingAssets, &assetFailed]() {
+            if (compressedTextures) {
+                if (!loadTextureCached(path, *compressed)) {
+                    assetFailed = true;
+                    --pendingAssets;
+                    return;
+                }
+                uploads.push([compressed, texture, &pendingAssets]() {
+                    uploadCompressedTexture(*texture, compressed->image);
+                    //GL has its own copy now, release the mapping
+                    *compressed = LoadedTexture();
+                    --pendingAssets;
+                });
+                return;
+            }
+            if (!decodeTexture(path, *image)) {
+                assetFailed = true;
+                --pendingAssets;
+                return;
+            }
+            uploads.push([image, texture, &pendingAssets]() {
+                uploadTexture(*texture, *image);
+                freeImage(*image);
+                --pendingAssets;
+            });
+        });
+    };
 
-    // Unbind the VAO to prevent accidental changes
-    glBindVertexArray(0);
+    queueModel("./Models/Shop2.obj", &roomMesh, &shopGpuMesh, &shopBvh);
+    queueModel("./Models/Bonsai.obj", &bonsaiMesh, &bonsaiGpuMesh, &bonsaiBvh);
+    queueTexture("./Models/Textures/brick.jpg", &shopImage, &shopCompressed, &shopTexture);
+    queueTexture("./Models/Textures/tree.jpg", &bonsaiImage, &bonsaiCompressed, &bonsaiTexture);
 
     //cleanup Bindings and configs
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
     glDisable(GL_CULL_FACE);
     
-    //compile and link shaders
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
-    glCompileShader(vertexShader);
-
-    GLint success;
-    GLchar infoLog[512];
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(vertexShader, 512, nullptr, infoLog);
-        std::cerr << "Vertex shader compilation failed:\n" << infoLog << std::endl;
-        glfwTerminate();
-        return -1;
-    }
-    
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, nullptr);
-    glCompileShader(fragmentShader);
-
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(fragmentShader, 512, nullptr, infoLog);
-        std::cerr << "Fragment shader compilation failed:\n" << infoLog << std::endl;
-        glfwTerminate();
-        return -1;
+    //shader variants come from the program binary cache, or compile on a worker context while the assets load
+    //every active uniform location is cached once a program is ready
+    ShaderManager shaders;
+    shaders.start(window);
+    //the sampler always reads texture unit 0
+    shaders.bindSampler("texture_main", 0);
+    shaders.bindSampler("clusterCells", ClusterCellsUnit);
+    shaders.bindSampler("clusterLightIndices", ClusterIndicesUnit);
+    shaders.bindSampler("clusterLights", ClusterLightsUnit);
+    shaders.bindSampler("shadowCascades", ShadowCascadesUnit);
+
+    //cheapest variant each material needs: the cube props have neither uvs nor normals, so they skip the
+    //texture fetch and the lighting, the models keep the full textured + lit path
+    const unsigned propFeatures = ShaderVertexColor;
+    const unsigned podiumFeatures = ShaderVertexColor | ShaderInstanced;
+    const unsigned modelFeatures = ShaderVertexColor | ShaderTexture | ShaderLighting;
+    const unsigned bonsaiFeatures = modelFeatures | ShaderInstanced;
+    //shadow casters only need positions
+    const unsigned casterFeatures = ShaderDepthOnly;
+    const unsigned podiumCasterFeatures = ShaderDepthOnly | ShaderInstanced;
+    for (unsigned features : { propFeatures, podiumFeatures, modelFeatures, bonsaiFeatures, casterFeatures, podiumCasterFeatures }) {
+        shaders.variant(features);
     }
-
-    //create and link shader program
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-    //check for shader program link errors
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(shaderProgram, 512, nullptr, infoLog);
-        std::cerr << "Shader program linking failed:\n" << infoLog << std::endl;
-        glfwTerminate();
-        return -1;
+    //the gpu driven path draws props, bonsais and the shop as one multi draw each, instances come from its storage buffer
+    const unsigned gpuPropFeatures = ShaderVertexColor | ShaderGpuDriven;
+    const unsigned gpuModelFeatures = modelFeatures | ShaderGpuDriven;
+    //occluders go into the depth pre-pass with positions only
+    const unsigned gpuOccluderFeatures = ShaderDepthOnly | ShaderGpuDriven;
+    if (options.gpuDriven) {
+        shaders.variant(gpuPropFeatures);
+        shaders.variant(gpuModelFeatures);
+        shaders.variant(gpuOccluderFeatures);
     }
 
-
-    //clean up shader objects after linking
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-
     cameraPos = glm::vec3(-0.35f, 0.0f, 0.0f);
-    GLuint roomLoc = glGetUniformLocation(shaderProgram, "room");
-    GLuint bonsaiLoc = glGetUniformLocation(shaderProgram, "plant");
    
     //podium
 
     GLuint VBO, VAO, EBO;
-    renderPodium(VAO, VBO, EBO);
+    Aabb podiumBounds;
+    renderPodium(VAO, VBO, EBO, podiumBounds);
+
+    //where everything in the shop sits: the room is the root, the can, wall and podiums hang off it and each bonsai
+    //off its podium; nothing moves, so the world matrices are worked out once here
+    SceneGraph sceneGraph;
+    SceneNode shopNode = sceneGraph.addNode(NoSceneNode, glm::vec3(-1.0f, 0.0f, 0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.1f));
+    SceneNode canNode = sceneGraph.addNode(shopNode, glm::vec3(0.0f));
+    SceneNode wallNode = sceneGraph.addNode(shopNode, glm::vec3(0.0f));
+
+    //every podium is drawn in one instanced call, transforms + tints stream through the instance buffer
+    std::vector<InstanceData> podiumGrid;
+    std::vector<SceneNode> podiumNodes;
+    buildPodiumGrid(options.podiumCount, sceneGraph, shopNode, podiumNodes, podiumGrid);
+    InstanceBuffer podiumInstances;
+    podiumInstances.attach(VAO);
+    //every podium casts a shadow whether the camera sees it or not
+    InstanceBuffer podiumCasters;
+
+    //the first podium's bonsai, or one on every podium with --bonsais, drawn instanced per detail level
+    std::vector<InstanceData> bonsais;
+    std::vector<SceneNode> bonsaiNodes;
+    for (SceneNode podiumNode : podiumNodes) {
+        bonsaiNodes.push_back(sceneGraph.addNode(podiumNode, glm::vec3(0.0f)));
+        if (!options.bonsaiGrid) {
+            break;
+        }
+    }
+
+    sceneGraph.update();
+    glm::mat4 shopModel = sceneGraph.world(shopNode);
+    glm::mat4 canModel = sceneGraph.world(canNode);
+    glm::mat4 wallModel = sceneGraph.world(wallNode);
+    for (size_t i = 0; i < podiumNodes.size(); ++i) {
+        podiumGrid[i].model = sceneGraph.world(podiumNodes[i]);
+    }
+    for (SceneNode bonsaiNode : bonsaiNodes) {
+        InstanceData bonsai;
+        bonsai.model = sceneGraph.world(bonsaiNode);
+        bonsai.color = glm::vec4(1.0f);
+        bonsais.push_back(bonsai);
+    }
+    InstanceBuffer bonsaiInstances[MaxMeshLods];
+    InstanceBuffer bonsaiCasters;
+
+    //every per frame upload (camera + light block, model matrices, podium instances) is sub-allocated
+    //from one ring buffer, each region is sized for the worst case of every podium visible plus every podium casting
+    StreamBuffer frameStream;
+    frameStream.create((GLsizeiptr)(podiumGrid.size() + bonsais.size()) * sizeof(InstanceData) * 2 + 64 * 1024);
+
+    //draws are queued each frame then sorted by program/texture/VAO before anything is bound
+    RenderQueue renderQueue;
+    renderQueue.setDepthRange(100.0f);
 
 
     //watering can
 
     GLuint canVBO, canVAO, canEBO;
-    renderCan(canVAO, canVBO, canEBO);
+    Aabb canBounds;
+    renderCan(canVAO, canVBO, canEBO, canBounds);
 
 
     //wall
 
     GLuint wallVBO, wallVAO, wallEBO;
-    renderWall(wallVAO, wallVBO, wallEBO);
+    Aabb wallBounds;
+    renderWall(wallVAO, wallVBO, wallEBO, wallBounds);
 
    
     
 
     view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
     projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
-    glm::mat4 canModel;
 
 
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    if (!options.headless) {
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    }
 
-    // Main rendering loop 
-    while (!glfwWindowShouldClose(window)) {
-        //calculate time related values for clean motion
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-        //Process input from processInput function - Handles wasd and mouse
-        processInput(window);
+    //keep presenting a loading screen while the assets stream in
+    while (pendingAssets > 0) {
+        uploads.drain();
+        shaders.poll();
+        if (options.headless) {
+            std::this_thread::yield();
+            continue;
+        }
+        float pulse = 0.75f + 0.25f * std::sin((float)glfwGetTime() * 4.0f);
+        glClearColor(0.2f * pulse, 0.3f * pulse, 0.3f * pulse, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+    }
+    uploads.drain();
+
+    //benchmark runs time the scene, not the compile, so they still wait for every program here
+    while (options.headless && !shaders.idle() && !shaders.failed()) {
+        shaders.poll();
+        std::this_thread::yield();
+    }
+    shaders.poll();
+
+    if (assetFailed || shaders.failed()) {
+        std::cerr << (assetFailed ? "Failed to load model" : "Failed to build shaders") << std::endl;
+        shaders.stop();
+        glfwTerminate();
+        return -1;
+    }
+    std::chrono::duration<double, std::milli> loadTime = std::chrono::steady_clock::now() - loadStart;
+    std::cout << "Assets ready in " << loadTime.count() << " ms on " << jobs.workerCount() << " worker threads" << std::endl;
+
+    //world bounds of every scene item, podiums first then the single props
+    std::vector<Aabb> sceneBounds;
+    for (const InstanceData& podium : podiumGrid) {
+        sceneBounds.push_back(transformAabb(podiumBounds, podium.model));
+    }
+    uint32_t canItem = (uint32_t)sceneBounds.size();
+    sceneBounds.push_back(transformAabb(canBounds, canModel));
+    uint32_t wallItem = (uint32_t)sceneBounds.size();
+    sceneBounds.push_back(transformAabb(wallBounds, wallModel));
+    uint32_t bonsaiItem = (uint32_t)sceneBounds.size();
+    Aabb bonsaiBounds;
+    bonsaiBounds.min = bonsaiMesh.boundsMin;
+    bonsaiBounds.max = bonsaiMesh.boundsMax;
+    for (const InstanceData& bonsai : bonsais) {
+        sceneBounds.push_back(transformAabb(bonsaiBounds, bonsai.model));
+    }
+    uint32_t shopItem = (uint32_t)sceneBounds.size();
+    Aabb shopBounds;
+    shopBounds.min = roomMesh.boundsMin;
+    shopBounds.max = roomMesh.boundsMax;
+    sceneBounds.push_back(transformAabb(shopBounds, shopModel));
+
+    //nothing in the shop moves, so the hierarchy is built once
+    SceneBvh sceneBvh;
+    sceneBvh.build(sceneBounds);
+
+    //grow lamps hang over the podiums, their data is uploaded once and only the clusters change per frame
+    Aabb podiumArea;
+    for (uint32_t item = 0; item < canItem; ++item) {
+        growAabb(podiumArea, sceneBounds[item]);
+    }
+    std::vector<PointLight> growLamps;
+    buildGrowLamps(options.lightCount, podiumArea, growLamps);
+    std::vector<glm::vec4> lampTexels;
+    packPointLights(growLamps, lampTexels);
+    ClusterLightBuffers clusterBuffers;
+    clusterBuffers.create();
+    clusterBuffers.uploadLights(lampTexels);
+
+    //the shop room only receives the sun's shadows, its roof would otherwise shade everything
+    Aabb casterBounds;
+    for (uint32_t item = 0; item < shopItem; ++item) {
+        growAabb(casterBounds, sceneBounds[item]);
+    }
+    ShadowMaps shadowMaps;
+    shadowMaps.create();
+
+    //the podium + wall triangles are the occluders on both culling paths, every prop's are picked against
+    MeshData podiumMesh, canMesh, wallMesh;
+    readPropMesh(VBO, EBO, podiumMesh);
+    readPropMesh(canVBO, canEBO, canMesh);
+    readPropMesh(wallVBO, wallEBO, wallMesh);
+    TriangleBvh podiumBvh, canBvh, wallBvh;
+    podiumBvh.build(meshView(podiumMesh));
+    canBvh.build(meshView(canMesh));
+    wallBvh.build(meshView(wallMesh));
+
+    //the same static scene again for the gpu driven path, every mesh in one buffer and every item an instance
+    enum { GpuPropGroup, GpuBonsaiGroup, GpuShopGroup };
+    GpuScene gpuScene;
+    bool gpuDriven = false;
+    if (options.gpuDriven) {
+        int podiumIndex = gpuScene.addMesh(meshView(podiumMesh), GpuPropGroup, true);
+        int canIndex = gpuScene.addMesh(meshView(canMesh), GpuPropGroup);
+        int wallIndex = gpuScene.addMesh(meshView(wallMesh), GpuPropGroup, true);
+        int bonsaiIndex = gpuScene.addMesh(bonsaiMesh.view, GpuBonsaiGroup);
+        int shopIndex = gpuScene.addMesh(roomMesh.view, GpuShopGroup);
+        for (const InstanceData& podium : podiumGrid) {
+            gpuScene.addInstance(podiumIndex, podium.model, podium.color, podiumBounds);
+        }
+        gpuScene.addInstance(canIndex, canModel, glm::vec4(1.0f), canBounds);
+        gpuScene.addInstance(wallIndex, wallModel, glm::vec4(1.0f), wallBounds);
+        for (const InstanceData& bonsai : bonsais) {
+            gpuScene.addInstance(bonsaiIndex, bonsai.model, bonsai.color, bonsaiBounds);
+        }
+        gpuScene.addInstance(shopIndex, shopModel, glm::vec4(1.0f), shopBounds);
+        gpuDriven = gpuScene.build();
+        if (!gpuDriven) {
+            std::cerr << "GPU driven scene failed to build, drawing without it" << std::endl;
+            gpuScene.destroy();
+            options.gpuDriven = false;
+        }
+    }
+
+    //input, camera movement, collision and culling, frames draw in between the last two fixed steps
+    SceneSimulation simulation;
+    simulation.sceneBvh = &sceneBvh;
+    simulation.podiumGrid = &podiumGrid;
+    simulation.canItem = canItem;
+    simulation.wallItem = wallItem;
+    simulation.bonsaiItem = bonsaiItem;
+    simulation.bonsais = &bonsais;
+    simulation.bonsaiCentre = (bonsaiMesh.boundsMin + bonsaiMesh.boundsMax) * 0.5f;
+    //the render thread picks shadow caster levels from its own copy, the simulation's belongs to its thread
+    float bonsaiLodErrors[MaxMeshLods] = {};
+    int bonsaiLodCount = meshLodErrors(bonsaiGpuMesh.submeshes.data(), bonsaiGpuMesh.submeshes.size(), bonsaiLodErrors);
+    std::copy(bonsaiLodErrors, bonsaiLodErrors + MaxMeshLods, simulation.bonsaiLodErrors);
+    simulation.bonsaiLodCount = bonsaiLodCount;
+    for (int level = 0; level < simulation.bonsaiLodCount; ++level) {
+        for (const Submesh& submesh : bonsaiGpuMesh.submeshes) {
+            simulation.bonsaiLodTriangles[level] += submesh.lods[std::min(level, (int)submesh.lodCount - 1)].indexCount / 3;
+        }
+    }
+    simulation.bonsaiLods.assign(bonsais.size(), 0);
+    simulation.triangleBudget = options.triangleBudget;
+    //every level shares the mesh's VAO, only the instance range differs
+    bonsaiInstances[0].attach(bonsaiGpuMesh.VAO);
+    simulation.shopItem = shopItem;
+    //the can and wall are drawn with one shared placement
+    simulation.propModel = canModel;
+    simulation.visibleItems.reserve(sceneBounds.size());
+    simulation.occlusionEnabled = options.occlusion;
+    simulation.itemBounds = &sceneBounds;
+    //every prop is solid, the shop itself is a room to stay inside of rather than a box to stay out of
+    for (uint32_t item = 0; item < shopItem; ++item) {
+        simulation.collision.addBox(sceneBounds[item]);
+    }
+    if (shopBvh.triangleCount() > 0) {
+        simulation.collision.addMesh(shopBvh, shopModel);
+    }
+    else {
+        simulation.collision.addRoom(sceneBounds[shopItem], 1.0f);
+    }
+    //every item is picked against its own mesh's triangles
+    simulation.picking.attach(sceneBvh);
+    for (uint32_t item = 0; item < canItem; ++item) {
+        simulation.picking.setItem(item, &podiumBvh, podiumGrid[item].model);
+    }
+    simulation.picking.setItem(canItem, &canBvh, canModel);
+    simulation.picking.setItem(wallItem, &wallBvh, wallModel);
+    for (size_t i = 0; i < bonsais.size(); ++i) {
+        simulation.picking.setItem(bonsaiItem + (uint32_t)i, &bonsaiBvh, bonsais[i].model);
+    }
+    simulation.picking.setItem(shopItem, &shopBvh, shopModel);
+    simulation.podiumOccluder = occluderFromVertices(podiumMesh.vertices.data(), podiumMesh.vertexCount(), VertexStride,
+        podiumMesh.indices.data(), podiumMesh.indices.size());
+    simulation.wallOccluder = occluderFromVertices(wallMesh.vertices.data(), wallMesh.vertexCount(), VertexStride,
+        wallMesh.indices.data(), wallMesh.indices.size());
+    simulation.podiumTriangles = podiumMesh.indices.size() / 3;
+    //the can is drawn with the same 36 indices as the other props
+    simulation.canTriangles = 36 / 3;
+    simulation.wallTriangles = wallMesh.indices.size() / 3;
+    for (const Submesh& submesh : shopGpuMesh.submeshes) {
+        simulation.shopTriangles += submesh.lods[0].indexCount / 3;
+    }
+    simulation.lights = &growLamps;
+    simulation.casterBounds = casterBounds;
+    simulation.currentState.cameraPos = cameraPos;
+    simulation.previousState = simulation.currentState;
+    simulation.lastFrameTime = options.headless ? 0.0 : glfwGetTime();
+
+    //gpu instances are numbered like the scene items, only podiums and bonsais have a colour to tint
+    uint32_t gpuHighlight = NoPick;
+    auto setGpuHighlight = [&](uint32_t item, bool highlighted) {
+        glm::vec4 color;
+        if (item < canItem) {
+            color = podiumGrid[item].color;
+        }
+        else if (item >= bonsaiItem && item < bonsaiItem + (uint32_t)bonsais.size()) {
+            color = bonsais[item - bonsaiItem].color;
+        }
+        else {
+            return;
+        }
+        gpuScene.setInstanceColor((int)item, highlighted ? color * HoverHighlight : color);
+    };
 
+    //draws one packet, everything in it was decided by the simulation stage
+    auto renderFrame = [&](const RenderPacket& packet) {
+        CpuScope renderScope("render");
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         //clears screen and depth buffer
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        //Use shader for rendering
-        glUseProgram(shaderProgram);
+        //variants still compiling on the worker, show the cleared frame until they arrive
+        RenderQueueStats stats;
+        const ShaderProgram& propShader = shaders.variant(propFeatures);
+        const ShaderProgram& podiumShader = shaders.variant(podiumFeatures);
+        const ShaderProgram& modelShader = shaders.variant(modelFeatures);
+        const ShaderProgram& bonsaiShader = shaders.variant(bonsaiFeatures);
+        const ShaderProgram& casterShader = shaders.variant(casterFeatures);
+        const ShaderProgram& podiumCasterShader = shaders.variant(podiumCasterFeatures);
+        if (!propShader.ready() || !podiumShader.ready() || !modelShader.ready() || !bonsaiShader.ready() ||
+            !casterShader.ready() || !podiumCasterShader.ready()) {
+            return stats;
+        }
+        const ShaderProgram& gpuPropShader = shaders.variant(gpuPropFeatures);
+        const ShaderProgram& gpuModelShader = shaders.variant(gpuModelFeatures);
+        const ShaderProgram& gpuOccluderShader = shaders.variant(gpuOccluderFeatures);
+        if (packet.gpuDriven && (!gpuPropShader.ready() || !gpuModelShader.ready() || !gpuOccluderShader.ready())) {
+            return stats;
+        }
 
-        // Update view matrix
-        view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-        // Update projection matrix
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+        frameStream.beginFrame();
+
+        //the cube props are vertex coloured only, no texture is bound for them
+        DrawCommand prop;
+        prop.program = propShader.id();
+        prop.indexCount = 36;
+        ObjectUniforms propObject;
+        propObject.model = packet.propModel;
+        prop.objectBuffer = frameStream.id();
+        prop.objectOffset = frameStream.allocate(&propObject, sizeof(propObject), frameStream.uniformAlignment());
+        prop.model = packet.propModel;
+
+        //sun cascades whose matrices moved since they were last drawn, nothing in the shop moves so the rest are kept
+        const ShadowCascadeSet& cascades = packet.shadowCascades;
+        bool castersUploaded = false;
+        for (int cascade = 0; cascade < ShadowCascadeCount; ++cascade) {
+            glm::mat4 lightViewProjection = cascades.lightProjection[cascade] * cascades.lightView[cascade];
+            if (!shadowMaps.needsRender(cascade, lightViewProjection)) {
+                continue;
+            }
+            RenderScope scope("shadow cascade");
+            if (!castersUploaded) {
+                podiumCasters.upload(frameStream, podiumGrid.data(), (GLsizei)podiumGrid.size());
+                bonsaiCasters.upload(frameStream, bonsais.data(), (GLsizei)bonsais.size());
+                castersUploaded = true;
+            }
+
+            GLint framebuffer = 0;
+            GLint viewport[4];
+            glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            shadowMaps.beginCascade(cascade);
+
+            //same FrameData block, seen from the sun
+            FrameUniforms casterUniforms = packet.uniforms;
+            casterUniforms.view = cascades.lightView[cascade];
+            casterUniforms.projection = cascades.lightProjection[cascade];
+            GLintptr casterOffset = frameStream.allocate(&casterUniforms, sizeof(casterUniforms), frameStream.uniformAlignment());
+            glBindBufferRange(GL_UNIFORM_BUFFER, FrameUniformBinding, frameStream.id(), casterOffset, sizeof(FrameUniforms));
+
+            DrawCommand caster = prop;
+            caster.program = casterShader.id();
+            caster.vao = canVAO;
+            renderQueue.submit(caster, 0.0f);
+            caster.vao = wallVAO;
+            renderQueue.submit(caster, 0.0f);
+            DrawCommand instancedCaster = caster;
+            instancedCaster.program = podiumCasterShader.id();
+            instancedCaster.vao = VAO;
+            instancedCaster.instances = &podiumCasters;
+            if (podiumCasters.count() > 0) {
+                renderQueue.submit(instancedCaster, 0.0f);
+            }
+            //bonsais at the level a shadow map texel can still resolve, the ortho scale is 1 / half extent
+            int casterLod = selectLod(bonsaiLodErrors, bonsaiLodCount,
+                ShadowMapSize * 0.5f * casterUniforms.projection[0][0] * glm::length(glm::vec3(bonsais[0].model[0])),
+                LodPixelError, 0);
+            instancedCaster.instances = &bonsaiCasters;
+            if (bonsaiCasters.count() > 0) {
+                renderQueue.submitMesh(bonsaiGpuMesh, instancedCaster, casterUniforms.view, casterLod);
+            }
+
+            //slope scaled offset keeps the lit faces from shadowing themselves
+            glEnable(GL_POLYGON_OFFSET_FILL);
+            glPolygonOffset(2.0f, 4.0f);
+            stats += renderQueue.execute();
+            glDisable(GL_POLYGON_OFFSET_FILL);
+
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+            shadowMaps.markRendered(cascade, lightViewProjection);
+        }
 
-        glUniform3fv(glGetUniformLocation(shaderProgram, "lightDir"), 1, glm::value_ptr(lightDirection));
-        glUniform3fv(glGetUniformLocation(shaderProgram, "lightAmbient"), 1, glm::value_ptr(lightAmbient));
+        //upload camera + light state once for every program
+        {
+            RenderScope scope("upload uniforms");
+            GLintptr frameOffset = frameStream.allocate(&packet.uniforms, sizeof(packet.uniforms), frameStream.uniformAlignment());
+            glBindBufferRange(GL_UNIFORM_BUFFER, FrameUniformBinding, frameStream.id(), frameOffset, sizeof(FrameUniforms));
+        }
 
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        //the gpu culls + picks levels itself, the packet's visibility lists are only for the cpu path below
+        if (packet.gpuDriven) {
+            //instance colours live on the gpu, so only the item the cursor moved on or off is rewritten
+            if (packet.hover.item != gpuHighlight) {
+                setGpuHighlight(gpuHighlight, false);
+                setGpuHighlight(packet.hover.item, true);
+                gpuHighlight = packet.hover.item;
+            }
+            //occluder depth first, everything else is culled against the pyramid built from it
+            gpuScene.beginTarget();
+            if (options.occlusion) {
+                RenderScope scope("draw occluders");
+                glUseProgram(gpuOccluderShader.id());
+                ++stats.programChanges;
+                gpuScene.drawOccluders();
+            }
+            {
+                RenderScope scope("gpu cull");
+                gpuScene.cull(packet.uniforms.view, packet.uniforms.projection, packet.lodPixelError);
+            }
+            {
+                RenderScope scope("upload clusters");
+                clusterBuffers.uploadClusters(packet.clusterCells, packet.clusterLightIndices);
+                stats.textureChanges += clusterBuffers.bind();
+                stats.textureChanges += shadowMaps.bind();
+            }
+
+            {
+                RenderScope scope("draw props");
+                glUseProgram(gpuPropShader.id());
+                gpuScene.drawGroup(GpuPropGroup);
+            }
+            {
+                RenderScope scope("draw bonsais");
+                glUseProgram(gpuModelShader.id());
+                glBindTexture(GL_TEXTURE_2D, bonsaiTexture);
+                gpuScene.drawGroup(GpuBonsaiGroup);
+            }
+            {
+                RenderScope scope("draw shop");
+                glBindTexture(GL_TEXTURE_2D, shopTexture);
+                gpuScene.drawGroup(GpuShopGroup);
+            }
+            gpuScene.endTarget();
+            frameStream.endFrame();
+            clusterBuffers.endFrame();
+            stats.programChanges += 2;
+            stats.textureChanges += 2;
+
+            //the pre-pass + one multi draw per group, and the binds the scene made for them and the culling
+            const GpuSceneStats& sceneStats = gpuScene.stats();
+            stats.draws += sceneStats.multiDraws;
+            stats.programChanges += sceneStats.programChanges;
+            stats.textureChanges += sceneStats.textureChanges;
+            stats.vaoChanges += sceneStats.vaoChanges;
+            stats.objectBinds += sceneStats.bufferBinds;
+            //triangles come back from the gpu a few frames late
+            stats.triangles += sceneStats.triangles;
+            return stats;
+        }
 
-        // Update model matrix for cube
-        glm::mat4 model = glm::mat4(1);
-        model = glm::translate(model, glm::vec3(-1.0f, 0.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.1));
+        //only visible podiums are streamed to the instance buffer
+        podiumInstances.upload(frameStream, packet.visiblePodiums.data(), (GLsizei)packet.visiblePodiums.size());
 
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+        float propDepth = viewDepth(packet.uniforms.view, glm::vec3(packet.propModel[3]));
 
+        DrawCommand podiumDraw = prop;
+        podiumDraw.program = podiumShader.id();
+        podiumDraw.vao = VAO;
+        podiumDraw.instances = &podiumInstances;
+        if (!packet.visiblePodiums.empty()) {
+            renderQueue.submit(podiumDraw, propDepth);
+        }
 
-        glm::mat4 roommodelMatrix = glm::translate(glm::mat4(-1.0f), glm::vec3(1.0f, 2.0f, 1.0f));
-        glm::mat4 plantmodelMatrix = glm::translate(glm::mat4(-1.0f), glm::vec3(2.0f, 1.0f, 2.0f));
-        
+        prop.vao = canVAO;
+        if (packet.canVisible) {
+            renderQueue.submit(prop, propDepth);
+        }
+        prop.vao = wallVAO;
+        if (packet.wallVisible) {
+            renderQueue.submit(prop, propDepth);
+        }
 
-        glUniformMatrix4fv(roomLoc, 1, GL_FALSE, glm::value_ptr(roommodelMatrix));
-        glUniformMatrix4fv(bonsaiLoc, 1, GL_FALSE, glm::value_ptr(plantmodelMatrix));
+        //bonsai + shop models, one draw per submesh
+        DrawCommand meshDraw = prop;
+        meshDraw.program = modelShader.id();
+        meshDraw.texture = bonsaiTexture;
+        DrawCommand bonsaiDraw = meshDraw;
+        bonsaiDraw.program = bonsaiShader.id();
+        for (int level = 0; level < MaxMeshLods; ++level) {
+            const std::vector<InstanceData>& atLevel = packet.visibleBonsais[level];
+            if (!atLevel.empty() && bonsaiInstances[level].upload(frameStream, atLevel.data(), (GLsizei)atLevel.size()) > 0) {
+                bonsaiDraw.instances = &bonsaiInstances[level];
+                renderQueue.submitMesh(bonsaiGpuMesh, bonsaiDraw, packet.uniforms.view, level);
+            }
+        }
+        meshDraw.texture = shopTexture;
+        if (packet.shopVisible) {
+            renderQueue.submitMesh(shopGpuMesh, meshDraw, packet.uniforms.view);
+        }
 
-        
+        //cells + light indices the simulation binned for this view
+        {
+            RenderScope scope("upload clusters");
+            clusterBuffers.uploadClusters(packet.clusterCells, packet.clusterLightIndices);
+            stats.textureChanges += clusterBuffers.bind();
+            stats.textureChanges += shadowMaps.bind();
+        }
 
-        glBindVertexArray(canVAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        //the queue sorts every group together by state, so it is timed as one
+        {
+            RenderScope scope("draw queue");
+            stats += renderQueue.execute();
+        }
+        frameStream.endFrame();
+        clusterBuffers.endFrame();
+        return stats;
+    };
 
-        float distanceFromCamera = 0.1f; // Adjust this value to bring the cube closer or farther
-        glm::vec3 yellowCubePosition = cameraPos;
+    //pipelined by default: the simulation thread builds frame N+1 while this thread draws frame N
+    //--serial runs both stages back to back on this thread instead
+    FramePipeline pipeline;
+    InputState firstInput = sampleInput(window);
+    firstInput.gpuDriven = gpuDriven;
+    pipeline.submitInput(firstInput);
+    std::thread simulationThread;
+    if (!options.serial) {
+        simulationThread = std::thread([&simulation, &pipeline, &options]() {
+            setProfilerThreadName("Simulation");
+            for (int frame = 0; !options.headless || frame < options.frames; ++frame) {
+                RenderPacket* packet = pipeline.beginPacket();
+                if (!packet) {
+                    break;
+                }
+                //headless runs step a fixed 60hz clock so every run renders the same frames
+                double frameTime = options.headless ? frame / 60.0 : glfwGetTime();
+                simulateFrame(simulation, pipeline.latestInput(), frameTime, frame, *packet);
+                pipeline.publishPacket();
+            }
+        });
+    }
+    RenderPacket serialPacket;
 
-        glm::mat4 canModel = glm::mat4(1.0f);  // Initialize the canModel matrix
-        canModel = glm::translate(canModel, yellowCubePosition);
-        canModel = glm::rotate(canModel, (float)glfwGetTime() * glm::radians(50.0f), glm::vec3(0.5f, 1.0f, 0.0f));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "canModel"), 1, GL_FALSE, glm::value_ptr(canModel));
+    // Main rendering loop 
+    int frameCount = 0;
+    bool toggleHeld = false;
+    bool selectHeld = false;
+    bool profileHeld = false;
+    while (options.headless ? frameCount < options.frames : !glfwWindowShouldClose(window)) {
+        //P starts a capture, or stops the running one and writes its trace, always between frames
+        bool profileDown = !options.headless && glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+        if (profileDown && !profileHeld) {
+            if (profilerRunning()) {
+                stopProfiler();
+                if (writeChromeTrace(options.profilePath)) {
+                    std::cout << "Profile written to " << options.profilePath << std::endl;
+                }
+            }
+            else {
+                startProfiler();
+                std::cout << "Profiling, press P again to stop" << std::endl;
+            }
+        }
+        profileHeld = profileDown;
 
-        glBindVertexArray(wallVAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        CpuScope frameScope("frame");
+        beginGpuProfilerFrame();
+        if (options.headless) {
+            frameTimer.beginFrame();
+        }
 
+        shaders.poll();
 
-        glm::mat4 wallModel = glm::mat4(1);
-        wallModel = glm::scale(wallModel, glm::vec3(0.1));
-        /* glm::mat4 wallModel = glm::mat4(1.0f);  */// Initialize the canModel matrix
-        wallModel = glm::translate(wallModel, glm::vec3(3.0f, 0.0f, 0.0f));
-        wallModel = glm::rotate(wallModel, (float)glfwGetTime() * glm::radians(50.0f), glm::vec3(0.5f, 1.0f, 0.0f));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "wallModel"), 1, GL_FALSE, glm::value_ptr(wallModel));
+        //G flips between the gpu driven and cpu driven paths when both are available
+        bool toggleDown = !options.headless && glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS;
+        if (toggleDown && !toggleHeld && options.gpuDriven) {
+            gpuDriven = !gpuDriven;
+            std::cout << (gpuDriven ? "GPU driven culling + multi draw indirect" : "CPU culling + render queue") << std::endl;
+        }
+        toggleHeld = toggleDown;
+
+        //Process input from sampleInput function - Handles wasd and esc, the simulation moves the camera
+        InputState input;
+        {
+            CpuScope scope("input");
+            input = sampleInput(window);
+            //the path to simulate for, the simulation skips the cpu culling while the gpu does it
+            input.gpuDriven = gpuDriven;
+            input.gpuTriangles = gpuDriven ? gpuScene.stats().triangles : 0;
+        }
+        const RenderPacket* packet = &serialPacket;
+        if (options.serial) {
+            double frameTime = options.headless ? frameCount / 60.0 : glfwGetTime();
+            simulateFrame(simulation, input, frameTime, frameCount, serialPacket);
+        }
+        else {
+            pipeline.submitInput(input);
+            CpuScope scope("wait for simulation");
+            packet = pipeline.acquirePacket();
+            if (!packet) {
+                break;
+            }
+        }
+
+        RenderQueueStats renderStats = renderFrame(*packet);
+        //left click reports what is under the cursor
+        bool selectDown = !options.headless && glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+        if (selectDown && !selectHeld) {
+            printPick(packet->hover, canItem, wallItem, bonsaiItem, shopItem);
+        }
+        selectHeld = selectDown;
+        PickStats pickStats = packet->pickStats;
+        CullStats cullStats = packet->cullStats;
+        OcclusionStats occlusionStats = packet->occlusionStats;
+        if (packet->gpuDriven) {
+            cullStats.visible = gpuScene.stats().visible;
+            cullStats.culled = gpuScene.stats().frustumCulled + gpuScene.stats().occluded;
+            occlusionStats.occluders = gpuScene.stats().occluders;
+            occlusionStats.occluded = gpuScene.stats().occluded;
+            occlusionStats.drawn = gpuScene.stats().visible;
+            occlusionStats.occludedTriangles = gpuScene.stats().occludedTriangles;
+            occlusionStats.microseconds = gpuScene.stats().occlusionMicroseconds;
+        }
+        ClusterBinStats lightStats = packet->lightStats;
+        if (!options.serial) {
+            pipeline.releasePacket();
+        }
 
+        //headless frames stay in the offscreen framebuffer, nothing to present
+        if (options.headless) {
+            frameTimer.recordRenderStats(renderStats.draws, renderStats.stateChanges(), renderStats.triangles);
+            frameTimer.recordCullStats(cullStats.visible, cullStats.culled);
+            frameTimer.recordLightStats(lightStats.lightReferences, lightStats.binMicroseconds);
+            frameTimer.recordOcclusionStats(occlusionStats.occluded, occlusionStats.drawn,
+                occlusionStats.occludedTriangles, occlusionStats.microseconds);
+            frameTimer.recordPickStats(pickStats.microseconds);
+            frameTimer.endFrame();
+        }
+        else {
+            //swap buffer and polls events
+            RenderScope scope("swap");
+            glfwSwapBuffers(window);
+        }
+        {
+            CpuScope scope("poll events");
+            glfwPollEvents();
+        }
 
-        //activate and bind textures for both models
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, bonsaiTexture);
-		glUniform1f(glGetUniformLocation(shaderProgram, "texture_main"), 0);
-        //render bonsai model
-        glBindVertexArray(bonsaiVAO);
-        glDrawArrays(GL_TRIANGLES, 0, bonsaiVertices.size() / 3);
-        glBindVertexArray(0);
+        glUseProgram(0);
+        ++frameCount;
+    }
 
-        glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, shopTexture);
-		glUniform1f(glGetUniformLocation(shaderProgram, "texture_main"), 0);
-        //render shop model
-		glBindVertexArray(shopVAO);
-        glDrawArrays(GL_TRIANGLES, 0, roomVertices.size());
-        glBindVertexArray(0);
+    //stop the simulation thread before anything it reads goes away
+    pipeline.close();
+    if (simulationThread.joinable()) {
+        simulationThread.join();
+    }
 
-        //swap buffer and polls events
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+    //a capture still running at exit (--profile) is written out
+    if (profilerRunning()) {
+        stopProfiler();
+        writeChromeTrace(options.profilePath);
+    }
 
-        glUseProgram(0);
+    //report the benchmark before tearing down the context
+    if (options.headless) {
+        frameTimer.finish();
+        std::cout.rdbuf(consoleOut);
+        writeBenchmarkJson(frameTimer.json((const char*)glGetString(GL_RENDERER)), options.jsonPath);
+        frameTimer.destroy();
+        destroyOffscreenTarget(offscreen);
     }
 
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &EBO);
-    glDeleteProgram(shaderProgram);
+    destroyMesh(bonsaiGpuMesh);
+    destroyMesh(shopGpuMesh);
+    frameStream.destroy();
+    clusterBuffers.destroy();
+    shadowMaps.destroy();
+    gpuScene.destroy();
+    destroyGpuProfiler();
+    shaders.stop();
 
     //cleans and exits
     glfwTerminate();
@@ -443,7 +1067,7 @@ int main() {
 
 }
 
-void renderPodium(GLuint& podiumVAO, GLuint& podiumVBO, GLuint& podiumEBO) {
+void renderPodium(GLuint& podiumVAO, GLuint& podiumVBO, GLuint& podiumEBO, Aabb& podiumBounds) {
 
     float podiumVertices[] = {
         // Front face
@@ -514,6 +1138,7 @@ void renderPodium(GLuint& podiumVAO, GLuint& podiumVBO, GLuint& podiumEBO) {
     //Bind and populate the VBO with vertex data
     glBindBuffer(GL_ARRAY_BUFFER, podiumVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(podiumVertices), podiumVertices, GL_STATIC_DRAW);
+    podiumBounds = boundsOfVertices(podiumVertices, sizeof(podiumVertices) / (6 * sizeof(float)), 6);
 
     //Bind and fill the EBO with element index data
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, podiumEBO);
@@ -533,7 +1158,73 @@ void renderPodium(GLuint& podiumVAO, GLuint& podiumVBO, GLuint& podiumEBO) {
 
 
 
-void renderCan(GLuint& canVAO, GLuint& canVBO, GLuint& canEBO) {
+void printPick(const PickHit& hit, uint32_t canItem, uint32_t wallItem, uint32_t bonsaiItem, uint32_t shopItem) {
+    if (hit.item == NoPick) {
+        std::cout << "Nothing selected" << std::endl;
+        return;
+    }
+    if (hit.item < canItem) {
+        std::cout << "Selected podium " << hit.item;
+    }
+    else if (hit.item == canItem) {
+        std::cout << "Selected can";
+    }
+    else if (hit.item == wallItem) {
+        std::cout << "Selected wall";
+    }
+    else if (hit.item == shopItem) {
+        std::cout << "Selected shop";
+    }
+    else {
+        std::cout << "Selected bonsai " << hit.item - bonsaiItem;
+    }
+    std::cout << ", triangle " << hit.triangle << " at (" << 1.0f - hit.u - hit.v << ", " << hit.u << ", " << hit.v << ")"
+        << ", " << hit.distance << " away" << std::endl;
+}
+
+//lays count podiums out on a square grid under parent, every podium after the first gets its own shade
+//the instances' matrices are left for the caller to fill in from the graph once it is updated
+void buildPodiumGrid(int count, SceneGraph& graph, SceneNode parent, std::vector<SceneNode>& nodes, std::vector<InstanceData>& instances) {
+    int side = (int)std::ceil(std::sqrt((float)count));
+    //podium is 1 unit wide, leave a walkway between them
+    float spacing = 1.5f;
+
+    nodes.resize(count);
+    instances.resize(count);
+    for (int i = 0; i < count; ++i) {
+        int row = i / side;
+        int column = i % side;
+        nodes[i] = graph.addNode(parent, glm::vec3(column * spacing, 0.0f, -row * spacing));
+        float shade = i == 0 ? 1.0f : 0.8f + 0.02f * ((i * 7) % 11);
+        instances[i].color = glm::vec4(shade, shade, shade, 1.0f);
+    }
+}
+
+void buildGrowLamps(int count, const Aabb& area, std::vector<PointLight>& lights) {
+    lights.resize(count);
+    if (count == 0) {
+        return;
+    }
+    int side = (int)std::ceil(std::sqrt((float)count));
+    glm::vec3 extent = area.max - area.min;
+    float spacing = std::max(extent.x, extent.z) / side;
+    //each lamp reaches its neighbours so the floor between them is never dark
+    float radius = std::max(spacing * 1.5f, 0.5f);
+
+    for (int i = 0; i < count; ++i) {
+        int row = i / side;
+        int column = i % side;
+        PointLight& lamp = lights[i];
+        lamp.position = glm::vec3(area.min.x + (column + 0.5f) * extent.x / side,
+            area.max.y + 0.2f, area.max.z - (row + 0.5f) * extent.z / side);
+        lamp.radius = radius;
+        //grow lamps are mostly red + blue
+        lamp.color = glm::vec3(1.0f, 0.45f, 0.9f);
+        lamp.intensity = 1.0f;
+    }
+}
+
+void renderCan(GLuint& canVAO, GLuint& canVBO, GLuint& canEBO, Aabb& canBounds) {
 
     float canVertices[] = {
         // Front face
@@ -613,6 +1304,7 @@ void renderCan(GLuint& canVAO, GLuint& canVBO, GLuint& canEBO) {
     //Bind and populate the VBO with vertex data
     glBindBuffer(GL_ARRAY_BUFFER, canVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(canVertices), canVertices, GL_STATIC_DRAW);
+    canBounds = boundsOfVertices(canVertices, sizeof(canVertices) / (6 * sizeof(float)), 6);
 
     //Bind and populate the EBO with element index data
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, canEBO);
@@ -630,12 +1322,7 @@ void renderCan(GLuint& canVAO, GLuint& canVBO, GLuint& canEBO) {
     glBindVertexArray(0);
 }
 
-void renderWall(GLuint& wallVAO, GLuint& wallVBO, GLuint& wallEBO) {
-
-    glUseProgram(shaderProgram);
-
-    glm::mat4 wall = glm::mat4(1.0f);
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "wall"), 1, GL_FALSE, glm::value_ptr(wall));
+void renderWall(GLuint& wallVAO, GLuint& wallVBO, GLuint& wallEBO, Aabb& wallBounds) {
 
     float wallVertices[] = {
     -10, 10, -10, 1.0f, 1.0f, 0.0f, // Vertex 1, yellow color
@@ -707,6 +1394,7 @@ void renderWall(GLuint& wallVAO, GLuint& wallVBO, GLuint& wallEBO) {
     //Bind and populate the VBO with vertex data
     glBindBuffer(GL_ARRAY_BUFFER, wallVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(wallVertices), wallVertices, GL_STATIC_DRAW);
+    wallBounds = boundsOfVertices(wallVertices, sizeof(wallVertices) / (6 * sizeof(float)), 6);
 
     //Bind and populate the VBO with element index data
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, wallEBO);
@@ -724,6 +1412,35 @@ void renderWall(GLuint& wallVAO, GLuint& wallVBO, GLuint& wallEBO) {
     glBindVertexArray(0);
 }
 
+void readPropMesh(GLuint VBO, GLuint EBO, MeshData& mesh) {
+    GLint vertexBytes = 0, indexBytes = 0;
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &vertexBytes);
+    std::vector<GLfloat> props(vertexBytes / sizeof(GLfloat));
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, vertexBytes, props.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    //element buffers belong to the VAO, so read this one through the copy target instead
+    glBindBuffer(GL_COPY_READ_BUFFER, EBO);
+    glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &indexBytes);
+    mesh.indices.resize(indexBytes / sizeof(GLuint));
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, indexBytes, mesh.indices.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    //position + colour, no normals or uvs
+    size_t vertexCount = props.size() / 6;
+    mesh.vertices.assign(vertexCount * VertexStride, 0.0f);
+    for (size_t i = 0; i < vertexCount; ++i) {
+        std::copy(props.begin() + i * 6, props.begin() + i * 6 + 6, mesh.vertices.begin() + i * VertexStride);
+    }
+
+    Submesh submesh;
+    submesh.indexCount = (GLsizei)mesh.indices.size();
+    submesh.vertexCount = (GLsizei)vertexCount;
+    submesh.lods[0].indexCount = submesh.indexCount;
+    mesh.submeshes.push_back(submesh);
+}
+
 //callback function handles scroll events
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
@@ -742,62 +1459,266 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 }
 
 //processes users input mouse + wasd for camera movement
-void processInput(GLFWwindow* window) {
-    
+InputState sampleInput(GLFWwindow* window) {
+
     //close window on esc
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
+    //wasd + the view the mouse and scroll wheel have set up
+    InputState input;
+    input.forward = glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS;
+    input.back = glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS;
+    input.left = glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS;
+    input.right = glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS;
+    input.cameraFront = cameraFront;
+    input.projection = projection;
+    int width = 0, height = 0;
+    glfwGetFramebufferSize(window, &width, &height);
+    if (width > 0 && height > 0) {
+        input.viewportWidth = (float)width;
+        input.viewportHeight = (float)height;
+    }
+    //picks through the middle of the screen unless there is a free cursor on a visible window
+    input.cursor = glm::vec2(input.viewportWidth, input.viewportHeight) * 0.5f;
+    if (glfwGetInputMode(window, GLFW_CURSOR) != GLFW_CURSOR_DISABLED && glfwGetWindowAttrib(window, GLFW_VISIBLE)) {
+        double cursorX = 0.0, cursorY = 0.0;
+        int windowWidth = 0, windowHeight = 0;
+        glfwGetCursorPos(window, &cursorX, &cursorY);
+        glfwGetWindowSize(window, &windowWidth, &windowHeight);
+        //window coordinates -> framebuffer pixels, they differ on high dpi displays
+        if (windowWidth > 0 && windowHeight > 0) {
+            input.cursor = glm::vec2((float)cursorX * input.viewportWidth / windowWidth, (float)cursorY * input.viewportHeight / windowHeight);
+        }
+    }
+    return input;
+}
+
+//moves the camera one simulation step from sampled input
+void processInput(const InputState& input, const CollisionWorld& collision) {
+
     //set starting camera speed and calculate updated camera speed 
     float baseCameraSpeed = 2.25f;
     float modifiedCameraSpeed = baseCameraSpeed * deltaTime / 3.0f;
 
-    //store new cam pos for collision detection
-    glm::vec3 newCameraPos = cameraPos;  
+    //movement this step based on wasd input
+    glm::vec3 motion = glm::vec3(0.0f);
+    if (input.forward)
+        motion += modifiedCameraSpeed * input.cameraFront;
+    if (input.back)
+        motion -= modifiedCameraSpeed * input.cameraFront;
+    if (input.left)
+        motion -= glm::normalize(glm::cross(input.cameraFront, cameraUp)) * modifiedCameraSpeed;
+    if (input.right)
+        motion += glm::normalize(glm::cross(input.cameraFront, cameraUp)) * modifiedCameraSpeed;
+    //sweep the camera's sphere through the scene, sliding along whatever it runs into instead of stopping dead
+    //the camera walks, it doesn't fly, so it never slides up or down
+    cameraPos = collision.slideSphere(cameraPos, motion, CameraRadius, cameraUp);
 
-    //move camera based on wasd input
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        newCameraPos += modifiedCameraSpeed * cameraFront;
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        newCameraPos -= modifiedCameraSpeed * cameraFront;
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        newCameraPos -= glm::normalize(glm::cross(cameraFront, cameraUp)) * modifiedCameraSpeed;
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        newCameraPos += glm::normalize(glm::cross(cameraFront, cameraUp)) * modifiedCameraSpeed;
+    // Ensure the camera stays at the same height
+    cameraPos.y = 0.0f;
+}
 
+//runs the fixed steps due by frameTime then builds the frame's render packet: camera, uniforms, culling
+void simulateFrame(SceneSimulation& simulation, const InputState& input, double frameTime, int frame, RenderPacket& packet) {
+    CpuScope simulateScope("simulate");
+    int steps = simulation.timestep.advance(frameTime - simulation.lastFrameTime);
+    simulation.lastFrameTime = frameTime;
+
+    //every step moves the same distance
+    deltaTime = (float)SimulationStep;
+    for (int step = 0; step < steps; ++step) {
+        CpuScope scope("step");
+        simulation.previousState = simulation.currentState;
+        processInput(input, simulation.collision);
+        simulation.currentState.cameraPos = cameraPos;
+        simulation.currentState.time += SimulationStep;
+    }
+    SimulationState renderState = interpolateState(simulation.previousState, simulation.currentState, simulation.timestep.alpha());
+
+    // Update view matrix
+    glm::mat4 frameView = glm::lookAt(renderState.cameraPos, renderState.cameraPos + input.cameraFront, cameraUp);
+
+    packet.frame = frame;
+    packet.uniforms.view = frameView;
+    packet.uniforms.projection = input.projection;
+    packet.uniforms.lightPos = glm::vec4(lightPosition, 1.0f);
+    packet.uniforms.viewPos = glm::vec4(renderState.cameraPos, 1.0f);
+    //the sun follows the simulation clock, so it is the same however the frames are paced
+    packet.uniforms.lightDir = sunLight(renderState.time);
+    packet.uniforms.lightAmbient = glm::vec4(lightAmbient, 1.0f);
+
+    //bin the grow lamps into this view's clusters, the GL thread only uploads the result
+    {
+        CpuScope scope("bin lights");
+        simulation.lightClusters.setProjection(input.projection);
+        simulation.lightClusters.bin(*simulation.lights, frameView, packet.lightStats);
+    }
+    packet.clusterCells = simulation.lightClusters.cellRanges();
+    packet.clusterLightIndices = simulation.lightClusters.lightIndices();
+    packet.uniforms.clusterDepth = simulation.lightClusters.sliceParams();
+    packet.uniforms.clusterGrid = glm::ivec4(ClusterTilesX, ClusterTilesY, ClusterSlices, 0);
+
+    //fit the sun cascades to this view, the matrices only change on a sun step or once the camera leaves a cascade's margin
+    ShadowCascadeSet& cascades = packet.shadowCascades;
+    {
+        CpuScope scope("fit cascades");
+        simulation.cascadeFitter.fit(frameView, input.projection, glm::vec3(packet.uniforms.lightDir), simulation.casterBounds, cascades);
+    }
+    //clip space -> 0..1 texture space for the shader's lookup
+    const glm::mat4 shadowTexture = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)), glm::vec3(0.5f));
+    for (int cascade = 0; cascade < ShadowCascadeCount; ++cascade) {
+        packet.uniforms.shadowMatrices[cascade] = shadowTexture * cascades.lightProjection[cascade] * cascades.lightView[cascade];
+        packet.uniforms.cascadeSplits[cascade] = cascades.splitDepth[cascade];
+    }
 
-    // Check if the new position is inside the podiums buffer zone
-    if (!isInsideCube(newCameraPos)) {
-        // Update the camera position only if it's not inside the cube
-        cameraPos = newCameraPos;
+    // Update model matrix for cube
+    packet.propModel = simulation.propModel;
+
+    //what the cursor is over, from the same camera the frame is drawn with
+    glm::vec3 rayOrigin, rayDirection;
+    viewportRay(input.cursor, glm::vec2(input.viewportWidth, input.viewportHeight), frameView, input.projection, rayOrigin, rayDirection);
+    {
+        CpuScope scope("pick");
+        simulation.picking.pick(rayOrigin, rayDirection, packet.hover, packet.pickStats);
     }
 
-    // Ensure the camera stays at the same height
-    cameraPos.y = 0.0f;
+    packet.visiblePodiums.clear();
+    for (std::vector<InstanceData>& atLevel : packet.visibleBonsais) {
+        atLevel.clear();
+    }
+    packet.bonsaiTriangles = 0;
+    packet.lodPixelError = simulation.lodPixelError;
+    packet.canVisible = packet.wallVisible = packet.shopVisible = false;
+    packet.cullStats = CullStats();
+    packet.occlusionStats = OcclusionStats();
+    //the gpu driven path culls and picks levels itself, its packets leave the lists empty
+    packet.gpuDriven = input.gpuDriven;
+    if (!input.gpuDriven) {
+        cullVisible(simulation, input, frameView, renderState.cameraPos, packet);
+    }
+
+    //keep the bonsais near the triangle budget: accept more screen error while over it, win detail back once well under
+    //the gpu's own count (everything it drew, a few frames late) stands in for the bonsais' on its path
+    long long drawnTriangles = input.gpuDriven ? input.gpuTriangles : packet.bonsaiTriangles;
+    if (drawnTriangles > simulation.triangleBudget) {
+        //capped so a budget even the coarsest levels can't meet doesn't take forever to recover from
+        simulation.lodPixelError = std::min(simulation.lodPixelError * 1.25f, LodPixelError * 64.0f);
+    }
+    else if (drawnTriangles < simulation.triangleBudget * 3 / 4) {
+        simulation.lodPixelError = std::max(simulation.lodPixelError / 1.25f, LodPixelError);
+    }
 }
-//function to prevent entry into podium - ensures no clipping 
-bool isInsideCube(const glm::vec3& point) {
-    // Defines where the cube is and adds a buffer to prevent clipping)
-    float buffer = -0.35f;  // Adjust the buffer 
-    float cubeMinX = -1.5f - buffer;
-    float cubeMaxX = -0.5f + buffer;
-    float cubeMinY = -0.5f - buffer;
-    float cubeMaxY = 0.5f + buffer;
-    float cubeMinZ = -0.5f - buffer;
-    float cubeMaxZ = 0.5f + buffer;
-   
-    //creates inverse model matrix to make point into local space
-    glm::mat4 inverseModelMatrix = glm::inverse(glm::mat4(1.0f));  
 
-    // Transform the camera position into local space
-    glm::vec4 localPoint = inverseModelMatrix * glm::vec4(point, 2.0f);
+void cullVisible(SceneSimulation& simulation, const InputState& input, const glm::mat4& frameView, const glm::vec3& eye, RenderPacket& packet) {
+    //cull the scene against the camera
+    Frustum frustum = extractFrustum(input.projection * frameView);
+    simulation.visibleItems.clear();
+    {
+        CpuScope scope("frustum cull");
+        simulation.sceneBvh->cull(frustum, simulation.visibleItems, packet.cullStats);
+    }
+    if (simulation.occlusionEnabled) {
+        CpuScope scope("occlusion cull");
+        cullOccluded(simulation, input.projection * frameView, eye, packet.occlusionStats);
+        packet.cullStats.visible -= packet.occlusionStats.occluded;
+        packet.cullStats.culled += packet.occlusionStats.occluded;
+    }
 
-    // Check if the point is inside the transformed cube
-    return (localPoint.x >= cubeMinX && localPoint.x <= cubeMaxX &&
-        localPoint.y >= cubeMinY && localPoint.y <= cubeMaxY &&
-        localPoint.z >= cubeMinZ && localPoint.z <= cubeMaxZ);
+    //sort the visible items into the packet and pick the bonsais' levels
+    CpuScope lodScope("select lods");
+    uint32_t bonsaiEnd = simulation.bonsaiItem + (uint32_t)simulation.bonsais->size();
+    for (uint32_t item : simulation.visibleItems) {
+        if (item < simulation.canItem) {
+            packet.visiblePodiums.push_back((*simulation.podiumGrid)[item]);
+            if (item == packet.hover.item) {
+                packet.visiblePodiums.back().color *= HoverHighlight;
+            }
+        }
+        else if (item >= simulation.bonsaiItem && item < bonsaiEnd) {
+            //coarsest level whose error stays under a pixel or so at this distance
+            uint32_t index = item - simulation.bonsaiItem;
+            const InstanceData& bonsai = (*simulation.bonsais)[index];
+            float distance = viewDepth(frameView, glm::vec3(bonsai.model * glm::vec4(simulation.bonsaiCentre, 1.0f)));
+            float pixelsPerUnit = lodPixelsPerUnit(input.projection, input.viewportHeight, glm::length(glm::vec3(bonsai.model[0])), distance);
+            int level = selectLod(simulation.bonsaiLodErrors, simulation.bonsaiLodCount, pixelsPerUnit,
+                simulation.lodPixelError, simulation.bonsaiLods[index]);
+            simulation.bonsaiLods[index] = level;
+            packet.visibleBonsais[level].push_back(bonsai);
+            if (item == packet.hover.item) {
+                packet.visibleBonsais[level].back().color *= HoverHighlight;
+            }
+            packet.bonsaiTriangles += simulation.bonsaiLodTriangles[level];
+        }
+        packet.canVisible |= item == simulation.canItem;
+        packet.wallVisible |= item == simulation.wallItem;
+        packet.shopVisible |= item == simulation.shopItem;
+    }
 }
 
+void cullOccluded(SceneSimulation& simulation, const glm::mat4& viewProjection, const glm::vec3& eye, OcclusionStats& stats) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const std::vector<Aabb>& bounds = *simulation.itemBounds;
+
+    //the occluders covering the most screen, roughly (size / distance) squared
+    simulation.occluderCandidates.clear();
+    for (uint32_t item : simulation.visibleItems) {
+        if (item >= simulation.canItem && item != simulation.wallItem) {
+            continue;
+        }
+        glm::vec3 centre = (bounds[item].min + bounds[item].max) * 0.5f;
+        float radius = glm::length(bounds[item].max - bounds[item].min) * 0.5f;
+        float distance = std::max(glm::length(centre - eye), radius);
+        simulation.occluderCandidates.push_back(std::make_pair(radius * radius / (distance * distance), item));
+    }
+    size_t occluderCount = std::min(simulation.occluderCandidates.size(), (size_t)OccluderBudget);
+    std::partial_sort(simulation.occluderCandidates.begin(), simulation.occluderCandidates.begin() + occluderCount,
+        simulation.occluderCandidates.end(), std::greater<std::pair<float, uint32_t>>());
+
+    simulation.occlusion.begin(viewProjection);
+    for (size_t i = 0; i < occluderCount; ++i) {
+        uint32_t item = simulation.occluderCandidates[i].second;
+        if (item == simulation.wallItem) {
+            simulation.occlusion.rasterize(simulation.wallOccluder, simulation.propModel);
+        }
+        else {
+            simulation.occlusion.rasterize(simulation.podiumOccluder, (*simulation.podiumGrid)[item].model);
+        }
+    }
+    simulation.occlusion.finish();
+    stats.occluders = (int)occluderCount;
+
+    //hidden items leave the visible list, a bonsai counts the triangles of the level it drew at last
+    uint32_t bonsaiEnd = simulation.bonsaiItem + (uint32_t)simulation.bonsais->size();
+    size_t kept = 0;
+    for (uint32_t item : simulation.visibleItems) {
+        if (!simulation.occlusion.occluded(bounds[item])) {
+            simulation.visibleItems[kept++] = item;
+            continue;
+        }
+        ++stats.occluded;
+        if (item < simulation.canItem) {
+            stats.occludedTriangles += simulation.podiumTriangles;
+        }
+        else if (item >= simulation.bonsaiItem && item < bonsaiEnd) {
+            stats.occludedTriangles += simulation.bonsaiLodTriangles[simulation.bonsaiLods[item - simulation.bonsaiItem]];
+        }
+        else if (item == simulation.canItem) {
+            stats.occludedTriangles += simulation.canTriangles;
+        }
+        else if (item == simulation.wallItem) {
+            stats.occludedTriangles += simulation.wallTriangles;
+        }
+        else if (item == simulation.shopItem) {
+            stats.occludedTriangles += simulation.shopTriangles;
+        }
+    }
+    simulation.visibleItems.resize(kept);
+    stats.drawn = (int)kept;
+
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    stats.microseconds = elapsed.count();
+}
 
 //call back function for handling mouse movement
 void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
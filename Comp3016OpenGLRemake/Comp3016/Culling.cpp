@@ -0,0 +1,271 @@
+#include "Culling.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define CULLING_SSE 1
+#include <xmmintrin.h>
+#endif
+
+//items per leaf, small enough that a partly visible leaf costs little to test one by one
+static const uint32_t BvhLeafSize = 4;
+
+Aabb boundsOfVertices(const float* vertices, size_t vertexCount, int stride)
+{
+    Aabb box;
+    for (size_t i = 0; i < vertexCount; ++i) {
+        glm::vec3 position(vertices[i * stride], vertices[i * stride + 1], vertices[i * stride + 2]);
+        box.min = glm::min(box.min, position);
+        box.max = glm::max(box.max, position);
+    }
+    return box;
+}
+
+Aabb transformAabb(const Aabb& box, const glm::mat4& transform)
+{
+    //centre moves with the matrix, extents grow by the absolute value of the rotation/scale part
+    glm::vec3 centre = (box.min + box.max) * 0.5f;
+    glm::vec3 extent = (box.max - box.min) * 0.5f;
+
+    glm::vec3 worldCentre = glm::vec3(transform * glm::vec4(centre, 1.0f));
+    glm::vec3 worldExtent(0.0f);
+    for (int column = 0; column < 3; ++column) {
+        worldExtent += glm::abs(glm::vec3(transform[column])) * extent[column];
+    }
+
+    Aabb result;
+    result.min = worldCentre - worldExtent;
+    result.max = worldCentre + worldExtent;
+    return result;
+}
+
+void growAabb(Aabb& box, const Aabb& other)
+{
+    box.min = glm::min(box.min, other.min);
+    box.max = glm::max(box.max, other.max);
+}
+
+glm::vec3 inverseDirection(const glm::vec3& direction)
+{
+    glm::vec3 inverse;
+    for (int axis = 0; axis < 3; ++axis) {
+        inverse[axis] = direction[axis] != 0.0f ? 1.0f / direction[axis] : 1e30f;
+    }
+    return inverse;
+}
+
+bool rayEntersAabb(const glm::vec3& origin, const glm::vec3& inverse, const Aabb& box, float grow, float limit, float& enter)
+{
+    glm::vec3 t0 = (box.min - glm::vec3(grow) - origin) * inverse;
+    glm::vec3 t1 = (box.max + glm::vec3(grow) - origin) * inverse;
+    glm::vec3 near = glm::min(t0, t1);
+    glm::vec3 far = glm::max(t0, t1);
+    enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+    float exit = std::min(std::min(far.x, far.y), std::min(far.z, limit));
+    return enter <= exit;
+}
+
+Frustum extractFrustum(const glm::mat4& viewProjection)
+{
+    //rows of the matrix, glm stores columns
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; ++i) {
+        row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+    }
+
+    Frustum frustum;
+    frustum.planes[0] = row[3] + row[0]; //left
+    frustum.planes[1] = row[3] - row[0]; //right
+    frustum.planes[2] = row[3] + row[1]; //bottom
+    frustum.planes[3] = row[3] - row[1]; //top
+    frustum.planes[4] = row[3] + row[2]; //near
+    frustum.planes[5] = row[3] - row[2]; //far
+
+    for (int i = 0; i < 8; ++i) {
+        if (i < 6) {
+            glm::vec4& plane = frustum.planes[i];
+            plane /= glm::length(glm::vec3(plane));
+            frustum.nx[i] = plane.x;
+            frustum.ny[i] = plane.y;
+            frustum.nz[i] = plane.z;
+            frustum.d[i] = plane.w;
+        }
+        else {
+            frustum.nx[i] = frustum.ny[i] = frustum.nz[i] = 0.0f;
+            frustum.d[i] = 1e30f;
+        }
+    }
+    return frustum;
+}
+
+CullResult classifyAabb(const Frustum& frustum, const Aabb& box)
+{
+    glm::vec3 centre = (box.min + box.max) * 0.5f;
+    glm::vec3 extent = (box.max - box.min) * 0.5f;
+    bool intersecting = false;
+
+#ifdef CULLING_SSE
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    __m128 cx = _mm_set1_ps(centre.x), cy = _mm_set1_ps(centre.y), cz = _mm_set1_ps(centre.z);
+    __m128 ex = _mm_set1_ps(extent.x), ey = _mm_set1_ps(extent.y), ez = _mm_set1_ps(extent.z);
+    for (int i = 0; i < 8; i += 4) {
+        __m128 nx = _mm_load_ps(frustum.nx + i);
+        __m128 ny = _mm_load_ps(frustum.ny + i);
+        __m128 nz = _mm_load_ps(frustum.nz + i);
+
+        //signed distance of the centre and the box's projected radius onto each normal
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+            _mm_add_ps(_mm_mul_ps(nz, cz), _mm_load_ps(frustum.d + i)));
+        __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, nx), ex),
+            _mm_mul_ps(_mm_andnot_ps(signMask, ny), ey)), _mm_mul_ps(_mm_andnot_ps(signMask, nz), ez));
+
+        if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()))) {
+            return CullResult::Outside;
+        }
+        if (_mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, radius), _mm_setzero_ps()))) {
+            intersecting = true;
+        }
+    }
+#else
+    for (int i = 0; i < 6; ++i) {
+        const glm::vec4& plane = frustum.planes[i];
+        float distance = glm::dot(glm::vec3(plane), centre) + plane.w;
+        float radius = glm::dot(glm::abs(glm::vec3(plane)), extent);
+        if (distance + radius < 0.0f) {
+            return CullResult::Outside;
+        }
+        if (distance - radius < 0.0f) {
+            intersecting = true;
+        }
+    }
+#endif
+    return intersecting ? CullResult::Intersecting : CullResult::Inside;
+}
+
+void SceneBvh::build(const std::vector<Aabb>& itemBounds)
+{
+    bounds = itemBounds;
+    items.resize(bounds.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        items[i] = (uint32_t)i;
+    }
+    nodes.clear();
+    nodes.reserve(items.size() * 2);
+    if (!items.empty()) {
+        buildNode(0, (uint32_t)items.size());
+    }
+}
+
+uint32_t SceneBvh::buildNode(uint32_t firstItem, uint32_t itemCount)
+{
+    uint32_t nodeIndex = (uint32_t)nodes.size();
+    nodes.push_back(Node());
+
+    Aabb nodeBounds, centroidBounds;
+    for (uint32_t i = firstItem; i < firstItem + itemCount; ++i) {
+        const Aabb& box = bounds[items[i]];
+        growAabb(nodeBounds, box);
+        glm::vec3 centroid = (box.min + box.max) * 0.5f;
+        centroidBounds.min = glm::min(centroidBounds.min, centroid);
+        centroidBounds.max = glm::max(centroidBounds.max, centroid);
+    }
+    nodes[nodeIndex].bounds = nodeBounds;
+    nodes[nodeIndex].firstItem = firstItem;
+    nodes[nodeIndex].itemCount = itemCount;
+    if (itemCount <= BvhLeafSize) {
+        return nodeIndex;
+    }
+
+    //median split on the axis the centroids spread furthest along
+    glm::vec3 spread = centroidBounds.max - centroidBounds.min;
+    int axis = spread.x > spread.y ? (spread.x > spread.z ? 0 : 2) : (spread.y > spread.z ? 1 : 2);
+    uint32_t half = itemCount / 2;
+    const std::vector<Aabb>& itemBoxes = bounds;
+    std::nth_element(items.begin() + firstItem, items.begin() + firstItem + half, items.begin() + firstItem + itemCount,
+        [&itemBoxes, axis](uint32_t a, uint32_t b) {
+            return itemBoxes[a].min[axis] + itemBoxes[a].max[axis] < itemBoxes[b].min[axis] + itemBoxes[b].max[axis];
+        });
+
+    buildNode(firstItem, half);
+    uint32_t rightChild = buildNode(firstItem + half, itemCount - half);
+    nodes[nodeIndex].rightChild = rightChild;
+    return nodeIndex;
+}
+
+void SceneBvh::cull(const Frustum& frustum, std::vector<uint32_t>& visible, CullStats& stats) const
+{
+    if (nodes.empty()) {
+        return;
+    }
+
+    //median splits keep the depth near log2(items), 64 entries covers any scene that fits in memory
+    uint32_t stack[64];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+        const Node& node = nodes[stack[--stackSize]];
+        ++stats.nodesTested;
+
+        CullResult result = classifyAabb(frustum, node.bounds);
+        if (result == CullResult::Outside) {
+            stats.culled += node.itemCount;
+            continue;
+        }
+        if (result == CullResult::Inside) {
+            //whole subtree is in view, no need to test anything below
+            visible.insert(visible.end(), items.begin() + node.firstItem, items.begin() + node.firstItem + node.itemCount);
+            stats.visible += node.itemCount;
+            continue;
+        }
+
+        if (node.rightChild == 0) {
+            for (uint32_t i = node.firstItem; i < node.firstItem + node.itemCount; ++i) {
+                if (classifyAabb(frustum, bounds[items[i]]) == CullResult::Outside) {
+                    ++stats.culled;
+                }
+                else {
+                    visible.push_back(items[i]);
+                    ++stats.visible;
+                }
+            }
+            continue;
+        }
+
+        uint32_t nodeIndex = (uint32_t)(&node - nodes.data());
+        stack[stackSize++] = node.rightChild;
+        stack[stackSize++] = nodeIndex + 1;
+    }
+}
+
+void SceneBvh::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+    std::vector<std::pair<float, uint32_t>>& hits) const
+{
+    if (nodes.empty()) {
+        return;
+    }
+    glm::vec3 inverse = inverseDirection(direction);
+
+    uint32_t stack[64];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        const Node& node = nodes[stack[--stackSize]];
+        float enter;
+        if (!rayEntersAabb(origin, inverse, node.bounds, 0.0f, maxDistance, enter)) {
+            continue;
+        }
+        if (node.rightChild == 0) {
+            for (uint32_t i = node.firstItem; i < node.firstItem + node.itemCount; ++i) {
+                if (rayEntersAabb(origin, inverse, bounds[items[i]], 0.0f, maxDistance, enter)) {
+                    hits.push_back(std::make_pair(enter, items[i]));
+                }
+            }
+            continue;
+        }
+        uint32_t nodeIndex = (uint32_t)(&node - nodes.data());
+        stack[stackSize++] = node.rightChild;
+        stack[stackSize++] = nodeIndex + 1;
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+//axis aligned box, min > max means empty
+struct Aabb {
+    glm::vec3 min = glm::vec3(1e30f);
+    glm::vec3 max = glm::vec3(-1e30f);
+};
+
+//bounds of interleaved vertex data, position is the first 3 floats of every vertex
+Aabb boundsOfVertices(const float* vertices, size_t vertexCount, int stride);
+//smallest world box holding the transformed local box
+Aabb transformAabb(const Aabb& box, const glm::mat4& transform);
+void growAabb(Aabb& box, const Aabb& other);
+
+//1 / direction with zero components made huge rather than infinite, so slab tests never multiply 0 by inf
+glm::vec3 inverseDirection(const glm::vec3& direction);
+//where origin + direction * t, 0 <= t <= limit, first enters the box grown by grow; inverse is from inverseDirection
+bool rayEntersAabb(const glm::vec3& origin, const glm::vec3& inverse, const Aabb& box, float grow, float limit, float& enter);
+
+//the six clip planes of a view projection, normals point inwards
+struct Frustum {
+    glm::vec4 planes[6];
+
+    //same planes split by component for the SIMD test, padded to 8 with planes nothing is outside of
+    alignas(16) float nx[8];
+    alignas(16) float ny[8];
+    alignas(16) float nz[8];
+    alignas(16) float d[8];
+};
+
+Frustum extractFrustum(const glm::mat4& viewProjection);
+
+enum class CullResult { Outside, Intersecting, Inside };
+
+//tests the box against every plane at once, 4 planes per SSE register
+CullResult classifyAabb(const Frustum& frustum, const Aabb& box);
+
+//per frame culling counts
+struct CullStats {
+    int nodesTested = 0;
+    int visible = 0;
+    int culled = 0;
+};
+
+//static bounding volume hierarchy over scene items, items are indices into the bounds it was built from
+class SceneBvh {
+public:
+    void build(const std::vector<Aabb>& itemBounds);
+
+    //appends the index of every item touching the frustum to visible
+    void cull(const Frustum& frustum, std::vector<uint32_t>& visible, CullStats& stats) const;
+    //appends (distance the ray enters the box, item) for every item box the ray enters before maxDistance, unsorted
+    void raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+        std::vector<std::pair<float, uint32_t>>& hits) const;
+
+    size_t itemCount() const { return items.size(); }
+
+private:
+    //every node covers a contiguous run of items, leaves have no children
+    struct Node {
+        Aabb bounds;
+        uint32_t firstItem = 0;
+        uint32_t itemCount = 0;
+        //left child is always the next node, 0 marks a leaf
+        uint32_t rightChild = 0;
+    };
+
+    uint32_t buildNode(uint32_t firstItem, uint32_t itemCount);
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> items;
+    std::vector<Aabb> bounds;
+};
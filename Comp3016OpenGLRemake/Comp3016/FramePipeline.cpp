@@ -0,0 +1,62 @@
+#include "FramePipeline.h"
+
+void FramePipeline::submitInput(const InputState& latest)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    input = latest;
+}
+
+InputState FramePipeline::latestInput() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return input;
+}
+
+RenderPacket* FramePipeline::beginPacket()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    //the slot written next must not be the one the GL thread is still reading
+    slotFreed.wait(lock, [this]() { return closed || published - released < SlotCount; });
+    if (closed) {
+        return nullptr;
+    }
+    return &slots[published % SlotCount];
+}
+
+void FramePipeline::publishPacket()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++published;
+    }
+    packetReady.notify_one();
+}
+
+const RenderPacket* FramePipeline::acquirePacket()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    packetReady.wait(lock, [this]() { return closed || published > released; });
+    if (published == released) {
+        return nullptr;
+    }
+    return &slots[released % SlotCount];
+}
+
+void FramePipeline::releasePacket()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++released;
+    }
+    slotFreed.notify_one();
+}
+
+void FramePipeline::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+    }
+    slotFreed.notify_all();
+    packetReady.notify_all();
+}
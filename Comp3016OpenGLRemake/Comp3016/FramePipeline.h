@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Culling.h"
+#include "InstanceBuffer.h"
+#include "Lighting.h"
+#include "MeshLod.h"
+#include "Occlusion.h"
+#include "Picking.h"
+#include "ShaderProgram.h"
+#include "Shadows.h"
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+//keys + view state sampled on the main thread (GLFW input is main thread only)
+struct InputState {
+    bool forward = false;
+    bool back = false;
+    bool left = false;
+    bool right = false;
+    glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
+    glm::mat4 projection = glm::mat4(1.0f);
+    //framebuffer height in pixels, level of detail is picked by on screen error
+    float viewportHeight = 600.0f;
+    float viewportWidth = 800.0f;
+    //framebuffer pixel the cursor is over (y down), the middle of the screen while the mouse turns the camera
+    glm::vec2 cursor = glm::vec2(400.0f, 300.0f);
+    //the gpu culls and picks levels itself, the simulation skips those stages
+    bool gpuDriven = false;
+    //triangles the gpu drew, read back a few frames late, the triangle budget is kept against them on that path
+    long long gpuTriangles = 0;
+};
+
+//everything the GL thread needs to draw one frame, written once by the simulation stage then only read
+struct RenderPacket {
+    int frame = 0;
+    //built for the gpu driven path: nothing was culled on the cpu and the visibility lists are empty
+    bool gpuDriven = false;
+    FrameUniforms uniforms;
+    //placement shared by the cube props and models
+    glm::mat4 propModel = glm::mat4(1.0f);
+
+    //visibility from the frustum culling
+    std::vector<InstanceData> visiblePodiums;
+    bool canVisible = false;
+    bool wallVisible = false;
+    bool shopVisible = false;
+    //visible bonsais grouped by the detail level they draw at, one instanced draw per level
+    std::vector<InstanceData> visibleBonsais[MaxMeshLods];
+    long long bonsaiTriangles = 0;
+    //screen error the levels were picked against, the gpu driven path picks its own levels with it
+    float lodPixelError = LodPixelError;
+    CullStats cullStats;
+    //frustum visible items the software occlusion test hid
+    OcclusionStats occlusionStats;
+    //what the cursor is over, podiums and bonsais under it are drawn highlighted
+    PickHit hover;
+    PickStats pickStats;
+
+    //grow lamps binned per cluster for this view, uploaded as buffer textures
+    std::vector<uint32_t> clusterCells;
+    std::vector<uint32_t> clusterLightIndices;
+    ClusterBinStats lightStats;
+
+    //sun cascades fitted to this view, the GL thread re-renders a cascade only when its matrices changed
+    ShadowCascadeSet shadowCascades;
+};
+
+//hands render packets from the simulation thread to the GL thread through three slots
+//the simulation can be at most two packets ahead of the frame being drawn, so latency stays bounded
+class FramePipeline {
+public:
+    //latest input from the main thread, the simulation reads it at the start of every frame
+    void submitInput(const InputState& input);
+    InputState latestInput() const;
+
+    //producer side: blocks until a slot is free, null once the pipeline is closed
+    RenderPacket* beginPacket();
+    void publishPacket();
+
+    //consumer side: blocks until a packet is published, null once closed and drained
+    const RenderPacket* acquirePacket();
+    void releasePacket();
+
+    //wakes both sides so the simulation thread can exit
+    void close();
+
+private:
+    static const int SlotCount = 3;
+
+    RenderPacket slots[SlotCount];
+    //packets published and released so far, the slot of packet n is n % SlotCount
+    long long published = 0;
+    long long released = 0;
+    bool closed = false;
+
+    InputState input;
+
+    mutable std::mutex mutex;
+    std::condition_variable slotFreed;
+    std::condition_variable packetReady;
+};
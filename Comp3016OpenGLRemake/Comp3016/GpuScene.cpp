@@ -0,0 +1,708 @@
+#include "GpuScene.h"
+
+#include "MeshLod.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+//one thread per instance: frustum, then the level of detail, then Hi-Z occlusion, then one
+//instance appended to the indirect command of every submesh at that level
+static const char* cullComputeSource = R"(#version 430 core
+layout (local_size_x = 64) in;
+
+struct SceneInstance {
+    mat4 model;
+    vec4 color;
+    vec4 boundsMin;
+    vec4 boundsMax;
+    uvec4 info;
+};
+layout (std430, binding = 0) buffer SceneInstances {
+    SceneInstance sceneInstances[];
+};
+
+// x = first command, y = submeshes, z = levels; commands run submesh major
+struct SceneMesh {
+    uvec4 commands;
+    vec4 lodErrors[2];
+};
+layout (std430, binding = 1) readonly buffer SceneMeshes {
+    SceneMesh sceneMeshes[];
+};
+
+struct DrawCommand {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+layout (std430, binding = 2) buffer DrawCommands {
+    DrawCommand drawCommands[];
+};
+
+// Read back by the vertex stage as aInstanceId, each command owns baseInstance onwards
+layout (std430, binding = 3) writeonly buffer VisibleIds {
+    uint visibleIds[];
+};
+
+layout (std430, binding = 4) buffer CullCounters {
+    uint visibleCount;
+    uint frustumCulled;
+    uint occludedCount;
+    uint triangleCount;
+    uint occludedTriangles;
+};
+
+uniform uint instanceCount;
+uniform vec4 frustumPlanes[6];
+// Dot with a world position gives its depth in front of the camera
+uniform vec4 viewDepthRow;
+// Screen pixels one unit covers at distance 1
+uniform float pixelScale;
+uniform float maxPixelError;
+uniform float lodHysteresis;
+
+// Max depth pyramid of this frame's occluders, hiZLevels is 0 when there was no pre-pass
+uniform sampler2D hiZ;
+uniform int hiZLevels;
+uniform mat4 viewProjection;
+
+bool outsideFrustum(vec3 boxMin, vec3 boxMax)
+{
+    for (int i = 0; i < 6; ++i) {
+        // corner furthest along the plane normal
+        vec3 corner = mix(boxMin, boxMax, greaterThan(frustumPlanes[i].xyz, vec3(0.0)));
+        if (dot(frustumPlanes[i].xyz, corner) + frustumPlanes[i].w < 0.0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool occluded(vec3 boxMin, vec3 boxMax)
+{
+    if (hiZLevels == 0) {
+        return false;
+    }
+
+    vec2 uvMin = vec2(1.0);
+    vec2 uvMax = vec2(0.0);
+    float nearest = 1.0;
+    for (int corner = 0; corner < 8; ++corner) {
+        vec3 point = vec3((corner & 1) != 0 ? boxMax.x : boxMin.x,
+            (corner & 2) != 0 ? boxMax.y : boxMin.y,
+            (corner & 4) != 0 ? boxMax.z : boxMin.z);
+        vec4 clip = viewProjection * vec4(point, 1.0);
+        // reaches behind the camera, its nearest depth is the near plane
+        if (clip.w <= 1e-4) {
+            return false;
+        }
+        vec3 ndc = clip.xyz / clip.w;
+        uvMin = min(uvMin, ndc.xy * 0.5 + 0.5);
+        uvMax = max(uvMax, ndc.xy * 0.5 + 0.5);
+        nearest = min(nearest, ndc.z * 0.5 + 0.5);
+    }
+    // the part off the screen can't be seen, only the visible part is tested
+    uvMin = clamp(uvMin, vec2(0.0), vec2(1.0));
+    uvMax = clamp(uvMax, vec2(0.0), vec2(1.0));
+
+    // finest level the box covers at most 2x2 texels of, every level maps texels by halving
+    ivec2 size = textureSize(hiZ, 0);
+    ivec2 texelMin = min(ivec2(uvMin * vec2(size)), size - 1);
+    ivec2 texelMax = min(ivec2(uvMax * vec2(size)), size - 1);
+    int level = 0;
+    while (level + 1 < hiZLevels && any(greaterThan((texelMax >> level) - (texelMin >> level), ivec2(1)))) {
+        ++level;
+    }
+    // an odd sized level folds its leftover texel into the last one
+    ivec2 levelSize = textureSize(hiZ, level);
+    ivec2 low = min(texelMin >> level, levelSize - 1);
+    ivec2 high = min(texelMax >> level, levelSize - 1);
+    float farthest = max(max(texelFetch(hiZ, low, level).r, texelFetch(hiZ, ivec2(high.x, low.y), level).r),
+        max(texelFetch(hiZ, ivec2(low.x, high.y), level).r, texelFetch(hiZ, high, level).r));
+    return nearest > farthest;
+}
+
+float lodError(SceneMesh mesh, int level)
+{
+    return mesh.lodErrors[level / 4][level % 4];
+}
+
+void main()
+{
+    uint id = gl_GlobalInvocationID.x;
+    if (id >= instanceCount) {
+        return;
+    }
+
+    vec3 boxMin = sceneInstances[id].boundsMin.xyz;
+    vec3 boxMax = sceneInstances[id].boundsMax.xyz;
+    if (outsideFrustum(boxMin, boxMax)) {
+        atomicAdd(frustumCulled, 1u);
+        return;
+    }
+
+    // same rule as selectLod, starting from last frame's level
+    SceneMesh mesh = sceneMeshes[sceneInstances[id].info.x];
+    int levels = int(mesh.commands.z);
+    float distance = max(dot(viewDepthRow, vec4((boxMin + boxMax) * 0.5, 1.0)), 1e-3);
+    float pixelsPerUnit = pixelScale * sceneInstances[id].boundsMax.w / distance;
+    int level = min(int(sceneInstances[id].info.y), levels - 1);
+    while (level > 0 && lodError(mesh, level) * pixelsPerUnit > maxPixelError) {
+        --level;
+    }
+    while (level + 1 < levels && lodError(mesh, level + 1) * pixelsPerUnit <= maxPixelError * (1.0 - lodHysteresis)) {
+        ++level;
+    }
+    sceneInstances[id].info.y = uint(level);
+
+    uint first = mesh.commands.x + uint(level);
+    if (occluded(boxMin, boxMax)) {
+        atomicAdd(occludedCount, 1u);
+        for (uint submesh = 0u; submesh < mesh.commands.y; ++submesh) {
+            atomicAdd(occludedTriangles, drawCommands[first + submesh * uint(levels)].count / 3u);
+        }
+        return;
+    }
+    atomicAdd(visibleCount, 1u);
+
+    for (uint submesh = 0u; submesh < mesh.commands.y; ++submesh) {
+        uint command = first + submesh * uint(levels);
+        uint slot = atomicAdd(drawCommands[command].instanceCount, 1u);
+        visibleIds[drawCommands[command].baseInstance + slot] = id;
+        atomicAdd(triangleCount, drawCommands[command].count / 3u);
+    }
+}
+)";
+
+//level 0 of the pyramid is the scene depth as it is
+static const char* hiZCopyComputeSource = R"(#version 430 core
+layout (local_size_x = 8, local_size_y = 8) in;
+
+uniform sampler2D sceneDepth;
+layout (r32f, binding = 0) uniform writeonly image2D hiZLevel;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, imageSize(hiZLevel)))) {
+        return;
+    }
+    imageStore(hiZLevel, texel, vec4(texelFetch(sceneDepth, texel, 0).r));
+}
+)";
+
+//every other level keeps the farthest depth of the 2x2 below it
+static const char* hiZReduceComputeSource = R"(#version 430 core
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (r32f, binding = 0) uniform readonly image2D sourceLevel;
+layout (r32f, binding = 1) uniform writeonly image2D hiZLevel;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(hiZLevel);
+    if (any(greaterThanEqual(texel, size))) {
+        return;
+    }
+
+    // the last row/column of an odd sized source also takes in the texel left over
+    ivec2 sourceSize = imageSize(sourceLevel);
+    ivec2 first = texel * 2;
+    ivec2 leftover = ivec2(equal(texel, size - 1)) * (sourceSize & ivec2(1));
+    ivec2 last = min(first + ivec2(1) + leftover, sourceSize - 1);
+
+    float farthest = 0.0;
+    for (int y = first.y; y <= last.y; ++y) {
+        for (int x = first.x; x <= last.x; ++x) {
+            farthest = max(farthest, imageLoad(sourceLevel, ivec2(x, y)).r);
+        }
+    }
+    imageStore(hiZLevel, texel, vec4(farthest));
+}
+)";
+
+//threads per work group in the shaders above
+static const GLuint CullGroupSize = 64;
+static const GLuint HiZGroupSize = 8;
+
+bool GpuScene::supported()
+{
+    if (!GLEW_VERSION_4_3) {
+        return false;
+    }
+    //4.3 only promises storage buffers in compute shaders, the vertex stage reads the instances too
+    GLint vertexStorageBlocks = 0;
+    glGetIntegerv(GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS, &vertexStorageBlocks);
+    return vertexStorageBlocks > 0;
+}
+
+int GpuScene::addMesh(const MeshView& mesh, int group, bool occluder)
+{
+    MeshSource source;
+    source.group = group;
+    source.baseVertex = (GLint)(vertices.size() / VertexStride);
+    source.firstIndex = (GLuint)indices.size();
+    source.submeshes.assign(mesh.submeshes, mesh.submeshes + mesh.submeshCount);
+    source.levels = meshLodErrors(mesh.submeshes, mesh.submeshCount, source.lodErrors);
+    source.instanceCount = 0;
+    source.occluder = occluder;
+
+    vertices.insert(vertices.end(), mesh.vertices, mesh.vertices + (size_t)mesh.vertexCount * VertexStride);
+    //one index type for the whole scene, 16 bit meshes are widened
+    for (GLsizei i = 0; i < mesh.indexCount; ++i) {
+        indices.push_back(mesh.indexType == GL_UNSIGNED_SHORT ?
+            (GLuint)static_cast<const GLushort*>(mesh.indices)[i] : static_cast<const GLuint*>(mesh.indices)[i]);
+    }
+
+    meshes.push_back(source);
+    if (group >= (int)groups.size()) {
+        groups.resize(group + 1);
+    }
+    return (int)meshes.size() - 1;
+}
+
+void GpuScene::addInstance(int mesh, const glm::mat4& model, const glm::vec4& color, const Aabb& localBounds)
+{
+    Aabb world = transformAabb(localBounds, model);
+    SceneInstance instance;
+    instance.model = model;
+    instance.color = color;
+    instance.boundsMin = glm::vec4(world.min, 0.0f);
+    instance.boundsMax = glm::vec4(world.max, glm::length(glm::vec3(model[0])));
+    instance.info = glm::uvec4((GLuint)mesh, 0, 0, 0);
+    instances.push_back(instance);
+    ++meshes[mesh].instanceCount;
+}
+
+void GpuScene::setInstanceColor(int instance, const glm::vec4& color)
+{
+    instances[instance].color = color;
+    if (buffers[Instances] != 0) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[Instances]);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, instance * sizeof(SceneInstance) + offsetof(SceneInstance, color),
+            sizeof(glm::vec4), &color);
+    }
+}
+
+bool GpuScene::build()
+{
+    //a command per (submesh, level) of every mesh, each group's commands side by side so one multi draw covers them,
+    //and a run of visible id slots per command big enough for every instance of its mesh
+    std::vector<IndirectCommand> commands;
+    std::vector<MeshRecord> records(meshes.size());
+    GLuint visibleSlots = 0;
+    for (size_t g = 0; g < groups.size(); ++g) {
+        groups[g].firstCommand = (GLuint)commands.size();
+        for (size_t m = 0; m < meshes.size(); ++m) {
+            const MeshSource& mesh = meshes[m];
+            if (mesh.group != (int)g) {
+                continue;
+            }
+            MeshRecord& record = records[m];
+            record.commands = glm::uvec4((GLuint)commands.size(), (GLuint)mesh.submeshes.size(), (GLuint)mesh.levels, 0);
+            for (int level = 0; level < MaxMeshLods; ++level) {
+                record.lodErrors[level / 4][level % 4] = level < mesh.levels ? mesh.lodErrors[level] : 0.0f;
+            }
+            for (const Submesh& submesh : mesh.submeshes) {
+                for (int level = 0; level < mesh.levels; ++level) {
+                    //a submesh with fewer levels keeps drawing its last one
+                    const MeshLod& lod = submesh.lods[std::min(level, (int)submesh.lodCount - 1)];
+                    IndirectCommand command;
+                    command.count = (GLuint)lod.indexCount;
+                    command.instanceCount = 0;
+                    command.firstIndex = mesh.firstIndex + lod.indexOffset;
+                    command.baseVertex = mesh.baseVertex + submesh.baseVertex;
+                    command.baseInstance = visibleSlots;
+                    commands.push_back(command);
+                    visibleSlots += mesh.instanceCount;
+                }
+            }
+        }
+        groups[g].commandCount = (GLsizei)(commands.size() - groups[g].firstCommand);
+    }
+    commandBytes = (GLsizeiptr)(commands.size() * sizeof(IndirectCommand));
+
+    //the pre-pass never changes: one command per submesh of every occluder instance at full detail,
+    //reading its instance id from slots after the ones the culling pass fills
+    std::vector<IndirectCommand> occluderCommands;
+    std::vector<GLuint> occluderIds;
+    occluderInstances = 0;
+    for (size_t i = 0; i < instances.size(); ++i) {
+        const MeshSource& mesh = meshes[instances[i].info.x];
+        if (!mesh.occluder) {
+            continue;
+        }
+        for (const Submesh& submesh : mesh.submeshes) {
+            IndirectCommand command;
+            command.count = (GLuint)submesh.lods[0].indexCount;
+            command.instanceCount = 1;
+            command.firstIndex = mesh.firstIndex + submesh.lods[0].indexOffset;
+            command.baseVertex = mesh.baseVertex + submesh.baseVertex;
+            command.baseInstance = visibleSlots + (GLuint)occluderIds.size();
+            occluderCommands.push_back(command);
+        }
+        occluderIds.push_back((GLuint)i);
+        ++occluderInstances;
+    }
+    occluderCommandCount = (GLsizei)occluderCommands.size();
+
+    glGenBuffers(BufferCount, buffers);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[Instances]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, instances.size() * sizeof(SceneInstance), instances.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[Meshes]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, records.size() * sizeof(MeshRecord), records.data(), GL_STATIC_DRAW);
+    //the culling pass counts instances into a fresh copy of the template every frame
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[CommandTemplate]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, commandBytes, commands.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[Commands]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, commandBytes, commands.data(), GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[VisibleIds]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(visibleSlots + occluderIds.size(), 1) * sizeof(GLuint),
+        nullptr, GL_DYNAMIC_COPY);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, visibleSlots * sizeof(GLuint), occluderIds.size() * sizeof(GLuint),
+        occluderIds.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[Counters]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, CounterCount * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffers[OccluderCommands]);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, std::max<size_t>(occluderCommands.size(), 1) * sizeof(IndirectCommand),
+        occluderCommands.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    glGenBuffers(ReadbackCount, readback);
+    for (int i = 0; i < ReadbackCount; ++i) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, readback[i]);
+        glBufferData(GL_COPY_WRITE_BUFFER, CounterCount * sizeof(GLuint), nullptr, GL_STREAM_READ);
+        glGenQueries(2, timerQueries[i]);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    //one VAO for the whole scene, same attribute locations as uploadMesh plus the visible id per instance
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vertexBuffer);
+    glGenBuffers(1, &indexBuffer);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    const GLint sizes[4] = { 3, 3, 3, 2 };
+    const size_t offsets[4] = { 0, 3, 6, 9 };
+    for (GLuint location = 0; location < 4; ++location) {
+        glVertexAttribPointer(location, sizes[location], GL_FLOAT, GL_FALSE, VertexStride * sizeof(GLfloat),
+            (GLvoid*)(offsets[location] * sizeof(GLfloat)));
+        glEnableVertexAttribArray(location);
+    }
+    //instanced, so baseInstance picks each command's run of ids
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[VisibleIds]);
+    glVertexAttribIPointer(SceneInstanceIdLocation, 1, GL_UNSIGNED_INT, sizeof(GLuint), (GLvoid*)0);
+    glVertexAttribDivisor(SceneInstanceIdLocation, 1);
+    glEnableVertexAttribArray(SceneInstanceIdLocation);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    std::cout << "GPU driven scene: " << meshes.size() << " meshes, " << instances.size() << " instances, "
+        << commands.size() << " indirect commands in " << groups.size() << " groups, "
+        << occluderInstances << " occluders\n";
+
+    //the cpu copies aren't needed once uploaded, the instance count stays for the dispatch size
+    vertices = std::vector<GLfloat>();
+    indices = std::vector<GLuint>();
+
+    GLuint cull = linkComputeProgram(cullComputeSource);
+    GLuint hiZCopy = linkComputeProgram(hiZCopyComputeSource);
+    GLuint hiZReduce = linkComputeProgram(hiZReduceComputeSource);
+    if (!cull || !hiZCopy || !hiZReduce) {
+        glDeleteProgram(cull);
+        glDeleteProgram(hiZCopy);
+        glDeleteProgram(hiZReduce);
+        return false;
+    }
+    cullProgram.adopt(cull);
+    hiZCopyProgram.adopt(hiZCopy);
+    hiZReduceProgram.adopt(hiZReduce);
+    //both read their texture from unit 0
+    glUseProgram(cull);
+    glUniform1i(cullProgram.uniform("hiZ"), 0);
+    glUseProgram(hiZCopy);
+    glUniform1i(hiZCopyProgram.uniform("sceneDepth"), 0);
+    glUseProgram(0);
+    return true;
+}
+
+void GpuScene::destroy()
+{
+    for (int i = 0; i < ReadbackCount; ++i) {
+        if (readbackFences[i]) {
+            glDeleteSync(readbackFences[i]);
+            readbackFences[i] = 0;
+        }
+        glDeleteQueries(2, timerQueries[i]);
+    }
+    glDeleteBuffers(ReadbackCount, readback);
+    glDeleteBuffers(BufferCount, buffers);
+    glDeleteBuffers(1, &vertexBuffer);
+    glDeleteBuffers(1, &indexBuffer);
+    glDeleteVertexArrays(1, &vao);
+    cullProgram.destroy();
+    hiZCopyProgram.destroy();
+    hiZReduceProgram.destroy();
+    destroyTarget();
+    *this = GpuScene();
+}
+
+void GpuScene::cull(const glm::mat4& view, const glm::mat4& projection, float maxPixelError)
+{
+    if (!cullProgram.ready()) {
+        return;
+    }
+
+    //instance counts back to zero, counters cleared
+    glBindBuffer(GL_COPY_READ_BUFFER, buffers[CommandTemplate]);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[Commands]);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, commandBytes);
+    const GLuint zero[CounterCount] = {};
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[Counters]);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, 0, sizeof(zero), zero);
+
+    //level of detail is picked for the viewport this frame draws to
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glm::mat4 viewProjection = projection * view;
+    Frustum frustum = extractFrustum(viewProjection);
+    glm::vec4 viewDepthRow = -glm::vec4(view[0][2], view[1][2], view[2][2], view[3][2]);
+
+    glUseProgram(cullProgram.id());
+    ++latestStats.programChanges;
+    glUniform1ui(cullProgram.uniform("instanceCount"), (GLuint)instances.size());
+    glUniform4fv(cullProgram.uniform("frustumPlanes"), 6, &frustum.planes[0][0]);
+    glUniform4fv(cullProgram.uniform("viewDepthRow"), 1, &viewDepthRow[0]);
+    glUniform1f(cullProgram.uniform("pixelScale"), projection[1][1] * viewport[3] * 0.5f);
+    glUniform1f(cullProgram.uniform("maxPixelError"), maxPixelError);
+    glUniform1f(cullProgram.uniform("lodHysteresis"), LodHysteresis);
+    glUniform1i(cullProgram.uniform("hiZLevels"), hiZReady ? hiZLevels : 0);
+    glUniformMatrix4fv(cullProgram.uniform("viewProjection"), 1, GL_FALSE, &viewProjection[0][0]);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, hiZTexture);
+    ++latestStats.textureChanges;
+    for (GLuint binding = Instances; binding <= Counters; ++binding) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffers[binding]);
+        ++latestStats.bufferBinds;
+    }
+    glDispatchCompute(((GLuint)instances.size() + CullGroupSize - 1) / CullGroupSize, 1, 1);
+    //the commands are read as indirect draws, the ids as an attribute, the counters by the copy below
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT |
+        GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    //counters go to a readback slot that is only read once its fence has passed
+    int slot = readbackFrame % ReadbackCount;
+    if (timed[slot]) {
+        glQueryCounter(timerQueries[slot][1], GL_TIMESTAMP);
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, buffers[Counters]);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, readback[slot]);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(zero));
+    readbackFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    ++readbackFrame;
+}
+
+void GpuScene::readStats()
+{
+    //the slot about to be reused was written ReadbackCount frames ago, nearly always done by now
+    int slot = readbackFrame % ReadbackCount;
+    if (!readbackFences[slot]) {
+        return;
+    }
+    GLenum status = glClientWaitSync(readbackFences[slot], 0, 0);
+    glDeleteSync(readbackFences[slot]);
+    readbackFences[slot] = 0;
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+        return;
+    }
+
+    GLuint counters[CounterCount];
+    glBindBuffer(GL_COPY_READ_BUFFER, readback[slot]);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(counters), counters);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    latestStats.visible = (int)counters[0];
+    latestStats.frustumCulled = (int)counters[1];
+    latestStats.occluded = (int)counters[2];
+    latestStats.triangles = counters[3];
+    latestStats.occludedTriangles = counters[4];
+    latestStats.occluders = timed[slot] ? occluderInstances : 0;
+
+    //both timestamps were written before the fence, so the results are already there
+    latestStats.occlusionMicroseconds = 0.0;
+    if (timed[slot]) {
+        GLuint64 start = 0;
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(timerQueries[slot][0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(timerQueries[slot][1], GL_QUERY_RESULT, &end);
+        latestStats.occlusionMicroseconds = (end - start) / 1000.0;
+    }
+}
+
+void GpuScene::beginTarget()
+{
+    //this frame reuses the oldest readback slot, take what it holds first
+    readStats();
+    timed[readbackFrame % ReadbackCount] = false;
+    latestStats.commands = 0;
+    latestStats.multiDraws = 0;
+    latestStats.programChanges = 0;
+    latestStats.textureChanges = 0;
+    latestStats.vaoChanges = 0;
+    latestStats.bufferBinds = 0;
+
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    if (previousViewport[2] != targetWidth || previousViewport[3] != targetHeight) {
+        createTarget(previousViewport[2], previousViewport[3]);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, targetWidth, targetHeight);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void GpuScene::drawOccluders()
+{
+    if (occluderCommandCount == 0 || !hiZCopyProgram.ready()) {
+        return;
+    }
+    int slot = readbackFrame % ReadbackCount;
+    glQueryCounter(timerQueries[slot][0], GL_TIMESTAMP);
+    timed[slot] = true;
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glBindVertexArray(vao);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SceneInstanceBinding, buffers[Instances]);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffers[OccluderCommands]);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (GLvoid*)0, occluderCommandCount, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    latestStats.commands += occluderCommandCount;
+    ++latestStats.multiDraws;
+    ++latestStats.vaoChanges;
+    ++latestStats.bufferBinds;
+
+    buildHiZ();
+    hiZReady = true;
+    //otherwise the occluders drawn again with their materials would fail the depth test against themselves
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void GpuScene::drawGroup(int group)
+{
+    const Group& drawn = groups[group];
+    if (drawn.commandCount == 0) {
+        return;
+    }
+    glBindVertexArray(vao);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SceneInstanceBinding, buffers[Instances]);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffers[Commands]);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+        (GLvoid*)(drawn.firstCommand * sizeof(IndirectCommand)), drawn.commandCount, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+    latestStats.commands += drawn.commandCount;
+    ++latestStats.multiDraws;
+    ++latestStats.vaoChanges;
+    ++latestStats.bufferBinds;
+}
+
+void GpuScene::endTarget()
+{
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousFramebuffer);
+    glBlitFramebuffer(0, 0, targetWidth, targetHeight, previousViewport[0], previousViewport[1],
+        previousViewport[0] + targetWidth, previousViewport[1] + targetHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    hiZReady = false;
+}
+
+void GpuScene::buildHiZ()
+{
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glUseProgram(hiZCopyProgram.id());
+    latestStats.programChanges += 2;
+    //depth texture, then one image for the copy and two for every reduce step
+    latestStats.textureChanges += 2 * hiZLevels;
+    glBindImageTexture(0, hiZTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glDispatchCompute((targetWidth + HiZGroupSize - 1) / HiZGroupSize, (targetHeight + HiZGroupSize - 1) / HiZGroupSize, 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glUseProgram(hiZReduceProgram.id());
+    for (int level = 1; level < hiZLevels; ++level) {
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        int width = std::max(targetWidth >> level, 1);
+        int height = std::max(targetHeight >> level, 1);
+        glBindImageTexture(0, hiZTexture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        glBindImageTexture(1, hiZTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute((width + HiZGroupSize - 1) / HiZGroupSize, (height + HiZGroupSize - 1) / HiZGroupSize, 1);
+    }
+    //the culling pass reads it back through a sampler
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    glUseProgram(0);
+}
+
+void GpuScene::createTarget(int width, int height)
+{
+    destroyTarget();
+    targetWidth = width;
+    targetHeight = height;
+    hiZLevels = 1;
+    while ((std::max(width, height) >> hiZLevels) > 0) {
+        ++hiZLevels;
+    }
+
+    glGenTextures(1, &colorTexture);
+    glBindTexture(GL_TEXTURE_2D, colorTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+
+    //float depth so level 0 of the pyramid is a straight copy
+    glGenTextures(1, &depthTexture);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenTextures(1, &hiZTexture);
+    glBindTexture(GL_TEXTURE_2D, hiZTexture);
+    glTexStorage2D(GL_TEXTURE_2D, hiZLevels, GL_R32F, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "GPU driven scene framebuffer is incomplete" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+}
+
+void GpuScene::destroyTarget()
+{
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(1, &colorTexture);
+    glDeleteTextures(1, &depthTexture);
+    glDeleteTextures(1, &hiZTexture);
+    framebuffer = colorTexture = depthTexture = hiZTexture = 0;
+    targetWidth = targetHeight = 0;
+    hiZLevels = 0;
+    hiZReady = false;
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "Culling.h"
+#include "ModelLoader.h"
+#include "ShaderProgram.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+//storage buffer binding the GPU_DRIVEN vertex stage reads SceneInstance from
+const GLuint SceneInstanceBinding = 0;
+//attribute the culling pass's visible instance ids are read through, one per instance (divisor 1)
+const GLuint SceneInstanceIdLocation = 9;
+
+//one placed mesh, std430 layout matching SceneInstances in Shader.h and the culling compute shader
+struct SceneInstance {
+    glm::mat4 model;
+    glm::vec4 color;
+    //world bounds, boundsMax.w is the model's scale for level of detail
+    glm::vec4 boundsMin;
+    glm::vec4 boundsMax;
+    //x = mesh, y = level it drew at last frame (the hysteresis starts from it)
+    glm::uvec4 info;
+};
+
+//counts the culling pass wrote, read back a couple of frames late so the cpu never waits on them
+struct GpuSceneStats {
+    int visible = 0;
+    int frustumCulled = 0;
+    int occluded = 0;
+    long long triangles = 0;
+    //indirect commands behind the multi draws (pre-pass included), including the ones that drew nothing
+    int commands = 0;
+    int multiDraws = 0;
+    //binds the scene made itself this frame, counted on the cpu so they are never late
+    //textures include the Hi-Z image bindings, buffer binds are the storage buffers the shaders read
+    int programChanges = 0;
+    int textureChanges = 0;
+    int vaoChanges = 0;
+    int bufferBinds = 0;
+    //occluder instances in the depth pre-pass, and what the instances it hid would have drawn
+    int occluders = 0;
+    long long occludedTriangles = 0;
+    //gpu time of the pre-pass, pyramid and culling dispatch
+    double occlusionMicroseconds = 0.0;
+};
+
+//the static scene drawn without the cpu touching individual objects:
+//every mesh lives in one vertex + index buffer, every instance in a storage buffer, and a compute pass
+//does the frustum test, the level of detail and the Hi-Z occlusion test (against a depth pre-pass of the
+//occluder meshes), then fills the DrawElementsIndirectCommands each material group is drawn from with one glMultiDrawElementsIndirect
+//needs GL 4.3, check supported() first
+class GpuScene {
+public:
+    //compute shaders, storage buffers and multi draw indirect, from the context version or extensions
+    static bool supported();
+
+    //copies a mesh (VertexStride layout, every submesh + level) into the shared buffers, returns its index
+    //group is the material it is drawn with, each group gets one multi draw
+    //instances of an occluder mesh are drawn (at full detail) into the depth pre-pass the others are tested against
+    int addMesh(const MeshView& mesh, int group, bool occluder = false);
+    //places a mesh, localBounds is the mesh's own box
+    void addInstance(int mesh, const glm::mat4& model, const glm::vec4& color, const Aabb& localBounds);
+    //instances are numbered in the order they were added, after build this updates the uploaded copy too
+    void setInstanceColor(int instance, const glm::vec4& color);
+
+    //uploads everything added so far and builds the compute programs, false if they failed
+    bool build();
+    void destroy();
+
+    //a frame goes beginTarget, drawOccluders (optional), cull, drawGroup for every group, endTarget
+
+    //redirects drawing into the scene's own colour + depth target (sized to the viewport) and clears it
+    void beginTarget();
+    //depth of every occluder instance, reduced into the Hi-Z pyramid cull tests against, then the depth is cleared
+    //bind a DEPTH_ONLY | GPU_DRIVEN program first, without it cull does no occlusion test
+    void drawOccluders();
+    //fills the indirect commands for this view, visible instances pick the coarsest level under maxPixelError
+    void cull(const glm::mat4& view, const glm::mat4& projection, float maxPixelError);
+    //one multi draw for every command of the group, bind the group's program + textures first
+    void drawGroup(int group);
+    //copies the colour back to the framebuffer that was bound
+    void endTarget();
+
+    //latest counts that have come back from the gpu
+    const GpuSceneStats& stats() const { return latestStats; }
+    int groupCount() const { return (int)groups.size(); }
+
+private:
+    //std430 layout of SceneMeshes in the culling shader
+    struct MeshRecord {
+        //x = first command, y = submeshes, z = levels
+        glm::uvec4 commands;
+        glm::vec4 lodErrors[2];
+    };
+
+    //GL's DrawElementsIndirectCommand
+    struct IndirectCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    struct MeshSource {
+        int group;
+        GLint baseVertex;
+        GLuint firstIndex;
+        std::vector<Submesh> submeshes;
+        int levels;
+        float lodErrors[MaxMeshLods];
+        GLuint instanceCount;
+        bool occluder;
+    };
+
+    struct Group {
+        GLuint firstCommand = 0;
+        GLsizei commandCount = 0;
+    };
+
+    //GL buffers, in storage binding order where the culling shader binds them
+    enum { Instances, Meshes, Commands, VisibleIds, Counters, CommandTemplate, OccluderCommands, BufferCount };
+    static const int ReadbackCount = 3;
+    //visibleCount, frustumCulled, occludedCount, triangleCount, occludedTriangles in the culling shader
+    static const int CounterCount = 5;
+
+    void createTarget(int width, int height);
+    void destroyTarget();
+    void buildHiZ();
+    void readStats();
+
+    //filled by addMesh/addInstance, uploaded by build
+    std::vector<GLfloat> vertices;
+    std::vector<GLuint> indices;
+    std::vector<MeshSource> meshes;
+    std::vector<SceneInstance> instances;
+    std::vector<Group> groups;
+
+    GLuint vao = 0;
+    GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+    GLuint buffers[BufferCount] = {};
+    GLsizeiptr commandBytes = 0;
+    GLsizei occluderCommandCount = 0;
+    int occluderInstances = 0;
+
+    ShaderProgram cullProgram;
+    ShaderProgram hiZCopyProgram;
+    ShaderProgram hiZReduceProgram;
+
+    //scene target + the max depth pyramid built from it
+    GLuint framebuffer = 0;
+    GLuint colorTexture = 0;
+    GLuint depthTexture = 0;
+    GLuint hiZTexture = 0;
+    int targetWidth = 0;
+    int targetHeight = 0;
+    int hiZLevels = 0;
+    //the pyramid only holds this frame's occluders once drawOccluders has run
+    bool hiZReady = false;
+    GLint previousFramebuffer = 0;
+    GLint previousViewport[4] = {};
+
+    //counters copied out every frame, read once their fence has passed
+    GLuint readback[ReadbackCount] = {};
+    GLsync readbackFences[ReadbackCount] = {};
+    //timestamps either side of the pre-pass + culling, only when the pre-pass ran that frame
+    GLuint timerQueries[ReadbackCount][2] = {};
+    bool timed[ReadbackCount] = {};
+    int readbackFrame = 0;
+    GpuSceneStats latestStats;
+};
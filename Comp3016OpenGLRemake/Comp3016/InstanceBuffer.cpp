@@ -0,0 +1,47 @@
+#include "InstanceBuffer.h"
+
+#include <cstddef>
+
+void InstanceBuffer::attach(GLuint vao) const
+{
+    glBindVertexArray(vao);
+    for (GLuint column = 0; column < 4; ++column) {
+        glEnableVertexAttribArray(InstanceModelLocation + column);
+        glVertexAttribDivisor(InstanceModelLocation + column, 1);
+    }
+    glEnableVertexAttribArray(InstanceColorLocation);
+    glVertexAttribDivisor(InstanceColorLocation, 1);
+    glBindVertexArray(0);
+}
+
+GLsizei InstanceBuffer::upload(StreamBuffer& stream, const InstanceData* instances, GLsizei count)
+{
+    buffer = stream.id();
+    offset = stream.allocate(instances, (GLsizeiptr)count * sizeof(InstanceData), sizeof(glm::vec4));
+    instanceCount = offset < 0 ? 0 : count;
+    return instanceCount;
+}
+
+void InstanceBuffer::draw(GLuint vao, GLsizei indexCount, GLenum indexType) const
+{
+    if (instanceCount == 0) {
+        return;
+    }
+
+    glBindVertexArray(vao);
+    bindAttributes();
+    glDrawElementsInstanced(GL_TRIANGLES, indexCount, indexType, 0, instanceCount);
+    glBindVertexArray(0);
+}
+
+void InstanceBuffer::bindAttributes() const
+{
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (GLuint column = 0; column < 4; ++column) {
+        glVertexAttribPointer(InstanceModelLocation + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+            (GLvoid*)(offset + column * sizeof(glm::vec4)));
+    }
+    glVertexAttribPointer(InstanceColorLocation, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+        (GLvoid*)(offset + offsetof(InstanceData, color)));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
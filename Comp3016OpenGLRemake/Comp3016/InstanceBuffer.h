@@ -0,0 +1,38 @@
+#pragma once
+
+#include "StreamBuffer.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+//per instance attributes, read by the instanced vertex shader at locations 4-7 (model) and 8 (colour)
+struct InstanceData {
+    glm::mat4 model;
+    glm::vec4 color;
+};
+
+//first attribute location used by InstanceData, the matrix takes four in a row
+const GLuint InstanceModelLocation = 4;
+const GLuint InstanceColorLocation = 8;
+
+//per frame instance transforms sub-allocated from the frame's StreamBuffer and drawn with glDrawElementsInstanced
+class InstanceBuffer {
+public:
+    //enables the instance attributes on a mesh VAO, once per VAO
+    void attach(GLuint vao) const;
+
+    //copies this frame's instances into the stream, returns how many fit (0 when the region is full)
+    GLsizei upload(StreamBuffer& stream, const InstanceData* instances, GLsizei count);
+    //draws every uploaded instance of an indexed mesh whose VAO was attached
+    void draw(GLuint vao, GLsizei indexCount, GLenum indexType) const;
+
+    //points the bound VAO's instance attributes at this frame's instances, for callers that bind the VAO themselves
+    void bindAttributes() const;
+
+    GLsizei count() const { return instanceCount; }
+
+private:
+    GLuint buffer = 0;
+    GLintptr offset = 0;
+    GLsizei instanceCount = 0;
+};
@@ -0,0 +1,105 @@
+#include "JobSystem.h"
+#include "Profiler.h"
+
+#include <algorithm>
+
+JobSystem::JobSystem(unsigned int workerCount)
+{
+    //leave one hardware thread for the render thread
+    if (workerCount == 0) {
+        unsigned int hardwareThreads = std::thread::hardware_concurrency();
+        workerCount = std::max(1u, hardwareThreads > 1 ? hardwareThreads - 1 : 1u);
+    }
+
+    for (unsigned int i = 0; i < workerCount; ++i) {
+        workers.emplace_back(&JobSystem::workerLoop, this);
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        stopping = true;
+    }
+    jobsReady.notify_all();
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void JobSystem::submit(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        jobs.push_back(std::move(job));
+    }
+    jobsReady.notify_one();
+}
+
+void JobSystem::workerLoop()
+{
+    setProfilerThreadName("Job worker");
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(jobsMutex);
+            jobsReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+
+            //finish queued work before shutting down
+            if (jobs.empty()) {
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        CpuScope scope("job");
+        job();
+    }
+}
+
+CompletionQueue::~CompletionQueue()
+{
+    Node* node = head.exchange(nullptr);
+    while (node) {
+        Node* next = node->next;
+        delete node;
+        node = next;
+    }
+}
+
+void CompletionQueue::push(std::function<void()> work)
+{
+    Node* node = new Node{ std::move(work), nullptr };
+
+    //treiber stack push, retry until no other producer got in between
+    node->next = head.load(std::memory_order_relaxed);
+    while (!head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+}
+
+int CompletionQueue::drain()
+{
+    //take the whole stack in one go, producers keep pushing onto a fresh empty one
+    Node* node = head.exchange(nullptr, std::memory_order_acquire);
+
+    //stack comes out newest first, reverse it so work runs in push order
+    Node* ordered = nullptr;
+    while (node) {
+        Node* next = node->next;
+        node->next = ordered;
+        ordered = node;
+        node = next;
+    }
+
+    int count = 0;
+    while (ordered) {
+        Node* next = ordered->next;
+        ordered->work();
+        delete ordered;
+        ordered = next;
+        ++count;
+    }
+    return count;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//fixed pool of worker threads pulling jobs from a shared queue
+class JobSystem {
+public:
+    //0 workers means one per spare hardware thread
+    explicit JobSystem(unsigned int workerCount = 0);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    void submit(std::function<void()> job);
+    size_t workerCount() const { return workers.size(); }
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex jobsMutex;
+    std::condition_variable jobsReady;
+    bool stopping = false;
+};
+
+//lock free multi producer / single consumer queue of work that has to run on the GL thread
+//workers push finished loads, the render thread drains them between frames
+class CompletionQueue {
+public:
+    CompletionQueue() = default;
+    ~CompletionQueue();
+
+    CompletionQueue(const CompletionQueue&) = delete;
+    CompletionQueue& operator=(const CompletionQueue&) = delete;
+
+    //safe from any thread
+    void push(std::function<void()> work);
+    //runs everything pushed so far in push order, only call from the GL thread
+    //returns how many items ran
+    int drain();
+
+private:
+    struct Node {
+        std::function<void()> work;
+        Node* next;
+    };
+
+    std::atomic<Node*> head{ nullptr };
+};
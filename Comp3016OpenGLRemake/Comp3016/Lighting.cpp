@@ -0,0 +1,279 @@
+#include "Lighting.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define LIGHTING_SSE 1
+#include <xmmintrin.h>
+#endif
+
+static const int TilesPerSlice = ClusterTilesX * ClusterTilesY;
+static_assert(TilesPerSlice % 4 == 0, "the SSE binning loop tests 4 tiles at a time");
+
+void LightClusters::setProjection(const glm::mat4& newProjection)
+{
+    if (newProjection == projection) {
+        return;
+    }
+    projection = newProjection;
+
+    //near/far straight from the perspective matrix
+    nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+    farPlane = projection[3][2] / (projection[2][2] + 1.0f);
+    float logRange = std::log(farPlane / nearPlane);
+    sliceScale = ClusterSlices / logRange;
+    sliceBias = -ClusterSlices * std::log(nearPlane) / logRange;
+
+    minX.resize(ClusterCount);
+    minY.resize(ClusterCount);
+    minZ.resize(ClusterCount);
+    maxX.resize(ClusterCount);
+    maxY.resize(ClusterCount);
+    maxZ.resize(ClusterCount);
+
+    //each tile's corners on the near plane, in view space
+    glm::mat4 inverseProjection = glm::inverse(projection);
+    for (int slice = 0; slice < ClusterSlices; ++slice) {
+        float sliceNear = nearPlane * std::pow(farPlane / nearPlane, (float)slice / ClusterSlices);
+        float sliceFar = nearPlane * std::pow(farPlane / nearPlane, (float)(slice + 1) / ClusterSlices);
+
+        for (int y = 0; y < ClusterTilesY; ++y) {
+            for (int x = 0; x < ClusterTilesX; ++x) {
+                glm::vec3 boxMin(1e30f), boxMax(-1e30f);
+                for (int corner = 0; corner < 4; ++corner) {
+                    float ndcX = -1.0f + 2.0f * (x + (corner & 1)) / ClusterTilesX;
+                    float ndcY = -1.0f + 2.0f * (y + (corner >> 1)) / ClusterTilesY;
+                    glm::vec4 onNear = inverseProjection * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+                    glm::vec3 ray = glm::vec3(onNear) / onNear.w;
+
+                    //same ray at the slice's two depths, the camera looks down -z
+                    glm::vec3 front = ray * (sliceNear / -ray.z);
+                    glm::vec3 back = ray * (sliceFar / -ray.z);
+                    boxMin = glm::min(boxMin, glm::min(front, back));
+                    boxMax = glm::max(boxMax, glm::max(front, back));
+                }
+
+                int cluster = (slice * ClusterTilesY + y) * ClusterTilesX + x;
+                minX[cluster] = boxMin.x;
+                minY[cluster] = boxMin.y;
+                minZ[cluster] = boxMin.z;
+                maxX[cluster] = boxMax.x;
+                maxY[cluster] = boxMax.y;
+                maxZ[cluster] = boxMax.z;
+            }
+        }
+    }
+}
+
+int LightClusters::sliceOf(float depth) const
+{
+    int slice = (int)std::floor(std::log(std::max(depth, nearPlane)) * sliceScale + sliceBias);
+    return std::min(std::max(slice, 0), ClusterSlices - 1);
+}
+
+void LightClusters::bin(const std::vector<PointLight>& lights, const glm::mat4& view, ClusterBinStats& stats)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    stats = ClusterBinStats();
+    pairClusters.clear();
+    pairLights.clear();
+
+    for (uint32_t light = 0; light < (uint32_t)lights.size(); ++light) {
+        glm::vec3 centre = glm::vec3(view * glm::vec4(lights[light].position, 1.0f));
+        float radius = lights[light].radius;
+        float depth = -centre.z;
+        if (depth + radius < nearPlane || depth - radius > farPlane) {
+            continue;
+        }
+        ++stats.lightsInView;
+
+        //only the slices the sphere's depth range covers, every tile of them is tested
+        int firstSlice = sliceOf(depth - radius);
+        int lastSlice = sliceOf(depth + radius);
+        float radiusSquared = radius * radius;
+
+        for (int slice = firstSlice; slice <= lastSlice; ++slice) {
+            int sliceStart = slice * TilesPerSlice;
+#ifdef LIGHTING_SSE
+            //squared distance from the centre to each box, 0 on the axes the centre is inside
+            const __m128 zero = _mm_setzero_ps();
+            __m128 cx = _mm_set1_ps(centre.x), cy = _mm_set1_ps(centre.y), cz = _mm_set1_ps(centre.z);
+            __m128 r2 = _mm_set1_ps(radiusSquared);
+            for (int i = 0; i < TilesPerSlice; i += 4) {
+                int cluster = sliceStart + i;
+                __m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minX[cluster]), cx), zero),
+                    _mm_max_ps(_mm_sub_ps(cx, _mm_loadu_ps(&maxX[cluster])), zero));
+                __m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minY[cluster]), cy), zero),
+                    _mm_max_ps(_mm_sub_ps(cy, _mm_loadu_ps(&maxY[cluster])), zero));
+                __m128 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minZ[cluster]), cz), zero),
+                    _mm_max_ps(_mm_sub_ps(cz, _mm_loadu_ps(&maxZ[cluster])), zero));
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                int hits = _mm_movemask_ps(_mm_cmple_ps(distance, r2));
+                while (hits) {
+                    int lane = 0;
+                    while (!(hits & (1 << lane))) {
+                        ++lane;
+                    }
+                    hits &= ~(1 << lane);
+                    pairClusters.push_back((uint32_t)(cluster + lane));
+                    pairLights.push_back(light);
+                }
+            }
+#else
+            for (int i = 0; i < TilesPerSlice; ++i) {
+                int cluster = sliceStart + i;
+                float dx = std::max(minX[cluster] - centre.x, 0.0f) + std::max(centre.x - maxX[cluster], 0.0f);
+                float dy = std::max(minY[cluster] - centre.y, 0.0f) + std::max(centre.y - maxY[cluster], 0.0f);
+                float dz = std::max(minZ[cluster] - centre.z, 0.0f) + std::max(centre.z - maxZ[cluster], 0.0f);
+                if (dx * dx + dy * dy + dz * dz <= radiusSquared) {
+                    pairClusters.push_back((uint32_t)cluster);
+                    pairLights.push_back(light);
+                }
+            }
+#endif
+        }
+    }
+
+    //counting sort by cluster, lights stay in order inside each cell
+    cells.assign(ClusterCount * 2, 0);
+    for (uint32_t cluster : pairClusters) {
+        ++cells[cluster * 2 + 1];
+    }
+    uint32_t offset = 0;
+    for (int cluster = 0; cluster < ClusterCount; ++cluster) {
+        cells[cluster * 2] = offset;
+        offset += cells[cluster * 2 + 1];
+    }
+    //the offset field is used as the write cursor, then wound back to the start of its cell
+    indices.resize(pairClusters.size());
+    for (size_t i = 0; i < pairClusters.size(); ++i) {
+        indices[cells[pairClusters[i] * 2]++] = pairLights[i];
+    }
+    for (int cluster = 0; cluster < ClusterCount; ++cluster) {
+        cells[cluster * 2] -= cells[cluster * 2 + 1];
+    }
+
+    stats.lightReferences = (int)indices.size();
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    stats.binMicroseconds = elapsed.count();
+}
+
+void packPointLights(const std::vector<PointLight>& lights, std::vector<glm::vec4>& texels)
+{
+    texels.resize(lights.size() * 2);
+    for (size_t i = 0; i < lights.size(); ++i) {
+        texels[i * 2] = glm::vec4(lights[i].position, lights[i].radius);
+        texels[i * 2 + 1] = glm::vec4(lights[i].color * lights[i].intensity, 0.0f);
+    }
+}
+
+void ClusterLightBuffers::create()
+{
+    const GLenum formats[BufferCount] = { GL_RG32UI, GL_R32UI, GL_RGBA32F };
+    //every cell is written every frame, so those buffers start at their final size
+    const GLsizeiptr initialSizes[BufferCount] = { ClusterCount * 2 * sizeof(uint32_t), 16, 16 };
+    for (int r = 0; r < RegionCount; ++r) {
+        for (int i = 0; i < BufferCount; ++i) {
+            if (i == Lights && r > 0) {
+                continue;
+            }
+            //never left empty, a buffer texture over a zero sized buffer is incomplete
+            glGenBuffers(1, &buffers[r][i]);
+            glGenTextures(1, &textures[r][i]);
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[r][i]);
+            glBufferData(GL_TEXTURE_BUFFER, initialSizes[i], nullptr, GL_STREAM_DRAW);
+            capacity[r][i] = initialSizes[i];
+            glBindTexture(GL_TEXTURE_BUFFER, textures[r][i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[r][i]);
+        }
+    }
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    region = 0;
+}
+
+void ClusterLightBuffers::destroy()
+{
+    for (int r = 0; r < RegionCount; ++r) {
+        if (fences[r]) {
+            glDeleteSync(fences[r]);
+            fences[r] = nullptr;
+        }
+        glDeleteTextures(BufferCount, textures[r]);
+        glDeleteBuffers(BufferCount, buffers[r]);
+        for (int i = 0; i < BufferCount; ++i) {
+            textures[r][i] = 0;
+            buffers[r][i] = 0;
+            capacity[r][i] = 0;
+        }
+    }
+}
+
+void ClusterLightBuffers::uploadLights(const std::vector<glm::vec4>& texels)
+{
+    GLsizeiptr size = (GLsizeiptr)(texels.size() * sizeof(glm::vec4));
+    glBindBuffer(GL_TEXTURE_BUFFER, buffers[0][Lights]);
+    glBufferData(GL_TEXTURE_BUFFER, std::max<GLsizeiptr>(size, 16), nullptr, GL_STATIC_DRAW);
+    if (size > 0) {
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, size, texels.data());
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void ClusterLightBuffers::uploadCluster(int which, const void* data, GLsizeiptr size)
+{
+    glBindBuffer(GL_TEXTURE_BUFFER, buffers[region][which]);
+    if (size > capacity[region][which]) {
+        //the buffer texture follows the buffer's new storage, half as much again so growth stays rare
+        capacity[region][which] = std::max(size, capacity[region][which] + capacity[region][which] / 2);
+        glBufferData(GL_TEXTURE_BUFFER, capacity[region][which], nullptr, GL_STREAM_DRAW);
+    }
+    if (size > 0) {
+        //the fence already guarantees the gpu is done with this set, so skip the driver's own sync
+        void* range = glMapBufferRange(GL_TEXTURE_BUFFER, 0, size,
+            GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+        if (range) {
+            std::memcpy(range, data, size);
+            glUnmapBuffer(GL_TEXTURE_BUFFER);
+        }
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void ClusterLightBuffers::uploadClusters(const std::vector<uint32_t>& cellRanges, const std::vector<uint32_t>& lightIndices)
+{
+    region = (region + 1) % RegionCount;
+    //only blocks if the gpu is a full three frames behind
+    if (fences[region]) {
+        while (glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {
+        }
+        glDeleteSync(fences[region]);
+        fences[region] = nullptr;
+    }
+
+    uploadCluster(Cells, cellRanges.data(), (GLsizeiptr)(cellRanges.size() * sizeof(uint32_t)));
+    uploadCluster(Indices, lightIndices.data(), (GLsizeiptr)(lightIndices.size() * sizeof(uint32_t)));
+}
+
+void ClusterLightBuffers::endFrame()
+{
+    if (fences[region]) {
+        glDeleteSync(fences[region]);
+    }
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+int ClusterLightBuffers::bind() const
+{
+    const GLint units[BufferCount] = { ClusterCellsUnit, ClusterIndicesUnit, ClusterLightsUnit };
+    const GLuint bound[BufferCount] = { textures[region][Cells], textures[region][Indices], textures[0][Lights] };
+    for (int i = 0; i < BufferCount; ++i) {
+        glActiveTexture(GL_TEXTURE0 + units[i]);
+        glBindTexture(GL_TEXTURE_BUFFER, bound[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    return BufferCount;
+}
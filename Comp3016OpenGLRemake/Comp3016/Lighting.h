@@ -0,0 +1,108 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+//point light with a hard range, e.g. a grow lamp over a podium
+struct PointLight {
+    glm::vec3 position = glm::vec3(0.0f);
+    float radius = 1.0f;
+    glm::vec3 color = glm::vec3(1.0f);
+    float intensity = 1.0f;
+};
+
+//froxel grid the view frustum is split into: screen tiles times exponential depth slices
+const int ClusterTilesX = 16;
+const int ClusterTilesY = 9;
+const int ClusterSlices = 24;
+const int ClusterCount = ClusterTilesX * ClusterTilesY * ClusterSlices;
+
+//texture units the LIGHTING shader variants read the cluster buffer textures from
+const GLint ClusterCellsUnit = 1;
+const GLint ClusterIndicesUnit = 2;
+const GLint ClusterLightsUnit = 3;
+
+//per frame binning counts
+struct ClusterBinStats {
+    //lights whose sphere reached the view frustum
+    int lightsInView = 0;
+    //light references written to the index list, one per (cluster, light) pair
+    int lightReferences = 0;
+    double binMicroseconds = 0.0;
+};
+
+//assigns point lights to the froxels their spheres touch, on the cpu
+//the result is a cell range (offset, count) per cluster into one flat list of light indices
+class LightClusters {
+public:
+    //rebuilds the view space box of every cluster, only does work when the projection changed
+    void setProjection(const glm::mat4& projection);
+    //bins every light for this view, 4 clusters per sphere/box test with SSE
+    void bin(const std::vector<PointLight>& lights, const glm::mat4& view, ClusterBinStats& stats);
+
+    //2 uints per cluster, index = (slice * ClusterTilesY + tileY) * ClusterTilesX + tileX
+    const std::vector<uint32_t>& cellRanges() const { return cells; }
+    const std::vector<uint32_t>& lightIndices() const { return indices; }
+
+    //x = slice scale, y = slice bias: slice = floor(log(viewDepth) * x + y)
+    glm::vec4 sliceParams() const { return glm::vec4(sliceScale, sliceBias, nearPlane, farPlane); }
+
+private:
+    //which slice a view depth falls in, clamped to the grid
+    int sliceOf(float depth) const;
+
+    glm::mat4 projection = glm::mat4(0.0f);
+    float nearPlane = 0.1f;
+    float farPlane = 100.0f;
+    float sliceScale = 0.0f;
+    float sliceBias = 0.0f;
+
+    //view space cluster boxes split by component so 4 clusters load into one register
+    std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+
+    std::vector<uint32_t> cells;
+    std::vector<uint32_t> indices;
+    //(cluster, light) pairs in light order, counting sorted by cluster into indices
+    std::vector<uint32_t> pairClusters;
+    std::vector<uint32_t> pairLights;
+};
+
+//the light data as the shader reads it: (position, radius) then (colour * intensity, 0) per light
+void packPointLights(const std::vector<PointLight>& lights, std::vector<glm::vec4>& texels);
+
+//buffer textures holding the cluster cells, light index list and light data for the shader
+//cells + indices rotate through one set of buffers per frame in flight, fenced like StreamBuffer's regions,
+//so a frame writes into storage the gpu is done with and nothing is reallocated unless the data outgrows it
+//(each set needs its own buffer textures, glTexBufferRange isn't core until 4.3)
+class ClusterLightBuffers {
+public:
+    void create();
+    void destroy();
+
+    //light data changes rarely, only call when the lights move, the buffer is reallocated to fit
+    void uploadLights(const std::vector<glm::vec4>& texels);
+    //cells + indices are rebuilt every frame, moves to the next set waiting for the gpu if it is still reading it
+    void uploadClusters(const std::vector<uint32_t>& cellRanges, const std::vector<uint32_t>& lightIndices);
+    //fences the set just uploaded, once the frame's draws that read it are issued
+    void endFrame();
+
+    //binds the three buffer textures to their units and leaves texture unit 0 active, returns how many it bound
+    int bind() const;
+
+private:
+    enum { Cells, Indices, Lights, BufferCount };
+    static const int RegionCount = 3;
+
+    //writes into a cluster buffer of the current set, growing it first if the data doesn't fit
+    void uploadCluster(int which, const void* data, GLsizeiptr size);
+
+    //[region][Cells or Indices], Lights only has the one buffer in region 0
+    GLuint buffers[RegionCount][BufferCount] = {};
+    GLuint textures[RegionCount][BufferCount] = {};
+    GLsizeiptr capacity[RegionCount][BufferCount] = {};
+    GLsync fences[RegionCount] = {};
+    int region = 0;
+};
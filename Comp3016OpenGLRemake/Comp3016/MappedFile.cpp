@@ -0,0 +1,180 @@
+#include "MappedFile.h"
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other)
+{
+    moveFrom(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other)
+{
+    if (this != &other) {
+        close();
+        moveFrom(other);
+    }
+    return *this;
+}
+
+void MappedFile::moveFrom(MappedFile& other)
+{
+    bytes = other.bytes;
+    length = other.length;
+    other.bytes = nullptr;
+    other.length = 0;
+#ifdef _WIN32
+    fileHandle = other.fileHandle;
+    mappingHandle = other.mappingHandle;
+    other.fileHandle = nullptr;
+    other.mappingHandle = nullptr;
+#else
+    fileDescriptor = other.fileDescriptor;
+    other.fileDescriptor = -1;
+#endif
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path)
+{
+    close();
+
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    fileHandle = file;
+    mappingHandle = mapping;
+    bytes = static_cast<const unsigned char*>(view);
+    length = (size_t)fileSize.QuadPart;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (bytes) {
+        UnmapViewOfFile(bytes);
+    }
+    if (mappingHandle) {
+        CloseHandle(mappingHandle);
+    }
+    if (fileHandle) {
+        CloseHandle(fileHandle);
+    }
+    bytes = nullptr;
+    length = 0;
+    fileHandle = nullptr;
+    mappingHandle = nullptr;
+}
+
+long long fileModifiedTime(const std::string& path)
+{
+    struct _stat64 info;
+    if (_stat64(path.c_str(), &info) != 0) {
+        return -1;
+    }
+    return (long long)info.st_mtime;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path)
+{
+    close();
+
+    int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0) {
+        ::close(file);
+        return false;
+    }
+
+    void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (view == MAP_FAILED) {
+        ::close(file);
+        return false;
+    }
+
+    fileDescriptor = file;
+    bytes = static_cast<const unsigned char*>(view);
+    length = (size_t)info.st_size;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (bytes) {
+        munmap(const_cast<unsigned char*>(bytes), length);
+    }
+    if (fileDescriptor >= 0) {
+        ::close(fileDescriptor);
+    }
+    bytes = nullptr;
+    length = 0;
+    fileDescriptor = -1;
+}
+
+long long fileModifiedTime(const std::string& path)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        return -1;
+    }
+    return (long long)info.st_mtime;
+}
+
+#endif
+
+uint64_t hashPath(const std::string& path)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : path) {
+        hash = (hash ^ (unsigned char)c) * 1099511628211ull;
+    }
+    return hash;
+}
+
+bool rangeFits(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t size)
+{
+    return offset <= size && count <= (size - offset) / elementSize;
+}
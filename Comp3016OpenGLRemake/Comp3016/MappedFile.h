@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+//read only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other);
+    MappedFile& operator=(MappedFile&& other);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    //maps the file, returns false if it is missing or empty
+    bool open(const std::string& path);
+    void close();
+
+    bool isOpen() const { return bytes != nullptr; }
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    void moveFrom(MappedFile& other);
+
+    const unsigned char* bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#else
+    int fileDescriptor = -1;
+#endif
+};
+
+//last write time of a file in seconds, -1 if it does not exist
+long long fileModifiedTime(const std::string& path);
+
+//FNV-1a 64 bit, keys a cache file to the path (or source text) it was built from
+uint64_t hashPath(const std::string& path);
+
+//true if count elements of elementSize bytes starting at offset fit in size bytes, written so a corrupt count or offset can't wrap
+bool rangeFits(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t size);
@@ -0,0 +1,316 @@
+#include "MeshCache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+//file layout, all little endian:
+//  MeshCacheHeader
+//  CachedSubmesh[submeshCount]
+//  vertices  (vertexCount * VertexStride floats, 16 byte aligned)
+//  indices   (indexCount of indexType, 16 byte aligned, every submesh's lod ranges included)
+//  materials (u32 length + chars, repeated materialCount times)
+struct MeshCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t importFlags;
+    uint32_t indexType;
+    uint64_t sourcePathHash;
+    int64_t sourceModified;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t submeshCount;
+    uint32_t materialCount;
+    float boundsMin[3];
+    float boundsMax[3];
+    uint64_t submeshOffset;
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint64_t materialOffset;
+};
+
+struct CachedLod {
+    uint32_t indexOffset;
+    uint32_t indexCount;
+    float error;
+};
+
+struct CachedSubmesh {
+    uint32_t indexOffset;
+    uint32_t indexCount;
+    int32_t baseVertex;
+    uint32_t vertexCount;
+    uint32_t materialIndex;
+    float boundsMin[3];
+    float boundsMax[3];
+    uint32_t lodCount;
+    CachedLod lods[MaxMeshLods];
+};
+
+static const char MeshCacheMagic[4] = { 'M', 'S', 'H', 'C' };
+
+static uint64_t alignTo16(uint64_t offset)
+{
+    return (offset + 15) & ~uint64_t(15);
+}
+
+std::string meshCachePath(const std::string& sourcePath)
+{
+    return sourcePath + ".meshcache";
+}
+
+//true if every index in the range is under limit, the range has already been checked against the index data
+static bool indicesBelow(const unsigned char* indices, uint32_t indexType, uint32_t first, uint32_t count, uint32_t limit)
+{
+    if (indexType == GL_UNSIGNED_SHORT) {
+        for (uint32_t i = first; i < first + count; ++i) {
+            GLushort index;
+            std::memcpy(&index, indices + i * sizeof(GLushort), sizeof(index));
+            if (index >= limit) {
+                return false;
+            }
+        }
+        return true;
+    }
+    for (uint32_t i = first; i < first + count; ++i) {
+        GLuint index;
+        std::memcpy(&index, indices + i * sizeof(GLuint), sizeof(index));
+        if (index >= limit) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool loadMeshCache(const std::string& sourcePath, LoadedModel& model)
+{
+    long long sourceModified = fileModifiedTime(sourcePath);
+    if (sourceModified < 0) {
+        return false;
+    }
+
+    MappedFile file;
+    if (!file.open(meshCachePath(sourcePath)) || file.size() < sizeof(MeshCacheHeader)) {
+        return false;
+    }
+
+    //stale or foreign caches are ignored and rebuilt
+    MeshCacheHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, MeshCacheMagic, 4) != 0 ||
+        header.version != MeshCacheVersion ||
+        header.importFlags != ModelImportFlags ||
+        header.sourcePathHash != hashPath(sourcePath) ||
+        header.sourceModified != sourceModified) {
+        return false;
+    }
+    if (header.indexType != GL_UNSIGNED_SHORT && header.indexType != GL_UNSIGNED_INT) {
+        std::cerr << "Mesh cache " << meshCachePath(sourcePath) << " has a bad index type" << std::endl;
+        return false;
+    }
+
+    size_t indexSize = header.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    if (!rangeFits(header.submeshOffset, header.submeshCount, sizeof(CachedSubmesh), file.size()) ||
+        !rangeFits(header.vertexOffset, header.vertexCount, VertexStride * sizeof(GLfloat), file.size()) ||
+        !rangeFits(header.indexOffset, header.indexCount, indexSize, file.size()) ||
+        header.materialOffset > file.size()) {
+        std::cerr << "Mesh cache " << meshCachePath(sourcePath) << " is truncated" << std::endl;
+        return false;
+    }
+
+    //submesh table is tiny, copy it out
+    const unsigned char* indices = file.data() + header.indexOffset;
+    model.submeshes.resize(header.submeshCount);
+    for (uint32_t i = 0; i < header.submeshCount; ++i) {
+        CachedSubmesh cached;
+        std::memcpy(&cached, file.data() + header.submeshOffset + i * sizeof(CachedSubmesh), sizeof(cached));
+
+        //the ranges have to fit the buffers, the index values are checked against the submesh below
+        if ((uint64_t)cached.indexOffset + cached.indexCount > header.indexCount ||
+            cached.baseVertex < 0 ||
+            (uint64_t)cached.baseVertex + cached.vertexCount > header.vertexCount) {
+            std::cerr << "Mesh cache " << meshCachePath(sourcePath) << " has a bad submesh range" << std::endl;
+            return false;
+        }
+
+        Submesh& submesh = model.submeshes[i];
+        submesh.indexOffset = cached.indexOffset;
+        submesh.indexCount = (GLsizei)cached.indexCount;
+        submesh.baseVertex = cached.baseVertex;
+        submesh.vertexCount = (GLsizei)cached.vertexCount;
+        submesh.materialIndex = cached.materialIndex;
+        submesh.boundsMin = glm::vec3(cached.boundsMin[0], cached.boundsMin[1], cached.boundsMin[2]);
+        submesh.boundsMax = glm::vec3(cached.boundsMax[0], cached.boundsMax[1], cached.boundsMax[2]);
+
+        if (cached.lodCount < 1 || cached.lodCount > (uint32_t)MaxMeshLods) {
+            std::cerr << "Mesh cache " << meshCachePath(sourcePath) << " has a bad lod count" << std::endl;
+            return false;
+        }
+        submesh.lodCount = cached.lodCount;
+        for (uint32_t level = 0; level < cached.lodCount; ++level) {
+            if ((uint64_t)cached.lods[level].indexOffset + cached.lods[level].indexCount > header.indexCount) {
+                std::cerr << "Mesh cache " << meshCachePath(sourcePath) << " has a bad lod range" << std::endl;
+                return false;
+            }
+            //draws and the collision build add the base vertex to these without checking them
+            if (!indicesBelow(indices, header.indexType, cached.lods[level].indexOffset, cached.lods[level].indexCount, cached.vertexCount)) {
+                std::cerr << "Mesh cache " << meshCachePath(sourcePath) << " has an index past its submesh's vertices" << std::endl;
+                return false;
+            }
+            submesh.lods[level].indexOffset = cached.lods[level].indexOffset;
+            submesh.lods[level].indexCount = (GLsizei)cached.lods[level].indexCount;
+            submesh.lods[level].error = cached.lods[level].error;
+        }
+        //the full detail range is normally lod 0's, only scanned again when it isn't
+        if ((cached.lods[0].indexOffset != cached.indexOffset || cached.lods[0].indexCount != cached.indexCount) &&
+            !indicesBelow(indices, header.indexType, cached.indexOffset, cached.indexCount, cached.vertexCount)) {
+            std::cerr << "Mesh cache " << meshCachePath(sourcePath) << " has an index past its submesh's vertices" << std::endl;
+            return false;
+        }
+    }
+
+    const unsigned char* cursor = file.data() + header.materialOffset;
+    const unsigned char* end = file.data() + file.size();
+    model.materialNames.clear();
+    for (uint32_t i = 0; i < header.materialCount; ++i) {
+        uint32_t length;
+        if (cursor + sizeof(length) > end) {
+            return false;
+        }
+        std::memcpy(&length, cursor, sizeof(length));
+        cursor += sizeof(length);
+        if (cursor + length > end) {
+            return false;
+        }
+        model.materialNames.push_back(std::string((const char*)cursor, length));
+        cursor += length;
+    }
+
+    model.boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+    model.boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+
+    //vertex + index blobs are used in place, they go straight from the mapping to glBufferData
+    model.view.vertices = reinterpret_cast<const GLfloat*>(file.data() + header.vertexOffset);
+    model.view.vertexCount = (GLsizei)header.vertexCount;
+    model.view.indices = file.data() + header.indexOffset;
+    model.view.indexType = header.indexType;
+    model.view.indexCount = (GLsizei)header.indexCount;
+    model.view.submeshes = model.submeshes.data();
+    model.view.submeshCount = model.submeshes.size();
+
+    model.mapping = std::move(file);
+    model.fromCache = true;
+    return true;
+}
+
+bool writeMeshCache(const std::string& sourcePath, const MeshData& mesh)
+{
+    long long sourceModified = fileModifiedTime(sourcePath);
+    if (sourceModified < 0) {
+        return false;
+    }
+
+    MeshView view = meshView(mesh);
+    size_t indexSize = view.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+    MeshCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MeshCacheMagic, 4);
+    header.version = MeshCacheVersion;
+    header.importFlags = ModelImportFlags;
+    header.indexType = view.indexType;
+    header.sourcePathHash = hashPath(sourcePath);
+    header.sourceModified = sourceModified;
+    header.vertexCount = (uint32_t)view.vertexCount;
+    header.indexCount = (uint32_t)view.indexCount;
+    header.submeshCount = (uint32_t)view.submeshCount;
+    header.materialCount = (uint32_t)mesh.materialNames.size();
+    for (int axis = 0; axis < 3; ++axis) {
+        header.boundsMin[axis] = mesh.boundsMin[axis];
+        header.boundsMax[axis] = mesh.boundsMax[axis];
+    }
+    header.submeshOffset = sizeof(MeshCacheHeader);
+    header.vertexOffset = alignTo16(header.submeshOffset + header.submeshCount * sizeof(CachedSubmesh));
+    header.indexOffset = alignTo16(header.vertexOffset + (uint64_t)header.vertexCount * VertexStride * sizeof(GLfloat));
+    header.materialOffset = header.indexOffset + (uint64_t)header.indexCount * indexSize;
+
+    std::vector<unsigned char> bytes((size_t)header.materialOffset, 0);
+    std::memcpy(bytes.data(), &header, sizeof(header));
+
+    for (size_t i = 0; i < view.submeshCount; ++i) {
+        const Submesh& submesh = view.submeshes[i];
+        CachedSubmesh cached;
+        std::memset(&cached, 0, sizeof(cached));
+        cached.indexOffset = submesh.indexOffset;
+        cached.indexCount = (uint32_t)submesh.indexCount;
+        cached.baseVertex = submesh.baseVertex;
+        cached.vertexCount = (uint32_t)submesh.vertexCount;
+        cached.materialIndex = submesh.materialIndex;
+        for (int axis = 0; axis < 3; ++axis) {
+            cached.boundsMin[axis] = submesh.boundsMin[axis];
+            cached.boundsMax[axis] = submesh.boundsMax[axis];
+        }
+        cached.lodCount = submesh.lodCount;
+        for (GLuint level = 0; level < submesh.lodCount; ++level) {
+            cached.lods[level].indexOffset = submesh.lods[level].indexOffset;
+            cached.lods[level].indexCount = (uint32_t)submesh.lods[level].indexCount;
+            cached.lods[level].error = submesh.lods[level].error;
+        }
+        std::memcpy(bytes.data() + header.submeshOffset + i * sizeof(CachedSubmesh), &cached, sizeof(cached));
+    }
+
+    std::memcpy(bytes.data() + header.vertexOffset, view.vertices, (size_t)header.vertexCount * VertexStride * sizeof(GLfloat));
+    std::memcpy(bytes.data() + header.indexOffset, view.indices, (size_t)header.indexCount * indexSize);
+
+    for (const std::string& name : mesh.materialNames) {
+        uint32_t length = (uint32_t)name.size();
+        const unsigned char* lengthBytes = reinterpret_cast<const unsigned char*>(&length);
+        bytes.insert(bytes.end(), lengthBytes, lengthBytes + sizeof(length));
+        bytes.insert(bytes.end(), name.begin(), name.end());
+    }
+
+    //write to a temp file first so a crash never leaves a half written cache behind
+    std::string cachePath = meshCachePath(sourcePath);
+    std::string tempPath = cachePath + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "Could not write mesh cache " << cachePath << std::endl;
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        if (!out) {
+            std::cerr << "Could not write mesh cache " << cachePath << std::endl;
+            return false;
+        }
+    }
+    std::remove(cachePath.c_str());
+    if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool loadModelCached(const std::string& sourcePath, LoadedModel& model)
+{
+    if (loadMeshCache(sourcePath, model)) {
+        std::cout << "Loading Asset " << sourcePath.c_str() << " from cache\n";
+        return true;
+    }
+
+    if (!loadModel(sourcePath, model.parsed)) {
+        return false;
+    }
+    writeMeshCache(sourcePath, model.parsed);
+
+    model.submeshes = model.parsed.submeshes;
+    model.materialNames = model.parsed.materialNames;
+    model.boundsMin = model.parsed.boundsMin;
+    model.boundsMax = model.parsed.boundsMax;
+    model.view = meshView(model.parsed);
+    model.fromCache = false;
+    return true;
+}
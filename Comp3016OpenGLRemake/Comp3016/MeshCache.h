@@ -0,0 +1,37 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "ModelLoader.h"
+
+#include <string>
+#include <vector>
+
+//bump whenever the cache layout or the mesh build changes
+const unsigned int MeshCacheVersion = 3;
+
+//cpu side model, either parsed by assimp or mapped straight from its cache file
+struct LoadedModel {
+    //filled when the model came from assimp
+    MeshData parsed;
+    //open when the model came from the cache, view points into it
+    MappedFile mapping;
+    std::vector<Submesh> submeshes;
+    std::vector<std::string> materialNames;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+
+    //what gets uploaded
+    MeshView view;
+    bool fromCache = false;
+};
+
+//cache file stored next to the source asset
+std::string meshCachePath(const std::string& sourcePath);
+
+//maps the cache if it matches the source path, modified time, import flags and version
+bool loadMeshCache(const std::string& sourcePath, LoadedModel& model);
+//writes the already interleaved vertex/index data, bounds and material table
+bool writeMeshCache(const std::string& sourcePath, const MeshData& mesh);
+
+//uses a fresh cache when there is one, otherwise imports with assimp and rewrites the cache
+bool loadModelCached(const std::string& sourcePath, LoadedModel& model);
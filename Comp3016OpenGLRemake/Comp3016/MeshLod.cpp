@@ -0,0 +1,363 @@
+#include "MeshLod.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+//symmetric 4x4 error quadric, sum of squared distances to a set of planes
+struct Quadric {
+    double a2 = 0, ab = 0, ac = 0, ad = 0;
+    double b2 = 0, bc = 0, bd = 0;
+    double c2 = 0, cd = 0;
+    double d2 = 0;
+
+    void addPlane(const glm::dvec3& normal, double distance)
+    {
+        a2 += normal.x * normal.x; ab += normal.x * normal.y; ac += normal.x * normal.z; ad += normal.x * distance;
+        b2 += normal.y * normal.y; bc += normal.y * normal.z; bd += normal.y * distance;
+        c2 += normal.z * normal.z; cd += normal.z * distance;
+        d2 += distance * distance;
+    }
+
+    void add(const Quadric& other)
+    {
+        a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+        b2 += other.b2; bc += other.bc; bd += other.bd;
+        c2 += other.c2; cd += other.cd;
+        d2 += other.d2;
+    }
+
+    double evaluate(const glm::dvec3& p) const
+    {
+        double error = a2 * p.x * p.x + 2 * ab * p.x * p.y + 2 * ac * p.x * p.z + 2 * ad * p.x
+            + b2 * p.y * p.y + 2 * bc * p.y * p.z + 2 * bd * p.y
+            + c2 * p.z * p.z + 2 * cd * p.z
+            + d2;
+        return std::max(error, 0.0);
+    }
+};
+
+//moving vertex from onto vertex to, both are position ids
+struct Collapse {
+    double cost;
+    uint32_t from;
+    uint32_t to;
+    uint32_t fromVersion;
+    uint32_t toVersion;
+
+    bool operator>(const Collapse& other) const { return cost > other.cost; }
+};
+
+static glm::dvec3 vertexPosition(const GLfloat* vertices, GLuint vertex)
+{
+    const GLfloat* v = vertices + (size_t)vertex * VertexStride;
+    return glm::dvec3(v[0], v[1], v[2]);
+}
+
+//how far apart two vertices' normals + uvs are, picks which seam vertex a collapsed one turns into
+static float attributeDistance(const GLfloat* vertices, GLuint a, GLuint b)
+{
+    const GLfloat* va = vertices + (size_t)a * VertexStride;
+    const GLfloat* vb = vertices + (size_t)b * VertexStride;
+    float distance = 0.0f;
+    for (int i = 3; i < VertexStride; ++i) {
+        distance += (va[i] - vb[i]) * (va[i] - vb[i]);
+    }
+    return distance;
+}
+
+float simplifyTriangles(const GLfloat* vertices, GLsizei vertexCount, const GLuint* indices, size_t indexCount,
+    size_t targetIndexCount, std::vector<GLuint>& simplified)
+{
+    //weld by position: the seams split vertices by uv/normal but the surface is one piece
+    std::vector<uint32_t> positionOf(vertexCount);
+    std::vector<std::vector<GLuint>> vertsAt;
+    {
+        std::unordered_map<std::string, uint32_t> positions;
+        positions.reserve(vertexCount);
+        for (GLsizei v = 0; v < vertexCount; ++v) {
+            std::string key((const char*)(vertices + (size_t)v * VertexStride), 3 * sizeof(GLfloat));
+            auto inserted = positions.emplace(key, (uint32_t)vertsAt.size());
+            if (inserted.second) {
+                vertsAt.emplace_back();
+            }
+            positionOf[v] = inserted.first->second;
+            vertsAt[inserted.first->second].push_back((GLuint)v);
+        }
+    }
+    size_t positionCount = vertsAt.size();
+
+    //triangles keep their real vertex ids, everything topological goes through positionOf
+    std::vector<GLuint> triangles;
+    triangles.reserve(indexCount);
+    for (size_t i = 0; i + 2 < indexCount; i += 3) {
+        uint32_t p0 = positionOf[indices[i]], p1 = positionOf[indices[i + 1]], p2 = positionOf[indices[i + 2]];
+        if (p0 != p1 && p1 != p2 && p0 != p2) {
+            triangles.insert(triangles.end(), indices + i, indices + i + 3);
+        }
+    }
+    size_t triangleCount = triangles.size() / 3;
+    std::vector<bool> triangleDead(triangleCount, false);
+    std::vector<std::vector<uint32_t>> trianglesAt(positionCount);
+
+    //plane of every triangle on its corners, open borders also get a plane standing on the edge so they hold their shape
+    std::vector<Quadric> quadrics(positionCount);
+    std::unordered_map<uint64_t, int> edgeUses;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        uint32_t p[3];
+        glm::dvec3 corner[3];
+        for (int k = 0; k < 3; ++k) {
+            p[k] = positionOf[triangles[t * 3 + k]];
+            corner[k] = vertexPosition(vertices, triangles[t * 3 + k]);
+            trianglesAt[p[k]].push_back((uint32_t)t);
+        }
+        glm::dvec3 normal = glm::cross(corner[1] - corner[0], corner[2] - corner[0]);
+        double length = glm::length(normal);
+        if (length > 0.0) {
+            normal /= length;
+            Quadric plane;
+            plane.addPlane(normal, -glm::dot(normal, corner[0]));
+            for (int k = 0; k < 3; ++k) {
+                quadrics[p[k]].add(plane);
+            }
+        }
+        for (int k = 0; k < 3; ++k) {
+            uint32_t a = std::min(p[k], p[(k + 1) % 3]), b = std::max(p[k], p[(k + 1) % 3]);
+            ++edgeUses[((uint64_t)a << 32) | b];
+        }
+    }
+    for (size_t t = 0; t < triangleCount; ++t) {
+        glm::dvec3 corner[3];
+        for (int k = 0; k < 3; ++k) {
+            corner[k] = vertexPosition(vertices, triangles[t * 3 + k]);
+        }
+        glm::dvec3 faceNormal = glm::cross(corner[1] - corner[0], corner[2] - corner[0]);
+        for (int k = 0; k < 3; ++k) {
+            uint32_t pa = positionOf[triangles[t * 3 + k]], pb = positionOf[triangles[t * 3 + (k + 1) % 3]];
+            uint64_t key = ((uint64_t)std::min(pa, pb) << 32) | std::max(pa, pb);
+            if (edgeUses[key] != 1) {
+                continue;
+            }
+            glm::dvec3 edgeNormal = glm::cross(corner[(k + 1) % 3] - corner[k], faceNormal);
+            double length = glm::length(edgeNormal);
+            if (length > 0.0) {
+                edgeNormal /= length;
+                Quadric plane;
+                plane.addPlane(edgeNormal, -glm::dot(edgeNormal, corner[k]));
+                quadrics[pa].add(plane);
+                quadrics[pb].add(plane);
+            }
+        }
+    }
+
+    std::vector<bool> positionDead(positionCount, false);
+    std::vector<uint32_t> version(positionCount, 0);
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+    auto pushCollapse = [&](uint32_t from, uint32_t to) {
+        Quadric merged = quadrics[from];
+        merged.add(quadrics[to]);
+        Collapse collapse;
+        collapse.cost = merged.evaluate(vertexPosition(vertices, vertsAt[to][0]));
+        collapse.from = from;
+        collapse.to = to;
+        collapse.fromVersion = version[from];
+        collapse.toVersion = version[to];
+        queue.push(collapse);
+    };
+    for (size_t t = 0; t < triangleCount; ++t) {
+        for (int k = 0; k < 3; ++k) {
+            uint32_t a = positionOf[triangles[t * 3 + k]], b = positionOf[triangles[t * 3 + (k + 1) % 3]];
+            pushCollapse(a, b);
+            pushCollapse(b, a);
+        }
+    }
+
+    size_t liveTriangles = triangleCount;
+    double worstCost = 0.0;
+    //(vertex at from, vertex at to it becomes) for the collapse being made
+    std::vector<std::pair<GLuint, GLuint>> replacement;
+    while (liveTriangles * 3 > targetIndexCount && !queue.empty()) {
+        Collapse collapse = queue.top();
+        queue.pop();
+        uint32_t from = collapse.from, to = collapse.to;
+        //either end moved since this was queued, a fresh entry was pushed then
+        if (positionDead[from] || positionDead[to] ||
+            collapse.fromVersion != version[from] || collapse.toVersion != version[to]) {
+            continue;
+        }
+
+        //the edge must still exist, and no triangle left around from may flip over
+        glm::dvec3 target = vertexPosition(vertices, vertsAt[to][0]);
+        bool connected = false, flips = false;
+        for (uint32_t t : trianglesAt[from]) {
+            if (triangleDead[t]) {
+                continue;
+            }
+            glm::dvec3 before[3], after[3];
+            bool hasTo = false;
+            for (int k = 0; k < 3; ++k) {
+                uint32_t p = positionOf[triangles[t * 3 + k]];
+                hasTo |= p == to;
+                before[k] = after[k] = vertexPosition(vertices, triangles[t * 3 + k]);
+                if (p == from) {
+                    after[k] = target;
+                }
+            }
+            if (hasTo) {
+                connected = true;
+                continue;
+            }
+            glm::dvec3 oldNormal = glm::cross(before[1] - before[0], before[2] - before[0]);
+            glm::dvec3 newNormal = glm::cross(after[1] - after[0], after[2] - after[0]);
+            if (glm::dot(oldNormal, newNormal) <= 0.0) {
+                flips = true;
+                break;
+            }
+        }
+        if (!connected || flips) {
+            continue;
+        }
+
+        //every vertex at from becomes the vertex at to with the closest normal + uv
+        replacement.clear();
+        for (GLuint v : vertsAt[from]) {
+            GLuint best = vertsAt[to][0];
+            float bestDistance = attributeDistance(vertices, v, best);
+            for (GLuint candidate : vertsAt[to]) {
+                float distance = attributeDistance(vertices, v, candidate);
+                if (distance < bestDistance) {
+                    best = candidate;
+                    bestDistance = distance;
+                }
+            }
+            replacement.push_back(std::make_pair(v, best));
+        }
+
+        for (uint32_t t : trianglesAt[from]) {
+            if (triangleDead[t]) {
+                continue;
+            }
+            bool hasTo = false;
+            for (int k = 0; k < 3; ++k) {
+                hasTo |= positionOf[triangles[t * 3 + k]] == to;
+            }
+            if (hasTo) {
+                triangleDead[t] = true;
+                --liveTriangles;
+                continue;
+            }
+            for (int k = 0; k < 3; ++k) {
+                for (const std::pair<GLuint, GLuint>& swap : replacement) {
+                    if (triangles[t * 3 + k] == swap.first) {
+                        triangles[t * 3 + k] = swap.second;
+                        break;
+                    }
+                }
+            }
+            trianglesAt[to].push_back(t);
+        }
+
+        quadrics[to].add(quadrics[from]);
+        positionDead[from] = true;
+        ++version[to];
+        worstCost = std::max(worstCost, collapse.cost);
+
+        //drop dead + duplicate entries, then requeue every edge around the merged vertex
+        std::vector<uint32_t>& around = trianglesAt[to];
+        around.erase(std::remove_if(around.begin(), around.end(), [&](uint32_t t) { return triangleDead[t]; }), around.end());
+        std::sort(around.begin(), around.end());
+        around.erase(std::unique(around.begin(), around.end()), around.end());
+        for (uint32_t t : around) {
+            for (int k = 0; k < 3; ++k) {
+                uint32_t p = positionOf[triangles[t * 3 + k]];
+                if (p != to) {
+                    pushCollapse(p, to);
+                    pushCollapse(to, p);
+                }
+            }
+        }
+        trianglesAt[from].clear();
+    }
+
+    simplified.clear();
+    simplified.reserve(liveTriangles * 3);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        if (!triangleDead[t]) {
+            simplified.insert(simplified.end(), triangles.begin() + t * 3, triangles.begin() + t * 3 + 3);
+        }
+    }
+    return (float)std::sqrt(worstCost);
+}
+
+void buildMeshLods(MeshData& mesh)
+{
+    std::vector<GLuint> current, next;
+    for (Submesh& submesh : mesh.submeshes) {
+        submesh.lods[0].indexOffset = submesh.indexOffset;
+        submesh.lods[0].indexCount = submesh.indexCount;
+        submesh.lods[0].error = 0.0f;
+        submesh.lodCount = 1;
+
+        current.assign(mesh.indices.begin() + submesh.indexOffset,
+            mesh.indices.begin() + submesh.indexOffset + submesh.indexCount);
+        const GLfloat* vertices = mesh.vertices.data() + (size_t)submesh.baseVertex * VertexStride;
+        float error = 0.0f;
+        while (submesh.lodCount < (GLuint)MaxMeshLods) {
+            size_t target = (size_t)(current.size() / 3 * LodReduction) * 3;
+            float levelError = simplifyTriangles(vertices, submesh.vertexCount, current.data(), current.size(), target, next);
+            //stuck on borders/flips, a level this close to the last one isn't worth its memory
+            if (next.empty() || next.size() > current.size() * 9 / 10) {
+                break;
+            }
+            //each level starts from the one before, so the errors stack up
+            error += levelError;
+
+            MeshLod& lod = submesh.lods[submesh.lodCount++];
+            lod.indexOffset = (GLuint)mesh.indices.size();
+            lod.indexCount = (GLsizei)next.size();
+            lod.error = error;
+            mesh.indices.insert(mesh.indices.end(), next.begin(), next.end());
+            current.swap(next);
+        }
+    }
+}
+
+int meshLodErrors(const Submesh* submeshes, size_t count, float errors[MaxMeshLods])
+{
+    int levels = 1;
+    for (size_t i = 0; i < count; ++i) {
+        levels = std::max(levels, (int)submeshes[i].lodCount);
+    }
+    //a submesh with fewer levels keeps drawing its last one
+    for (int level = 0; level < levels; ++level) {
+        errors[level] = 0.0f;
+        for (size_t i = 0; i < count; ++i) {
+            const Submesh& submesh = submeshes[i];
+            errors[level] = std::max(errors[level], submesh.lods[std::min(level, (int)submesh.lodCount - 1)].error);
+        }
+    }
+    return levels;
+}
+
+float lodPixelsPerUnit(const glm::mat4& projection, float viewportHeight, float modelScale, float distance)
+{
+    //projection[1][1] is 1 / tan(fov / 2), so one unit spans that many half viewports at distance 1
+    return projection[1][1] * viewportHeight * 0.5f * modelScale / std::max(distance, 1e-3f);
+}
+
+int selectLod(const float* errors, int levelCount, float pixelsPerUnit, float maxPixels, int current)
+{
+    int level = std::min(std::max(current, 0), levelCount - 1);
+    while (level > 0 && errors[level] * pixelsPerUnit > maxPixels) {
+        --level;
+    }
+    while (level + 1 < levelCount && errors[level + 1] * pixelsPerUnit <= maxPixels * (1.0f - LodHysteresis)) {
+        ++level;
+    }
+    return level;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "ModelLoader.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+//each level aims for this fraction of the triangles of the one before it
+const float LodReduction = 0.5f;
+//detail is dropped until a level's error would cover this many pixels on screen
+const float LodPixelError = 1.0f;
+//a coarser level is only taken once its error is this much under the limit, so levels don't flicker at the boundary
+const float LodHysteresis = 0.25f;
+
+//simplifies one submesh's triangles (submesh local indices) towards targetIndexCount by quadric error edge collapse
+//vertices sharing a position (uv seams) collapse together and every collapse lands on a vertex that already
+//exists, so all levels share the original vertex buffer; returns the error of the worst collapse in model units
+float simplifyTriangles(const GLfloat* vertices, GLsizei vertexCount, const GLuint* indices, size_t indexCount,
+    size_t targetIndexCount, std::vector<GLuint>& simplified);
+
+//appends up to MaxMeshLods - 1 coarser index lists per submesh to a freshly imported mesh
+//stops early once a submesh won't simplify any further, call before the 16 bit indices are packed
+void buildMeshLods(MeshData& mesh);
+
+//error of each level for the model as a whole (worst submesh), returns how many levels the model has
+int meshLodErrors(const Submesh* submeshes, size_t count, float errors[MaxMeshLods]);
+
+//screen pixels one model unit covers at distance in front of the camera
+float lodPixelsPerUnit(const glm::mat4& projection, float viewportHeight, float modelScale, float distance);
+
+//coarsest level whose error stays under maxPixels, starting from current so the hysteresis applies
+int selectLod(const float* errors, int levelCount, float pixelsPerUnit, float maxPixels, int current);
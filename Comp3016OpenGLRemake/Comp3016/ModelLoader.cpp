@@ -1,60 +1,265 @@
-//#include "modelloader.h"
-//#include <iostream>
-//#include <fstream>
-//
-//
-//ModelLoader::ModelLoader(const char* filePath) : filePath(filePath), bonsaiVAO(0), bonsaiVBO(0), bonsaiEBO(0) {}
-//
-//ModelLoader::~ModelLoader() {
-//    // You may want to add cleanup code here if needed
-//}
-//
-//bool ModelLoader::loadModel() {
-//    Assimp::Importer importer;
-//    const aiScene* scene = importer.ReadFile(filePath, aiProcess_Triangulate | aiProcess_FlipUVs);
-//
-//    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
-//        std::cerr << "Assimp error: " << importer.GetErrorString() << std::endl;
-//        return false;
-//    }
-//
-//    aiMesh* mesh = scene->mMeshes[0]; // Assuming there's only one mesh in the model
-//    std::vector<float> vertices;
-//    std::vector<unsigned int> indices;
-//
-//    for (unsigned int i = 0; i < mesh->mNumVertices; ++i) {
-//        vertices.push_back(mesh->mVertices[i].x);
-//        vertices.push_back(mesh->mVertices[i].y);
-//        vertices.push_back(mesh->mVertices[i].z);
-//    }
-//
-//    for (unsigned int i = 0; i < mesh->mNumFaces; ++i) {
-//        aiFace face = mesh->mFaces[i];
-//        for (unsigned int j = 0; j < face.mNumIndices; ++j) {
-//            indices.push_back(face.mIndices[j]);
-//        }
-//    }
-//
-//    vertexCount = mesh->mNumVertices;
-//    indexCount = indices.size();
-//
-//    glGenVertexArrays(1, &bonsaiVAO);
-//    glGenBuffers(1, &bonsaiVBO);
-//    glGenBuffers(1, &bonsaiEBO);
-//
-//    glBindVertexArray(bonsaiVAO);
-//
-//    glBindBuffer(GL_ARRAY_BUFFER, bonsaiVBO);
-//    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-//
-//    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bonsaiEBO);
-//    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
-//
-//    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (GLvoid*)0);
-//    glEnableVertexAttribArray(0);
-//
-//    glBindBuffer(GL_ARRAY_BUFFER, 0);
-//    glBindVertexArray(0);
-//
-//    return true;
-//}
+#include "ModelLoader.h"
+
+#include "MeshLod.h"
+
+#include <Assimp/Importer.hpp>
+#include <Assimp/scene.h>
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+//one interleaved vertex, used as the key when merging duplicates
+struct VertexKey {
+    std::array<GLfloat, VertexStride> data;
+
+    bool operator==(const VertexKey& other) const {
+        return std::memcmp(data.data(), other.data.data(), sizeof(data)) == 0;
+    }
+};
+
+//FNV-1a over the raw vertex bytes
+struct VertexKeyHash {
+    size_t operator()(const VertexKey& key) const {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(key.data.data());
+        size_t hash = 2166136261u;
+        for (size_t i = 0; i < sizeof(key.data); ++i) {
+            hash = (hash ^ bytes[i]) * 16777619u;
+        }
+        return hash;
+    }
+};
+
+//appends one assimp mesh as a new submesh, positions moved into model space by transform
+static void appendMesh(const aiMesh* source, const aiMatrix4x4& transform, MeshData& mesh) {
+    Submesh submesh;
+    submesh.indexOffset = (GLuint)mesh.indices.size();
+    submesh.baseVertex = mesh.vertexCount();
+    submesh.materialIndex = source->mMaterialIndex;
+
+    submesh.boundsMin = glm::vec3(FLT_MAX);
+    submesh.boundsMax = glm::vec3(-FLT_MAX);
+
+    //normals follow the inverse transpose so non uniform node scales keep them perpendicular
+    aiMatrix3x3 normalTransform = aiMatrix3x3(transform);
+    normalTransform.Inverse().Transpose();
+
+    //maps each unique vertex to its slot, local to this submesh
+    std::unordered_map<VertexKey, GLuint, VertexKeyHash> uniqueVertices;
+    uniqueVertices.reserve(source->mNumVertices);
+
+    for (unsigned int f = 0; f < source->mNumFaces; ++f) {
+        const aiFace& face = source->mFaces[f];
+        //skip points and lines left over after triangulation
+        if (face.mNumIndices != 3) {
+            continue;
+        }
+
+        for (unsigned int j = 0; j < 3; ++j) {
+            unsigned int i = face.mIndices[j];
+            VertexKey key;
+
+            // Add vertex positions
+            aiVector3D position = transform * source->mVertices[i];
+            key.data[0] = position.x;
+            key.data[1] = position.y;
+            key.data[2] = position.z;
+
+            // Add vertex colors, white if the model has none
+            if (source->HasVertexColors(0)) {
+                key.data[3] = source->mColors[0][i].r;
+                key.data[4] = source->mColors[0][i].g;
+                key.data[5] = source->mColors[0][i].b;
+            }
+            else {
+                key.data[3] = 1.0f;
+                key.data[4] = 1.0f;
+                key.data[5] = 1.0f;
+            }
+
+            // Add vertex normals, zero if missing (lighting then only adds the ambient term)
+            if (source->HasNormals()) {
+                aiVector3D normal = normalTransform * source->mNormals[i];
+                normal.NormalizeSafe();
+                key.data[6] = normal.x;
+                key.data[7] = normal.y;
+                key.data[8] = normal.z;
+            }
+            else {
+                key.data[6] = 0.0f;
+                key.data[7] = 0.0f;
+                key.data[8] = 0.0f;
+            }
+
+            // Add texture coords, zero if missing so the stride stays the same
+            if (source->HasTextureCoords(0)) {
+                key.data[9] = source->mTextureCoords[0][i].x;
+                key.data[10] = source->mTextureCoords[0][i].y;
+            }
+            else {
+                key.data[9] = 0.0f;
+                key.data[10] = 0.0f;
+            }
+
+            //reuse the vertex if an identical one was already emitted
+            auto found = uniqueVertices.find(key);
+            if (found != uniqueVertices.end()) {
+                mesh.indices.push_back(found->second);
+                continue;
+            }
+
+            glm::vec3 point(position.x, position.y, position.z);
+            submesh.boundsMin = glm::min(submesh.boundsMin, point);
+            submesh.boundsMax = glm::max(submesh.boundsMax, point);
+
+            GLuint index = (GLuint)uniqueVertices.size();
+            uniqueVertices.emplace(key, index);
+            mesh.vertices.insert(mesh.vertices.end(), key.data.begin(), key.data.end());
+            mesh.indices.push_back(index);
+        }
+    }
+
+    submesh.indexCount = (GLsizei)(mesh.indices.size() - submesh.indexOffset);
+    submesh.vertexCount = (GLsizei)uniqueVertices.size();
+    if (submesh.indexCount > 0) {
+        mesh.submeshes.push_back(submesh);
+    }
+}
+
+//walks the node tree, accumulating transforms down to each mesh it references
+static void appendNode(const aiScene* scene, const aiNode* node, const aiMatrix4x4& parentTransform, MeshData& mesh) {
+    aiMatrix4x4 transform = parentTransform * node->mTransformation;
+
+    for (unsigned int m = 0; m < node->mNumMeshes; ++m) {
+        appendMesh(scene->mMeshes[node->mMeshes[m]], transform, mesh);
+    }
+    for (unsigned int c = 0; c < node->mNumChildren; ++c) {
+        appendNode(scene, node->mChildren[c], transform, mesh);
+    }
+}
+
+bool loadModel(const std::string& filePath, MeshData& mesh) {
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(filePath, ModelImportFlags);
+
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+        std::cerr << "Assimp Error: " << importer.GetErrorString() << std::endl;
+        return false;
+    }
+
+    std::cout << "Loading Asset " << filePath.c_str() << "\n";
+
+    //material names so submeshes can be matched to textures later
+    for (unsigned int m = 0; m < scene->mNumMaterials; ++m) {
+        mesh.materialNames.push_back(scene->mMaterials[m]->GetName().C_Str());
+    }
+
+    appendNode(scene, scene->mRootNode, aiMatrix4x4(), mesh);
+    //simplified levels go after every full submesh in the same index list
+    buildMeshLods(mesh);
+
+    //model bounds + 16 bit indices when every submesh is small enough
+    GLsizei largestSubmesh = 0;
+    mesh.boundsMin = glm::vec3(FLT_MAX);
+    mesh.boundsMax = glm::vec3(-FLT_MAX);
+    for (const Submesh& submesh : mesh.submeshes) {
+        largestSubmesh = std::max(largestSubmesh, submesh.vertexCount);
+        mesh.boundsMin = glm::min(mesh.boundsMin, submesh.boundsMin);
+        mesh.boundsMax = glm::max(mesh.boundsMax, submesh.boundsMax);
+    }
+    if (largestSubmesh <= 0xFFFF) {
+        mesh.shortIndices.assign(mesh.indices.begin(), mesh.indices.end());
+    }
+
+    std::cout << "  " << mesh.submeshes.size() << " submeshes, " << mesh.vertexCount()
+        << " unique vertices for " << mesh.indices.size() << " indices\n";
+    for (const Submesh& submesh : mesh.submeshes) {
+        std::cout << "  lods";
+        for (GLuint level = 0; level < submesh.lodCount; ++level) {
+            std::cout << " " << submesh.lods[level].indexCount / 3;
+        }
+        std::cout << " triangles\n";
+    }
+    return !mesh.submeshes.empty();
+}
+
+MeshView meshView(const MeshData& mesh) {
+    MeshView view;
+    view.vertices = mesh.vertices.data();
+    view.vertexCount = mesh.vertexCount();
+    view.indexCount = (GLsizei)mesh.indices.size();
+    view.submeshes = mesh.submeshes.data();
+    view.submeshCount = mesh.submeshes.size();
+
+    //indices are submesh local, so 16 bits is enough while every submesh stays under 65536 vertices
+    if (!mesh.shortIndices.empty()) {
+        view.indices = mesh.shortIndices.data();
+        view.indexType = GL_UNSIGNED_SHORT;
+    }
+    else {
+        view.indices = mesh.indices.data();
+        view.indexType = GL_UNSIGNED_INT;
+    }
+    return view;
+}
+
+void uploadMesh(const MeshView& mesh, GpuMesh& gpuMesh) {
+    glGenVertexArrays(1, &gpuMesh.VAO);
+    glGenBuffers(1, &gpuMesh.VBO);
+    glGenBuffers(1, &gpuMesh.EBO);
+
+    glBindVertexArray(gpuMesh.VAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, gpuMesh.VBO);
+    glBufferData(GL_ARRAY_BUFFER, mesh.vertexCount * VertexStride * sizeof(GLfloat), mesh.vertices, GL_STATIC_DRAW);
+
+    size_t indexSize = mesh.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpuMesh.EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indexCount * indexSize, mesh.indices, GL_STATIC_DRAW);
+    gpuMesh.indexType = mesh.indexType;
+    gpuMesh.indexCount = mesh.indexCount;
+    gpuMesh.submeshes.assign(mesh.submeshes, mesh.submeshes + mesh.submeshCount);
+
+    // Vertex attribute for position
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VertexStride * sizeof(GLfloat), (GLvoid*)0);
+    glEnableVertexAttribArray(0);
+
+    // Vertex attribute for color
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, VertexStride * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(1);
+
+    // Vertex attribute for normals
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, VertexStride * sizeof(GLfloat), (GLvoid*)(6 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(2);
+
+    // Vertex attribute for texture coords
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, VertexStride * sizeof(GLfloat), (GLvoid*)(9 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(3);
+
+    // Unbind the VAO first so it keeps the element buffer binding
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void drawMesh(const GpuMesh& gpuMesh) {
+    size_t indexSize = gpuMesh.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+    //one VAO bind for the whole model, each submesh is just an index range
+    glBindVertexArray(gpuMesh.VAO);
+    for (const Submesh& submesh : gpuMesh.submeshes) {
+        glDrawElementsBaseVertex(GL_TRIANGLES, submesh.indexCount, gpuMesh.indexType,
+            (GLvoid*)(submesh.indexOffset * indexSize), submesh.baseVertex);
+    }
+    glBindVertexArray(0);
+}
+
+void destroyMesh(GpuMesh& gpuMesh) {
+    glDeleteVertexArrays(1, &gpuMesh.VAO);
+    glDeleteBuffers(1, &gpuMesh.VBO);
+    glDeleteBuffers(1, &gpuMesh.EBO);
+    gpuMesh = GpuMesh();
+}
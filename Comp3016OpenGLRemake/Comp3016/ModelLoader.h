@@ -1,29 +1,91 @@
-//#pragma once
-//
-//#include <assimp/Importer.hpp>
-//#include <assimp/scene.h>
-//#include <assimp/postprocess.h>
-//#include <vector>
-//#include <GL/glew.h>
-//#include <iostream>
-//
-//class ModelLoader {
-//public:
-//    ModelLoader(const char* filePath);
-//    ~ModelLoader();
-//
-//    bool loadModel();
-//
-//    GLuint getVAO() const { return bonsaiVAO; }
-//    GLuint getVBO() const { return bonsaiVBO; }
-//    GLuint getEBO() const { return bonsaiEBO; }
-//    GLsizei getVertexCount() const;
-//    GLsizei getIndexCount() const;
-//
-//public:
-//    const char* filePath;
-//    GLuint bonsaiVAO, bonsaiVBO, bonsaiEBO;
-//    GLsizei vertexCount;  // New variable to store the vertex count
-//    GLsizei indexCount;   // New variable to store the index count
-//    
-//};
\ No newline at end of file
+#pragma once
+
+#include <GL/glew.h>
+#include <Assimp/postprocess.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+//floats per interleaved vertex: position(3) colour(3) normal(3) texture coords(2)
+const int VertexStride = 11;
+
+//assimp post process flags used for every model, normals are generated when the file has none
+const unsigned int ModelImportFlags = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenSmoothNormals;
+
+//most detail levels a submesh keeps, level 0 is the imported mesh
+const int MaxMeshLods = 5;
+
+//one detail level of a submesh: a range of the shared index buffer over the same vertices
+struct MeshLod {
+    GLuint indexOffset = 0;
+    GLsizei indexCount = 0;
+    //worst distance (model units) the simplified surface strays from the original
+    float error = 0.0f;
+};
+
+//range of the shared buffers that belongs to one assimp mesh
+struct Submesh {
+    //first index and number of indices in the shared index buffer
+    GLuint indexOffset = 0;
+    GLsizei indexCount = 0;
+    //indices are local to the submesh, this is added to each one when drawing
+    GLint baseVertex = 0;
+    GLsizei vertexCount = 0;
+    //index into MeshData::materialNames
+    GLuint materialIndex = 0;
+    //model space bounding box
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    //simplified index ranges built at import (see MeshLod.h), lods[0] is indexOffset/indexCount
+    GLuint lodCount = 1;
+    MeshLod lods[MaxMeshLods];
+};
+
+//cpu side model with every mesh packed into one vertex and one index list
+struct MeshData {
+    std::vector<GLfloat> vertices;
+    std::vector<GLuint> indices;
+    //copy of indices packed to 16 bits, only filled when every submesh fits
+    std::vector<GLushort> shortIndices;
+    std::vector<Submesh> submeshes;
+    std::vector<std::string> materialNames;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+
+    GLsizei vertexCount() const { return (GLsizei)(vertices.size() / VertexStride); }
+};
+
+//read only view of a model ready for upload, indices already in their final gpu type
+//points either into a MeshData or straight into a mapped cache file
+struct MeshView {
+    const GLfloat* vertices = nullptr;
+    GLsizei vertexCount = 0;
+    const void* indices = nullptr;
+    GLenum indexType = GL_UNSIGNED_INT;
+    GLsizei indexCount = 0;
+    const Submesh* submeshes = nullptr;
+    size_t submeshCount = 0;
+};
+
+//gpu buffers for an uploaded model, one VAO shared by all submeshes
+struct GpuMesh {
+    GLuint VAO = 0;
+    GLuint VBO = 0;
+    GLuint EBO = 0;
+    //GL_UNSIGNED_SHORT when every submesh index fits in 16 bits, otherwise GL_UNSIGNED_INT
+    GLenum indexType = GL_UNSIGNED_INT;
+    GLsizei indexCount = 0;
+    std::vector<Submesh> submeshes;
+};
+
+//reads every mesh in the model's node tree and packs them into one indexed, deduplicated mesh
+bool loadModel(const std::string& filePath, MeshData& mesh);
+
+//view of a loaded MeshData, uses the 16 bit indices when they were packed
+MeshView meshView(const MeshData& mesh);
+
+//creates the VAO/VBO/EBO for a model
+void uploadMesh(const MeshView& mesh, GpuMesh& gpuMesh);
+//binds the model's VAO once and draws every submesh range
+void drawMesh(const GpuMesh& gpuMesh);
+void destroyMesh(GpuMesh& gpuMesh);
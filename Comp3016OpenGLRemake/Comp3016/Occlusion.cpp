@@ -0,0 +1,248 @@
+#include "Occlusion.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define OCCLUSION_SSE 1
+#include <xmmintrin.h>
+#endif
+
+static_assert(OcclusionWidth % 4 == 0, "the SSE raster loop fills 4 texels of a row at a time");
+
+OccluderMesh occluderFromVertices(const float* vertices, size_t vertexCount, int stride,
+    const uint32_t* indices, size_t indexCount)
+{
+    OccluderMesh mesh;
+    mesh.positions.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i) {
+        mesh.positions[i] = glm::vec3(vertices[i * stride], vertices[i * stride + 1], vertices[i * stride + 2]);
+    }
+    mesh.indices.assign(indices, indices + indexCount);
+    return mesh;
+}
+
+void OcclusionBuffer::begin(const glm::mat4& frameViewProjection)
+{
+    viewProjection = frameViewProjection;
+    depth.assign(OcclusionWidth * OcclusionHeight, 1.0f);
+
+    if (levels.empty()) {
+        glm::ivec2 size(OcclusionWidth, OcclusionHeight);
+        while (true) {
+            levelSizes.push_back(size);
+            levels.push_back(std::vector<float>(size.x * size.y, 1.0f));
+            if (size.x == 1 && size.y == 1) {
+                break;
+            }
+            size = glm::max(size / 2, glm::ivec2(1));
+        }
+    }
+}
+
+void OcclusionBuffer::rasterize(const OccluderMesh& mesh, const glm::mat4& model)
+{
+    glm::mat4 modelViewProjection = viewProjection * model;
+    clipped.resize(mesh.positions.size());
+    for (size_t i = 0; i < mesh.positions.size(); ++i) {
+        clipped[i] = modelViewProjection * glm::vec4(mesh.positions[i], 1.0f);
+    }
+
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        const glm::vec4 corners[3] = { clipped[mesh.indices[i]], clipped[mesh.indices[i + 1]], clipped[mesh.indices[i + 2]] };
+
+        //clip against the near plane (z = -w), a triangle becomes at most a quad
+        glm::vec4 polygon[4];
+        int count = 0;
+        for (int edge = 0; edge < 3; ++edge) {
+            const glm::vec4& from = corners[edge];
+            const glm::vec4& to = corners[(edge + 1) % 3];
+            float fromDistance = from.z + from.w;
+            float toDistance = to.z + to.w;
+            if (fromDistance >= 0.0f) {
+                polygon[count++] = from;
+            }
+            if ((fromDistance >= 0.0f) != (toDistance >= 0.0f)) {
+                polygon[count++] = from + (to - from) * (fromDistance / (fromDistance - toDistance));
+            }
+        }
+        if (count < 3) {
+            continue;
+        }
+
+        //to texel space, depth in the same 0..1 range the gl depth buffer uses
+        glm::vec3 screen[4];
+        for (int corner = 0; corner < count; ++corner) {
+            glm::vec3 ndc = glm::vec3(polygon[corner]) / polygon[corner].w;
+            screen[corner] = glm::vec3((ndc.x * 0.5f + 0.5f) * OcclusionWidth, (ndc.y * 0.5f + 0.5f) * OcclusionHeight,
+                ndc.z * 0.5f + 0.5f);
+        }
+        rasterizeTriangle(screen[0], screen[1], screen[2]);
+        if (count == 4) {
+            rasterizeTriangle(screen[0], screen[2], screen[3]);
+        }
+    }
+}
+
+//twice the signed area of (a, b, p), positive when p is left of a -> b
+static float edgeFunction(const glm::vec3& a, const glm::vec3& b, float x, float y)
+{
+    return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+}
+
+void OcclusionBuffer::rasterizeTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    float area = edgeFunction(a, b, c.x, c.y);
+    if (std::abs(area) < 1e-8f) {
+        return;
+    }
+    //props have mixed windings and no back faces are culled, so turn every triangle counter clockwise
+    const glm::vec3& second = area > 0.0f ? b : c;
+    const glm::vec3& third = area > 0.0f ? c : b;
+    area = std::abs(area);
+
+    //texels whose centre falls inside the triangle's box
+    int minX = std::max(0, (int)std::ceil(std::min(a.x, std::min(b.x, c.x)) - 0.5f));
+    int maxX = std::min(OcclusionWidth - 1, (int)std::floor(std::max(a.x, std::max(b.x, c.x)) - 0.5f));
+    int minY = std::max(0, (int)std::ceil(std::min(a.y, std::min(b.y, c.y)) - 0.5f));
+    int maxY = std::min(OcclusionHeight - 1, (int)std::floor(std::max(a.y, std::max(b.y, c.y)) - 0.5f));
+    if (minX > maxX || minY > maxY) {
+        return;
+    }
+
+    //edge functions are linear, so step them across each row instead of recomputing
+    //z / w is affine in screen space, so it steps the same way
+    float stepX0 = -(third.y - second.y), stepX1 = -(a.y - third.y), stepX2 = -(second.y - a.y);
+    float stepZ = (stepX0 * a.z + stepX1 * second.z + stepX2 * third.z) / area;
+#ifdef OCCLUSION_SSE
+    //4 texels at a time from a 4 aligned column, the edge tests mask off the ones outside
+    minX &= ~3;
+    const __m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+    const __m128 step0 = _mm_set1_ps(stepX0 * 4.0f), step1 = _mm_set1_ps(stepX1 * 4.0f);
+    const __m128 step2 = _mm_set1_ps(stepX2 * 4.0f), stepDepth = _mm_set1_ps(stepZ * 4.0f);
+    const __m128 zero = _mm_setzero_ps();
+#endif
+    for (int y = minY; y <= maxY; ++y) {
+        float centreX = minX + 0.5f, centreY = y + 0.5f;
+        float w0 = edgeFunction(second, third, centreX, centreY);
+        float w1 = edgeFunction(third, a, centreX, centreY);
+        float w2 = edgeFunction(a, second, centreX, centreY);
+        float z = (w0 * a.z + w1 * second.z + w2 * third.z) / area;
+        float* row = &depth[y * OcclusionWidth];
+#ifdef OCCLUSION_SSE
+        __m128 edge0 = _mm_add_ps(_mm_set1_ps(w0), _mm_mul_ps(lanes, _mm_set1_ps(stepX0)));
+        __m128 edge1 = _mm_add_ps(_mm_set1_ps(w1), _mm_mul_ps(lanes, _mm_set1_ps(stepX1)));
+        __m128 edge2 = _mm_add_ps(_mm_set1_ps(w2), _mm_mul_ps(lanes, _mm_set1_ps(stepX2)));
+        __m128 depths = _mm_add_ps(_mm_set1_ps(z), _mm_mul_ps(lanes, _mm_set1_ps(stepZ)));
+        for (int x = minX; x <= maxX; x += 4) {
+            __m128 inside = _mm_cmpge_ps(_mm_min_ps(edge0, _mm_min_ps(edge1, edge2)), zero);
+            __m128 current = _mm_loadu_ps(row + x);
+            __m128 nearer = _mm_min_ps(current, depths);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+            edge0 = _mm_add_ps(edge0, step0);
+            edge1 = _mm_add_ps(edge1, step1);
+            edge2 = _mm_add_ps(edge2, step2);
+            depths = _mm_add_ps(depths, stepDepth);
+        }
+#else
+        for (int x = minX; x <= maxX; ++x) {
+            if (w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f) {
+                row[x] = std::min(row[x], z);
+            }
+            w0 += stepX0;
+            w1 += stepX1;
+            w2 += stepX2;
+            z += stepZ;
+        }
+#endif
+    }
+}
+
+void OcclusionBuffer::finish()
+{
+    //a texel only keeps the farthest depth of its 3x3 neighbourhood: one that is partly uncovered has an
+    //uncovered neighbour, and the neighbours' centres span the texel so the depth bounds all of it
+    //done as a 3 wide max along the rows then down the columns, texels off the screen can't show anything
+    //so the edge row/column stands in for them
+    eroded.resize(depth.size());
+    for (int y = 0; y < OcclusionHeight; ++y) {
+        const float* row = &depth[y * OcclusionWidth];
+        float* out = &eroded[y * OcclusionWidth];
+        out[0] = std::max(row[0], row[1]);
+        for (int x = 1; x < OcclusionWidth - 1; ++x) {
+            out[x] = std::max(row[x - 1], std::max(row[x], row[x + 1]));
+        }
+        out[OcclusionWidth - 1] = std::max(row[OcclusionWidth - 2], row[OcclusionWidth - 1]);
+    }
+    std::vector<float>& base = levels[0];
+    for (int y = 0; y < OcclusionHeight; ++y) {
+        const float* above = &eroded[std::max(y - 1, 0) * OcclusionWidth];
+        const float* row = &eroded[y * OcclusionWidth];
+        const float* below = &eroded[std::min(y + 1, OcclusionHeight - 1) * OcclusionWidth];
+        float* out = &base[y * OcclusionWidth];
+        for (int x = 0; x < OcclusionWidth; ++x) {
+            out[x] = std::max(above[x], std::max(row[x], below[x]));
+        }
+    }
+
+    //same reduction as the gpu pyramid: 2x2, the last row/column of an odd level also takes the leftover
+    for (size_t level = 1; level < levels.size(); ++level) {
+        const std::vector<float>& source = levels[level - 1];
+        glm::ivec2 sourceSize = levelSizes[level - 1];
+        glm::ivec2 size = levelSizes[level];
+        for (int y = 0; y < size.y; ++y) {
+            int lastY = std::min(y * 2 + 1 + (y == size.y - 1 ? (sourceSize.y & 1) : 0), sourceSize.y - 1);
+            for (int x = 0; x < size.x; ++x) {
+                int lastX = std::min(x * 2 + 1 + (x == size.x - 1 ? (sourceSize.x & 1) : 0), sourceSize.x - 1);
+                float farthest = 0.0f;
+                for (int sy = y * 2; sy <= lastY; ++sy) {
+                    for (int sx = x * 2; sx <= lastX; ++sx) {
+                        farthest = std::max(farthest, source[sy * sourceSize.x + sx]);
+                    }
+                }
+                levels[level][y * size.x + x] = farthest;
+            }
+        }
+    }
+}
+
+bool OcclusionBuffer::occluded(const Aabb& box) const
+{
+    glm::vec2 uvMin(1.0f), uvMax(0.0f);
+    float nearest = 1.0f;
+    for (int corner = 0; corner < 8; ++corner) {
+        glm::vec3 point((corner & 1) ? box.max.x : box.min.x,
+            (corner & 2) ? box.max.y : box.min.y,
+            (corner & 4) ? box.max.z : box.min.z);
+        glm::vec4 clip = viewProjection * glm::vec4(point, 1.0f);
+        //reaches behind the camera, its nearest depth is the near plane
+        if (clip.w <= 1e-4f) {
+            return false;
+        }
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        uvMin = glm::min(uvMin, glm::vec2(ndc) * 0.5f + 0.5f);
+        uvMax = glm::max(uvMax, glm::vec2(ndc) * 0.5f + 0.5f);
+        nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+    }
+    //the part off the screen can't be seen, only the visible part is tested
+    uvMin = glm::clamp(uvMin, glm::vec2(0.0f), glm::vec2(1.0f));
+    uvMax = glm::clamp(uvMax, glm::vec2(0.0f), glm::vec2(1.0f));
+
+    //finest level the box covers at most 2x2 texels of
+    glm::ivec2 size = levelSizes[0];
+    glm::ivec2 texelMin = glm::min(glm::ivec2(uvMin * glm::vec2(size)), size - 1);
+    glm::ivec2 texelMax = glm::min(glm::ivec2(uvMax * glm::vec2(size)), size - 1);
+    int level = 0;
+    while (level + 1 < (int)levels.size() &&
+        ((texelMax.x >> level) - (texelMin.x >> level) > 1 || (texelMax.y >> level) - (texelMin.y >> level) > 1)) {
+        ++level;
+    }
+
+    glm::ivec2 levelSize = levelSizes[level];
+    glm::ivec2 low = glm::min(glm::ivec2(texelMin.x >> level, texelMin.y >> level), levelSize - 1);
+    glm::ivec2 high = glm::min(glm::ivec2(texelMax.x >> level, texelMax.y >> level), levelSize - 1);
+    const std::vector<float>& texels = levels[level];
+    float farthest = std::max(std::max(texels[low.y * levelSize.x + low.x], texels[low.y * levelSize.x + high.x]),
+        std::max(texels[high.y * levelSize.x + low.x], texels[high.y * levelSize.x + high.x]));
+    return nearest > farthest;
+}
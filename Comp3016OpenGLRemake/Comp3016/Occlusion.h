@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Culling.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+//software depth buffer the occluders are rasterised into, a quarter of the window or so is plenty
+const int OcclusionWidth = 256;
+const int OcclusionHeight = 192;
+//only the occluders covering the most screen are rasterised each frame
+const int OccluderBudget = 32;
+
+//triangles of an occluder in its model space
+struct OccluderMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+};
+
+//positions out of interleaved vertex data (position first), e.g. the props' pos + colour buffers
+OccluderMesh occluderFromVertices(const float* vertices, size_t vertexCount, int stride,
+    const uint32_t* indices, size_t indexCount);
+
+//per frame occlusion counts
+struct OcclusionStats {
+    //occluders rasterised into the depth buffer (or drawn in the gpu pre-pass)
+    int occluders = 0;
+    //frustum visible items hidden behind them, and the rest that were drawn
+    int occluded = 0;
+    int drawn = 0;
+    //triangles the occluded items would have drawn
+    long long occludedTriangles = 0;
+    //rasterising + pyramid + testing
+    double microseconds = 0.0;
+};
+
+//occlusion culling on the cpu, for contexts without compute shaders
+//large occluders are rasterised into a small depth buffer, shrunk by a texel so a texel only counts as
+//covered when all of it is, then reduced into a max depth pyramid; a box is occluded when its nearest
+//depth is behind the farthest occluder depth over the texels it covers
+class OcclusionBuffer {
+public:
+    //clears to the far plane for a new view
+    void begin(const glm::mat4& viewProjection);
+    //depth of every triangle of the mesh, clipped at the near plane, keeps the nearest per texel
+    void rasterize(const OccluderMesh& mesh, const glm::mat4& model);
+    //erodes the occluders and builds the pyramid, call once everything is rasterised
+    void finish();
+
+    bool occluded(const Aabb& box) const;
+
+private:
+    void rasterizeTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    std::vector<float> depth;
+    //depth after the horizontal half of the erosion
+    std::vector<float> eroded;
+    //levels[0] is the eroded depth, each level after holds the max of the 2x2 below it
+    std::vector<std::vector<float>> levels;
+    std::vector<glm::ivec2> levelSizes;
+    std::vector<glm::vec4> clipped;
+};
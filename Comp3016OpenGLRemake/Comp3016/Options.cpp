@@ -0,0 +1,97 @@
+#include "Options.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+//prints the accepted command line flags
+static void printUsage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [options]\n"
+        << "  --headless        render offscreen without a visible window\n"
+        << "  --frames N        frames to render in headless mode (default 300)\n"
+        << "  --json PATH       write benchmark results to PATH instead of stdout\n"
+        << "  --bench-load      compare cold and warm (cached) model load times, then exit\n"
+        << "  --bench-scene     time scene graph transform updates over 100k nodes, then exit\n"
+        << "  --podiums N       draw an instanced grid of N podiums (default 1)\n"
+        << "  --serial          run simulation and rendering on one thread\n"
+        << "  --lights N        hang N clustered grow lamps over the podiums (default 1)\n"
+        << "  --bonsais         put a bonsai on every podium\n"
+        << "  --triangle-budget N  bonsai triangles the level of detail aims for (default 500000)\n"
+        << "  --gpu-driven      cull and draw the scene from the gpu with compute + multi draw indirect (GL 4.3)\n"
+        << "  --no-occlusion    draw everything the frustum keeps, even when the podiums or wall hide it\n"
+        << "  --profile PATH    record cpu + gpu scopes from launch to exit (or P) into a chrome trace at PATH\n";
+}
+
+bool parseLaunchOptions(int argc, char** argv, LaunchOptions& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+
+        //flags that take a value read the next argument
+        bool hasValue = i + 1 < argc;
+
+        if (std::strcmp(arg, "--headless") == 0) {
+            options.headless = true;
+        }
+        else if (std::strcmp(arg, "--frames") == 0 && hasValue) {
+            options.frames = std::atoi(argv[++i]);
+            if (options.frames <= 0) {
+                std::cerr << "--frames must be a positive number\n";
+                return false;
+            }
+        }
+        else if (std::strcmp(arg, "--json") == 0 && hasValue) {
+            options.jsonPath = argv[++i];
+        }
+        else if (std::strcmp(arg, "--bench-load") == 0) {
+            options.benchLoad = true;
+        }
+        else if (std::strcmp(arg, "--bench-scene") == 0) {
+            options.benchScene = true;
+        }
+        else if (std::strcmp(arg, "--podiums") == 0 && hasValue) {
+            options.podiumCount = std::atoi(argv[++i]);
+            if (options.podiumCount <= 0) {
+                std::cerr << "--podiums must be a positive number\n";
+                return false;
+            }
+        }
+        else if (std::strcmp(arg, "--serial") == 0) {
+            options.serial = true;
+        }
+        else if (std::strcmp(arg, "--lights") == 0 && hasValue) {
+            options.lightCount = std::atoi(argv[++i]);
+            if (options.lightCount < 0) {
+                std::cerr << "--lights must not be negative\n";
+                return false;
+            }
+        }
+        else if (std::strcmp(arg, "--bonsais") == 0) {
+            options.bonsaiGrid = true;
+        }
+        else if (std::strcmp(arg, "--triangle-budget") == 0 && hasValue) {
+            options.triangleBudget = std::atoi(argv[++i]);
+            if (options.triangleBudget <= 0) {
+                std::cerr << "--triangle-budget must be a positive number\n";
+                return false;
+            }
+        }
+        else if (std::strcmp(arg, "--gpu-driven") == 0) {
+            options.gpuDriven = true;
+        }
+        else if (std::strcmp(arg, "--no-occlusion") == 0) {
+            options.occlusion = false;
+        }
+        else if (std::strcmp(arg, "--profile") == 0 && hasValue) {
+            options.profile = true;
+            options.profilePath = argv[++i];
+        }
+        else {
+            std::cerr << "Unknown or incomplete option " << arg << "\n";
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <string>
+
+//settings read from the command line at startup
+struct LaunchOptions {
+    //render into an offscreen framebuffer instead of a visible window
+    bool headless = false;
+    //number of frames to render before exiting in headless mode
+    int frames = 300;
+    //where the benchmark json is written, "-" means stdout
+    std::string jsonPath = "-";
+    //time cold (assimp) against warm (mesh cache) model loads and exit
+    bool benchLoad = false;
+    //time scene graph updates over 100k nodes and exit, no window needed
+    bool benchScene = false;
+    //podiums drawn as one instanced grid, 1 is the original single podium
+    int podiumCount = 1;
+    //simulate and draw on one thread instead of pipelining them
+    bool serial = false;
+    //clustered grow lamps over the podiums, 0 leaves just the original light
+    int lightCount = 1;
+    //a bonsai on every podium instead of just the first
+    bool bonsaiGrid = false;
+    //bonsai triangles the level of detail selection aims to stay under
+    int triangleBudget = 500000;
+    //draw the scene from indirect commands the gpu culls itself (GL 4.3), G switches back and forth
+    bool gpuDriven = false;
+    //test what the frustum kept against a depth buffer of the big occluders (podiums, wall) before drawing it
+    bool occlusion = true;
+    //chrome trace written when a capture stops, --profile starts one at launch, P starts and stops one at any time
+    std::string profilePath = "profile.json";
+    bool profile = false;
+};
+
+//fills options from argv, returns false (and prints usage) on bad arguments
+bool parseLaunchOptions(int argc, char** argv, LaunchOptions& options);
@@ -0,0 +1,74 @@
+#include "Picking.h"
+
+#include <algorithm>
+#include <chrono>
+
+void viewportRay(const glm::vec2& pixel, const glm::vec2& viewportSize, const glm::mat4& view, const glm::mat4& projection,
+    glm::vec3& origin, glm::vec3& direction)
+{
+    //pixel centre to normalised device coordinates, then back through the camera at the near and far planes
+    glm::vec2 ndc = glm::vec2(2.0f * (pixel.x + 0.5f) / viewportSize.x - 1.0f, 1.0f - 2.0f * (pixel.y + 0.5f) / viewportSize.y);
+    glm::mat4 inverse = glm::inverse(projection * view);
+    glm::vec4 nearPoint = inverse * glm::vec4(ndc, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverse * glm::vec4(ndc, 1.0f, 1.0f);
+    origin = glm::vec3(nearPoint) / nearPoint.w;
+    direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+}
+
+void PickScene::attach(const SceneBvh& bvh)
+{
+    sceneBvh = &bvh;
+}
+
+void PickScene::setItem(uint32_t item, const TriangleBvh* mesh, const glm::mat4& model)
+{
+    if (item >= items.size()) {
+        items.resize(item + 1);
+    }
+    items[item].mesh = mesh;
+    items[item].inverse = glm::inverse(model);
+}
+
+bool PickScene::pick(const glm::vec3& origin, const glm::vec3& direction, PickHit& hit, PickStats& stats) const
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    hit = PickHit();
+    stats = PickStats();
+    if (!sceneBvh) {
+        return false;
+    }
+
+    candidates.clear();
+    sceneBvh->raycast(origin, direction, 1e30f, candidates);
+    std::sort(candidates.begin(), candidates.end());
+    stats.boxesHit = (int)candidates.size();
+
+    //an affine transform keeps the ray's parameter, so a distance found in mesh space is the world distance too
+    RayHit nearest;
+    for (const std::pair<float, uint32_t>& candidate : candidates) {
+        if (candidate.first >= nearest.distance) {
+            break;
+        }
+        if (candidate.second >= items.size() || !items[candidate.second].mesh) {
+            continue;
+        }
+        const Item& item = items[candidate.second];
+        ++stats.meshesTested;
+        glm::vec3 localOrigin = glm::vec3(item.inverse * glm::vec4(origin, 1.0f));
+        glm::vec3 localDirection = glm::mat3(item.inverse) * direction;
+        if (item.mesh->raycast(localOrigin, localDirection, nearest)) {
+            hit.item = candidate.second;
+        }
+    }
+    if (hit.item != NoPick) {
+        hit.triangle = nearest.triangle;
+        hit.u = nearest.u;
+        hit.v = nearest.v;
+        hit.distance = nearest.distance;
+        hit.position = origin + direction * nearest.distance;
+    }
+
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    stats.microseconds = elapsed.count();
+    return hit.item != NoPick;
+}
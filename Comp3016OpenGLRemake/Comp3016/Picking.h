@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Culling.h"
+#include "TriangleBvh.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+//item of a PickHit when the ray hit nothing
+const uint32_t NoPick = 0xffffffffu;
+//instance colour is multiplied by this while the cursor is over it
+const glm::vec4 HoverHighlight = glm::vec4(1.6f, 1.4f, 0.6f, 1.0f);
+
+//ray from the camera through a pixel of the viewport (y down, as the window reports the cursor), direction is unit length
+void viewportRay(const glm::vec2& pixel, const glm::vec2& viewportSize, const glm::mat4& view, const glm::mat4& projection,
+    glm::vec3& origin, glm::vec3& direction);
+
+//nearest scene item triangle under a ray
+struct PickHit {
+    uint32_t item = NoPick;
+    //first index of the triangle in the item mesh's index buffer / 3
+    uint32_t triangle = 0;
+    //weights of the triangle's 2nd and 3rd vertex at the hit, the 1st gets 1 - u - v
+    float u = 0.0f;
+    float v = 0.0f;
+    float distance = 0.0f;
+    glm::vec3 position = glm::vec3(0.0f);
+};
+
+//per pick counts
+struct PickStats {
+    //items whose box the ray went through, and how many of their meshes it was tested against before the nearest hit
+    int boxesHit = 0;
+    int meshesTested = 0;
+    double microseconds = 0.0;
+};
+
+//ray casts against the scene's items: the SceneBvh finds the boxes the ray passes through, then they are tested
+//nearest first against their mesh's TriangleBvh until the next box starts behind the nearest hit
+class PickScene {
+public:
+    //bvh is over the same items setItem numbers, both are referenced, not copied
+    void attach(const SceneBvh& bvh);
+    //null mesh leaves the item out of picking
+    void setItem(uint32_t item, const TriangleBvh* mesh, const glm::mat4& model);
+
+    bool pick(const glm::vec3& origin, const glm::vec3& direction, PickHit& hit, PickStats& stats) const;
+
+private:
+    struct Item {
+        const TriangleBvh* mesh = nullptr;
+        glm::mat4 inverse = glm::mat4(1.0f);
+    };
+
+    const SceneBvh* sceneBvh = nullptr;
+    std::vector<Item> items;
+    //(box entry, item) of the current pick, picks only ever come from one thread
+    mutable std::vector<std::pair<float, uint32_t>> candidates;
+};
@@ -0,0 +1,239 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> profilerActive{ false };
+
+struct ProfileEvent {
+    const char* name;
+    int64_t start;
+    int64_t end;
+};
+
+//one thread's events, only that thread writes them so recording takes no lock
+//count is published after the event it covers, so the trace writer can read a consistent prefix at any time
+struct ThreadEvents {
+    std::atomic<const char*> name{ nullptr };
+    //tid in the trace
+    int track = 0;
+    std::unique_ptr<ProfileEvent[]> events;
+    std::atomic<uint32_t> count{ 0 };
+    std::atomic<uint32_t> dropped{ 0 };
+    //capture the events belong to, the owner clears its buffer the first time it records in a new capture
+    std::atomic<uint32_t> capture{ 0 };
+};
+
+//every buffer ever created, the lock is only taken the first time a thread records and when writing the trace
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<ThreadEvents>> registry;
+static std::atomic<uint32_t> currentCapture{ 0 };
+static int64_t captureStart = 0;
+
+static thread_local ThreadEvents* threadEvents = nullptr;
+static thread_local const char* threadName = nullptr;
+
+//gpu timestamps, two frames of queries so reading one frame back never waits on the frame being drawn
+struct GpuFrameQueries {
+    GLuint queries[ProfilerGpuScopes][2] = {};
+    const char* names[ProfilerGpuScopes] = {};
+    int used = 0;
+    //cpu clock - gpu clock when the frame began
+    int64_t clockOffset = 0;
+    //recording for this capture, 0 when the profiler wasn't running as the frame began
+    uint32_t capture = 0;
+};
+
+static bool gpuReady = false;
+static GpuFrameQueries gpuFrames[2];
+static int gpuFrame = 0;
+static ThreadEvents* gpuEvents = nullptr;
+
+static ThreadEvents* createEvents(const char* name)
+{
+    std::unique_ptr<ThreadEvents> events(new ThreadEvents());
+    events->name = name;
+    events->events.reset(new ProfileEvent[ProfilerThreadEvents]);
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    events->track = (int)registry.size() + 1;
+    registry.push_back(std::move(events));
+    return registry.back().get();
+}
+
+//appends to a buffer, only ever called by the buffer's owner
+static void appendEvent(ThreadEvents& events, uint32_t capture, const char* name, int64_t start, int64_t end)
+{
+    if (events.capture.load(std::memory_order_relaxed) != capture) {
+        events.count.store(0, std::memory_order_relaxed);
+        events.dropped.store(0, std::memory_order_relaxed);
+        events.capture.store(capture, std::memory_order_release);
+    }
+
+    uint32_t count = events.count.load(std::memory_order_relaxed);
+    if (count >= ProfilerThreadEvents) {
+        events.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    events.events[count] = ProfileEvent{ name, start, end };
+    events.count.store(count + 1, std::memory_order_release);
+}
+
+void setProfilerThreadName(const char* name)
+{
+    threadName = name;
+    if (threadEvents) {
+        threadEvents->name = name;
+    }
+}
+
+void recordCpuEvent(const char* name, int64_t start, int64_t end)
+{
+    if (!threadEvents) {
+        threadEvents = createEvents(threadName);
+    }
+    appendEvent(*threadEvents, currentCapture.load(std::memory_order_relaxed), name, start, end);
+}
+
+void startProfiler()
+{
+    captureStart = profilerNow();
+    currentCapture.fetch_add(1);
+    profilerActive = true;
+}
+
+//turns one frame's timestamps into events on the gpu track, blocks until the gpu has written them
+static void collectGpuFrame(GpuFrameQueries& frame)
+{
+    for (int slot = 0; slot < frame.used; ++slot) {
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(frame.queries[slot][0], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(frame.queries[slot][1], GL_QUERY_RESULT, &end);
+        if (frame.capture != 0) {
+            appendEvent(*gpuEvents, frame.capture, frame.names[slot], (int64_t)begin + frame.clockOffset, (int64_t)end + frame.clockOffset);
+        }
+    }
+    frame.used = 0;
+    frame.capture = 0;
+}
+
+void stopProfiler()
+{
+    profilerActive = false;
+    if (gpuReady) {
+        //oldest first so the gpu track stays in order
+        collectGpuFrame(gpuFrames[(gpuFrame + 1) % 2]);
+        collectGpuFrame(gpuFrames[gpuFrame % 2]);
+    }
+}
+
+void initGpuProfiler()
+{
+    if (!GLEW_VERSION_3_3 && !GLEW_ARB_timer_query) {
+        std::cerr << "No timer queries, the profiler only records cpu scopes" << std::endl;
+        return;
+    }
+    for (GpuFrameQueries& frame : gpuFrames) {
+        glGenQueries(ProfilerGpuScopes * 2, &frame.queries[0][0]);
+    }
+    if (!gpuEvents) {
+        gpuEvents = createEvents("GPU");
+    }
+    gpuReady = true;
+}
+
+void destroyGpuProfiler()
+{
+    if (!gpuReady) {
+        return;
+    }
+    for (GpuFrameQueries& frame : gpuFrames) {
+        glDeleteQueries(ProfilerGpuScopes * 2, &frame.queries[0][0]);
+        frame = GpuFrameQueries();
+    }
+    gpuReady = false;
+}
+
+void beginGpuProfilerFrame()
+{
+    if (!gpuReady) {
+        return;
+    }
+    ++gpuFrame;
+    GpuFrameQueries& frame = gpuFrames[gpuFrame % 2];
+    collectGpuFrame(frame);
+    if (!profilerRunning()) {
+        return;
+    }
+
+    //GL_TIMESTAMP is the gpu clock once the commands so far reach the driver, close enough to line the tracks up
+    GLint64 gpuNow = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    frame.clockOffset = profilerNow() - gpuNow;
+    frame.capture = currentCapture.load(std::memory_order_relaxed);
+}
+
+GpuScope::GpuScope(const char* name)
+{
+    GpuFrameQueries& frame = gpuFrames[gpuFrame % 2];
+    if (!gpuReady || frame.capture == 0 || frame.used >= ProfilerGpuScopes) {
+        return;
+    }
+    slot = frame.used++;
+    frame.names[slot] = name;
+    glQueryCounter(frame.queries[slot][0], GL_TIMESTAMP);
+}
+
+GpuScope::~GpuScope()
+{
+    if (slot >= 0) {
+        glQueryCounter(gpuFrames[gpuFrame % 2].queries[slot][1], GL_TIMESTAMP);
+    }
+}
+
+bool writeChromeTrace(const std::string& path)
+{
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Failed to write the profile to " << path << std::endl;
+        return false;
+    }
+
+    uint32_t capture = currentCapture.load();
+    size_t written = 0;
+    uint32_t dropped = 0;
+    //complete ("X") events nest by time on their track, chrome wants microseconds
+    file << std::fixed << std::setprecision(3);
+    file << "{\"traceEvents\":[\n";
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (const std::unique_ptr<ThreadEvents>& events : registry) {
+        if (events->capture.load(std::memory_order_acquire) != capture) {
+            continue;
+        }
+        uint32_t count = events->count.load(std::memory_order_acquire);
+        dropped += events->dropped.load(std::memory_order_relaxed);
+
+        const char* name = events->name.load();
+        file << (written++ > 0 ? ",\n" : "") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << events->track
+            << ",\"args\":{\"name\":\"" << (name ? name : "Thread") << "\"}}";
+        for (uint32_t i = 0; i < count; ++i) {
+            const ProfileEvent& event = events->events[i];
+            //gpu events from before the capture started can't be placed
+            int64_t start = std::max(event.start, captureStart);
+            int64_t end = std::max(event.end, start);
+            file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << events->track
+                << ",\"ts\":" << (start - captureStart) / 1000.0 << ",\"dur\":" << (end - start) / 1000.0 << "}";
+        }
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    if (dropped > 0) {
+        std::cerr << dropped << " profiler events didn't fit and were dropped" << std::endl;
+    }
+    return true;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+//events one thread can record in a capture, later ones are dropped and counted
+const uint32_t ProfilerThreadEvents = 1u << 18;
+//gpu scopes one frame can time, later ones are skipped
+const int ProfilerGpuScopes = 64;
+
+//set while a capture is recording, scopes check it before doing anything else
+extern std::atomic<bool> profilerActive;
+
+inline bool profilerRunning()
+{
+    return profilerActive.load(std::memory_order_relaxed);
+}
+
+//nanoseconds on the steady clock every event is stamped with
+inline int64_t profilerNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//names the calling thread's track in the trace, name has to outlive the profiler (a literal)
+void setProfilerThreadName(const char* name);
+
+//starts a new capture, events of the previous one are thrown away
+void startProfiler();
+//GL thread only, also waits for the gpu scopes still in flight
+void stopProfiler();
+//the last capture as chrome trace json (chrome://tracing, ui.perfetto.dev), one track per thread plus the gpu's
+bool writeChromeTrace(const std::string& path);
+
+//timer queries for GpuScope, needs a current GL context (3.3 or ARB_timer_query)
+void initGpuProfiler();
+void destroyGpuProfiler();
+//GL thread, once a frame before its first GpuScope: reads back the scopes of two frames ago, their queries are reused
+void beginGpuProfilerFrame();
+
+//appends a completed event to the calling thread's buffer
+void recordCpuEvent(const char* name, int64_t start, int64_t end);
+
+//times the enclosing block on the calling thread, name has to be a literal
+class CpuScope {
+public:
+    explicit CpuScope(const char* name) : name(name), start(profilerRunning() ? profilerNow() : -1) {}
+    ~CpuScope()
+    {
+        if (start >= 0) {
+            recordCpuEvent(name, start, profilerNow());
+        }
+    }
+
+    CpuScope(const CpuScope&) = delete;
+    CpuScope& operator=(const CpuScope&) = delete;
+
+private:
+    const char* name;
+    int64_t start;
+};
+
+//times the GL commands issued in the enclosing block with a pair of gpu timestamps, GL thread only
+//timestamps rather than GL_TIME_ELAPSED so scopes can nest (and run inside the benchmark's frame query)
+class GpuScope {
+public:
+    explicit GpuScope(const char* name);
+    ~GpuScope();
+
+    GpuScope(const GpuScope&) = delete;
+    GpuScope& operator=(const GpuScope&) = delete;
+
+private:
+    int slot = -1;
+};
+
+//CpuScope + GpuScope of the same name, for GL thread blocks whose cost is on both sides
+class RenderScope {
+public:
+    explicit RenderScope(const char* name) : cpu(name), gpu(name) {}
+
+private:
+    CpuScope cpu;
+    GpuScope gpu;
+};
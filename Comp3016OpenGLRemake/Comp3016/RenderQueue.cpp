@@ -0,0 +1,158 @@
+#include "RenderQueue.h"
+
+#include "InstanceBuffer.h"
+#include "ModelLoader.h"
+#include "ShaderProgram.h"
+
+#include <algorithm>
+
+uint64_t makeSortKey(GLuint program, GLuint texture, GLuint vao, float depth01)
+{
+    const uint64_t depthMax = (1ull << SortKeyDepthBits) - 1;
+    uint64_t depth = (uint64_t)(std::min(std::max(depth01, 0.0f), 1.0f) * depthMax);
+
+    uint64_t key = program & ((1u << SortKeyProgramBits) - 1);
+    key = (key << SortKeyTextureBits) | (texture & ((1u << SortKeyTextureBits) - 1));
+    key = (key << SortKeyVaoBits) | (vao & ((1u << SortKeyVaoBits) - 1));
+    key = (key << SortKeyDepthBits) | depth;
+    return key;
+}
+
+float viewDepth(const glm::mat4& view, const glm::vec3& worldPosition)
+{
+    //the camera looks down -z in view space
+    return -(view * glm::vec4(worldPosition, 1.0f)).z;
+}
+
+void RenderQueue::submit(const DrawCommand& command, float depth)
+{
+    commands.push_back(command);
+    keys.push_back(makeSortKey(command.program, command.texture, command.vao, depth / depthRange));
+}
+
+void RenderQueue::submitMesh(const GpuMesh& mesh, const DrawCommand& base, const glm::mat4& view, int lod)
+{
+    size_t indexSize = mesh.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+    DrawCommand command = base;
+    command.vao = mesh.VAO;
+    command.indexType = mesh.indexType;
+    for (const Submesh& submesh : mesh.submeshes) {
+        const MeshLod& level = submesh.lods[std::min(std::max(lod, 0), (int)submesh.lodCount - 1)];
+        command.indexCount = level.indexCount;
+        command.indexOffset = level.indexOffset * indexSize;
+        command.baseVertex = submesh.baseVertex;
+
+        glm::vec3 centre = glm::vec3(base.model * glm::vec4((submesh.boundsMin + submesh.boundsMax) * 0.5f, 1.0f));
+        submit(command, viewDepth(view, centre));
+    }
+}
+
+void RenderQueue::sort()
+{
+    size_t count = keys.size();
+    sortedKeys = keys;
+    scratchKeys.resize(count);
+    sortedOrder.resize(count);
+    scratchOrder.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        sortedOrder[i] = (uint32_t)i;
+    }
+
+    //8 passes of 8 bits, least significant byte first so each pass keeps the order of the last
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t histogram[256] = {};
+        for (size_t i = 0; i < count; ++i) {
+            ++histogram[(sortedKeys[i] >> shift) & 0xFF];
+        }
+        //every key shares this byte (unused texture bits etc), the pass would change nothing
+        if (histogram[(sortedKeys[0] >> shift) & 0xFF] == count) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (int bucket = 0; bucket < 256; ++bucket) {
+            size_t bucketSize = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += bucketSize;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            size_t slot = histogram[(sortedKeys[i] >> shift) & 0xFF]++;
+            scratchKeys[slot] = sortedKeys[i];
+            scratchOrder[slot] = sortedOrder[i];
+        }
+        sortedKeys.swap(scratchKeys);
+        sortedOrder.swap(scratchOrder);
+    }
+}
+
+RenderQueueStats RenderQueue::execute()
+{
+    RenderQueueStats stats;
+    if (commands.empty()) {
+        return stats;
+    }
+    sort();
+
+    //nothing is assumed about the state left by earlier code, the first draw binds everything
+    const GLuint unknown = ~0u;
+    GLuint currentProgram = unknown;
+    GLuint currentTexture = unknown;
+    GLuint currentVao = unknown;
+    const InstanceBuffer* currentInstances = nullptr;
+    GLuint currentObjectBuffer = unknown;
+    GLintptr currentObjectOffset = -1;
+
+    glActiveTexture(GL_TEXTURE0);
+    for (uint32_t index : sortedOrder) {
+        const DrawCommand& command = commands[index];
+
+        if (command.program != currentProgram) {
+            glUseProgram(command.program);
+            currentProgram = command.program;
+            ++stats.programChanges;
+        }
+        if (command.texture != currentTexture) {
+            glBindTexture(GL_TEXTURE_2D, command.texture);
+            currentTexture = command.texture;
+            ++stats.textureChanges;
+        }
+        if (command.vao != currentVao) {
+            glBindVertexArray(command.vao);
+            currentVao = command.vao;
+            currentInstances = nullptr;
+            ++stats.vaoChanges;
+        }
+
+        if (command.instances) {
+            if (command.instances != currentInstances) {
+                command.instances->bindAttributes();
+                currentInstances = command.instances;
+                ++stats.instanceBinds;
+            }
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.indexCount, command.indexType,
+                (GLvoid*)command.indexOffset, command.instances->count(), command.baseVertex);
+            stats.triangles += (long long)command.indexCount / 3 * command.instances->count();
+        }
+        else {
+            //binding points are shared by every program, so a range stays bound across program changes
+            if (command.objectBuffer != 0 &&
+                (command.objectBuffer != currentObjectBuffer || command.objectOffset != currentObjectOffset)) {
+                glBindBufferRange(GL_UNIFORM_BUFFER, ObjectUniformBinding, command.objectBuffer,
+                    command.objectOffset, sizeof(ObjectUniforms));
+                currentObjectBuffer = command.objectBuffer;
+                currentObjectOffset = command.objectOffset;
+                ++stats.objectBinds;
+            }
+            glDrawElementsBaseVertex(GL_TRIANGLES, command.indexCount, command.indexType,
+                (GLvoid*)command.indexOffset, command.baseVertex);
+            stats.triangles += command.indexCount / 3;
+        }
+        ++stats.draws;
+    }
+    glBindVertexArray(0);
+
+    commands.clear();
+    keys.clear();
+    return stats;
+}
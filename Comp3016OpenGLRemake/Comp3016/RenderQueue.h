@@ -0,0 +1,103 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+class InstanceBuffer;
+struct GpuMesh;
+
+//one indexed draw plus every bit of GL state it needs
+struct DrawCommand {
+    GLuint program = 0;
+    GLuint texture = 0;
+    GLuint vao = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    GLsizei indexCount = 0;
+    //byte offset into the VAO's element buffer, base vertex for meshes sharing one buffer
+    size_t indexOffset = 0;
+    GLint baseVertex = 0;
+    //ObjectData block range holding the model matrix, not bound when objectBuffer is 0
+    GLuint objectBuffer = 0;
+    GLintptr objectOffset = 0;
+    //same placement on the cpu side, only used to depth sort submeshes
+    glm::mat4 model = glm::mat4(1.0f);
+    //instanced draws take their transforms from here instead of the object block
+    InstanceBuffer* instances = nullptr;
+};
+
+//what executing one frame of the queue actually sent to GL
+struct RenderQueueStats {
+    int draws = 0;
+    int programChanges = 0;
+    int textureChanges = 0;
+    int vaoChanges = 0;
+    int objectBinds = 0;
+    //instance buffers pointed at the bound VAO's attributes
+    int instanceBinds = 0;
+    //triangles drawn, instanced draws count every instance
+    long long triangles = 0;
+
+    int stateChanges() const { return programChanges + textureChanges + vaoChanges + objectBinds + instanceBinds; }
+
+    //sums the passes of one frame, the shadow cascades and the main view
+    RenderQueueStats& operator+=(const RenderQueueStats& other)
+    {
+        draws += other.draws;
+        programChanges += other.programChanges;
+        textureChanges += other.textureChanges;
+        vaoChanges += other.vaoChanges;
+        objectBinds += other.objectBinds;
+        instanceBinds += other.instanceBinds;
+        triangles += other.triangles;
+        return *this;
+    }
+};
+
+//sort key fields from the top bit down: program | texture | VAO | depth
+//GL names are masked to their field, a collision only costs sorting quality because
+//execute() still compares the real names before skipping a bind
+const int SortKeyProgramBits = 10;
+const int SortKeyTextureBits = 14;
+const int SortKeyVaoBits = 14;
+const int SortKeyDepthBits = 26;
+
+//depth01 is 0 at the camera and 1 at the far plane, nearer draws sort first inside a state group
+uint64_t makeSortKey(GLuint program, GLuint texture, GLuint vao, float depth01);
+
+//distance in front of the camera, what submit() expects as viewDepth
+float viewDepth(const glm::mat4& view, const glm::vec3& worldPosition);
+
+//collects a frame's draws, radix sorts them by state and replays them skipping redundant binds
+class RenderQueue {
+public:
+    //far plane the depth field is quantised against, keep in step with the projection
+    void setDepthRange(float farPlane) { depthRange = farPlane; }
+
+    void submit(const DrawCommand& command, float depth);
+    //queues every submesh of a model at one detail level, each sorted by the depth of its own bounds
+    //submeshes with fewer levels than lod draw their coarsest one
+    void submitMesh(const GpuMesh& mesh, const DrawCommand& base, const glm::mat4& view, int lod = 0);
+
+    //sorts, issues every draw and empties the queue for the next frame
+    RenderQueueStats execute();
+
+    size_t size() const { return commands.size(); }
+
+private:
+    //lsd radix sort of keys, leaves the draw order in sortedOrder
+    void sort();
+
+    std::vector<DrawCommand> commands;
+    std::vector<uint64_t> keys;
+
+    //sort scratch, kept between frames so sorting never allocates once warmed up
+    std::vector<uint64_t> sortedKeys;
+    std::vector<uint64_t> scratchKeys;
+    std::vector<uint32_t> sortedOrder;
+    std::vector<uint32_t> scratchOrder;
+
+    float depthRange = 100.0f;
+};
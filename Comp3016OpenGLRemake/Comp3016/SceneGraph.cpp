@@ -0,0 +1,207 @@
+#include "SceneGraph.h"
+
+#include <algorithm>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define SCENEGRAPH_SSE 1
+#include <xmmintrin.h>
+#endif
+
+//lanes become nodes by transposing each column of the 4x4 element registers
+void SceneGraph::composeBlock(const TransformBlock& block, glm::mat4* out)
+{
+#ifdef SCENEGRAPH_SSE
+    __m128 x = _mm_loadu_ps(block.qx);
+    __m128 y = _mm_loadu_ps(block.qy);
+    __m128 z = _mm_loadu_ps(block.qz);
+    __m128 w = _mm_loadu_ps(block.qw);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    __m128 x2 = _mm_mul_ps(x, two);
+    __m128 y2 = _mm_mul_ps(y, two);
+    __m128 z2 = _mm_mul_ps(z, two);
+    __m128 xx = _mm_mul_ps(x, x2);
+    __m128 yy = _mm_mul_ps(y, y2);
+    __m128 zz = _mm_mul_ps(z, z2);
+    __m128 xy = _mm_mul_ps(x, y2);
+    __m128 xz = _mm_mul_ps(x, z2);
+    __m128 yz = _mm_mul_ps(y, z2);
+    __m128 wx = _mm_mul_ps(w, x2);
+    __m128 wy = _mm_mul_ps(w, y2);
+    __m128 wz = _mm_mul_ps(w, z2);
+
+    //one register per matrix element, lanes are nodes
+    __m128 scaleX = _mm_loadu_ps(block.sx);
+    __m128 scaleY = _mm_loadu_ps(block.sy);
+    __m128 scaleZ = _mm_loadu_ps(block.sz);
+    __m128 column[4][4] = {
+        { _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), scaleX), _mm_mul_ps(_mm_add_ps(xy, wz), scaleX),
+          _mm_mul_ps(_mm_sub_ps(xz, wy), scaleX), _mm_setzero_ps() },
+        { _mm_mul_ps(_mm_sub_ps(xy, wz), scaleY), _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), scaleY),
+          _mm_mul_ps(_mm_add_ps(yz, wx), scaleY), _mm_setzero_ps() },
+        { _mm_mul_ps(_mm_add_ps(xz, wy), scaleZ), _mm_mul_ps(_mm_sub_ps(yz, wx), scaleZ),
+          _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), scaleZ), _mm_setzero_ps() },
+        { _mm_loadu_ps(block.tx), _mm_loadu_ps(block.ty), _mm_loadu_ps(block.tz), one },
+    };
+    //transposing a column's 4 elements gives that column of each lane's matrix
+    for (int c = 0; c < 4; ++c) {
+        _MM_TRANSPOSE4_PS(column[c][0], column[c][1], column[c][2], column[c][3]);
+        for (int lane = 0; lane < 4; ++lane) {
+            _mm_storeu_ps(&out[lane][c][0], column[c][lane]);
+        }
+    }
+#else
+    for (int lane = 0; lane < 4; ++lane) {
+        glm::mat4 local = glm::mat4_cast(glm::quat(block.qw[lane], block.qx[lane], block.qy[lane], block.qz[lane]));
+        local[0] *= block.sx[lane];
+        local[1] *= block.sy[lane];
+        local[2] *= block.sz[lane];
+        local[3] = glm::vec4(block.tx[lane], block.ty[lane], block.tz[lane], 1.0f);
+        out[lane] = local;
+    }
+#endif
+}
+
+//parent * local, local is affine (last row 0 0 0 1)
+static void multiplyAffine(const glm::mat4& parent, const glm::mat4& local, glm::mat4& out)
+{
+#ifdef SCENEGRAPH_SSE
+    __m128 p0 = _mm_loadu_ps(&parent[0][0]);
+    __m128 p1 = _mm_loadu_ps(&parent[1][0]);
+    __m128 p2 = _mm_loadu_ps(&parent[2][0]);
+    __m128 p3 = _mm_loadu_ps(&parent[3][0]);
+    for (int c = 0; c < 4; ++c) {
+        __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p0, _mm_set1_ps(local[c][0])), _mm_mul_ps(p1, _mm_set1_ps(local[c][1]))),
+            _mm_mul_ps(p2, _mm_set1_ps(local[c][2])));
+        _mm_storeu_ps(&out[c][0], c == 3 ? _mm_add_ps(r, p3) : r);
+    }
+#else
+    out = parent * local;
+#endif
+}
+
+SceneNode SceneGraph::addNode(SceneNode parent, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+{
+    SceneNode node = (SceneNode)parents.size();
+    if (node % 4 == 0) {
+        //the last block's unused lanes stay zero, they are composed but never stored
+        locals.push_back(TransformBlock());
+        dirty.resize(locals.size() * 4, 0);
+    }
+    parents.push_back(parent);
+    worlds.push_back(glm::mat4(1.0f));
+    setTranslation(node, translation);
+    setRotation(node, rotation);
+    setScale(node, scale);
+    return node;
+}
+
+void SceneGraph::reserve(size_t count)
+{
+    parents.reserve(count);
+    locals.reserve((count + 3) / 4);
+    worlds.reserve(count);
+    dirty.reserve((count + 3) / 4 * 4);
+}
+
+void SceneGraph::clear()
+{
+    *this = SceneGraph();
+}
+
+void SceneGraph::setTranslation(SceneNode node, const glm::vec3& translation)
+{
+    TransformBlock& block = locals[node / 4];
+    block.tx[node % 4] = translation.x;
+    block.ty[node % 4] = translation.y;
+    block.tz[node % 4] = translation.z;
+    markDirty(node);
+}
+
+void SceneGraph::setRotation(SceneNode node, const glm::quat& rotation)
+{
+    TransformBlock& block = locals[node / 4];
+    block.qx[node % 4] = rotation.x;
+    block.qy[node % 4] = rotation.y;
+    block.qz[node % 4] = rotation.z;
+    block.qw[node % 4] = rotation.w;
+    markDirty(node);
+}
+
+void SceneGraph::setScale(SceneNode node, const glm::vec3& scale)
+{
+    TransformBlock& block = locals[node / 4];
+    block.sx[node % 4] = scale.x;
+    block.sy[node % 4] = scale.y;
+    block.sz[node % 4] = scale.z;
+    markDirty(node);
+}
+
+glm::vec3 SceneGraph::translation(SceneNode node) const
+{
+    const TransformBlock& block = locals[node / 4];
+    return glm::vec3(block.tx[node % 4], block.ty[node % 4], block.tz[node % 4]);
+}
+
+glm::quat SceneGraph::rotation(SceneNode node) const
+{
+    const TransformBlock& block = locals[node / 4];
+    return glm::quat(block.qw[node % 4], block.qx[node % 4], block.qy[node % 4], block.qz[node % 4]);
+}
+
+glm::vec3 SceneGraph::scale(SceneNode node) const
+{
+    const TransformBlock& block = locals[node / 4];
+    return glm::vec3(block.sx[node % 4], block.sy[node % 4], block.sz[node % 4]);
+}
+
+void SceneGraph::markDirty(SceneNode node)
+{
+    dirty[node] = 1;
+    firstDirty = std::min(firstDirty, (size_t)node);
+}
+
+size_t SceneGraph::update()
+{
+    size_t count = parents.size();
+    if (firstDirty >= count) {
+        return 0;
+    }
+
+    //a node under a dirty parent is dirty too, parents come first so theirs is already final
+    for (size_t node = firstDirty; node < count; ++node) {
+        SceneNode parent = parents[node];
+        if (parent != NoSceneNode) {
+            dirty[node] |= dirty[parent];
+        }
+    }
+
+    size_t updated = 0;
+    for (size_t b = firstDirty / 4; b < locals.size(); ++b) {
+        const uint8_t* flags = &dirty[b * 4];
+        if ((flags[0] | flags[1] | flags[2] | flags[3]) == 0) {
+            continue;
+        }
+        glm::mat4 local[4];
+        composeBlock(locals[b], local);
+        //lanes in order, a parent in the same block is done before its child
+        for (size_t lane = 0; lane < 4; ++lane) {
+            if (!flags[lane]) {
+                continue;
+            }
+            size_t node = b * 4 + lane;
+            SceneNode parent = parents[node];
+            if (parent == NoSceneNode) {
+                worlds[node] = local[lane];
+            }
+            else {
+                multiplyAffine(worlds[parent], local[lane], worlds[node]);
+            }
+            ++updated;
+        }
+    }
+
+    std::fill(dirty.begin() + firstDirty, dirty.end(), (uint8_t)0);
+    firstDirty = count;
+    return updated;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <vector>
+
+//node handle, an index into the graph's arrays
+typedef uint32_t SceneNode;
+const SceneNode NoSceneNode = 0xffffffffu;
+
+//transform hierarchy kept as structure of arrays, every node after its parent so one forward pass updates it all
+//only nodes whose local transform changed since the last update, and everything under them, are recomputed;
+//local transforms are composed 4 nodes at a time from the lanes of a block
+class SceneGraph {
+public:
+    //parent must already be in the graph (NoSceneNode for a root), that is what keeps the order topological
+    SceneNode addNode(SceneNode parent, const glm::vec3& translation,
+        const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), const glm::vec3& scale = glm::vec3(1.0f));
+    void reserve(size_t count);
+    void clear();
+
+    //each marks the node dirty, its world matrix (and its subtree's) is recomputed by the next update
+    void setTranslation(SceneNode node, const glm::vec3& translation);
+    void setRotation(SceneNode node, const glm::quat& rotation);
+    void setScale(SceneNode node, const glm::vec3& scale);
+
+    glm::vec3 translation(SceneNode node) const;
+    glm::quat rotation(SceneNode node) const;
+    glm::vec3 scale(SceneNode node) const;
+    SceneNode parent(SceneNode node) const { return parents[node]; }
+
+    //recomputes the world matrices of every dirty subtree, returns how many nodes that was
+    size_t update();
+
+    //as of the last update
+    const glm::mat4& world(SceneNode node) const { return worlds[node]; }
+    size_t size() const { return parents.size(); }
+
+private:
+    //local transforms of 4 consecutive nodes, one lane each
+    struct TransformBlock {
+        float tx[4], ty[4], tz[4];
+        float qx[4], qy[4], qz[4], qw[4];
+        float sx[4], sy[4], sz[4];
+    };
+
+    //translation * rotation * scale of every lane, into 4 matrices
+    static void composeBlock(const TransformBlock& block, glm::mat4* out);
+    void markDirty(SceneNode node);
+
+    std::vector<SceneNode> parents;
+    std::vector<TransformBlock> locals;
+    std::vector<glm::mat4> worlds;
+    //1 while a node's world matrix is out of date, padded to whole blocks
+    std::vector<uint8_t> dirty;
+    //nothing before it is dirty, update starts here
+    size_t firstDirty = 0;
+};
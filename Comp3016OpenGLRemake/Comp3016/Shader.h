@@ -1,65 +1,223 @@
 #pragma once
 //vert shader source code
+//every variant is built from this and fragmentShaderSource with a #version line and one
+//#define per ShaderFeature bit in front (see ShaderManager::variant), missing inputs are compiled out
 const char* vertexShaderSource = R"(
-   #version 330 core
  layout (location = 0) in vec3 aPos;
+#ifdef VERTEX_COLOR
  layout (location = 1) in vec3 aColor; // Added color attribute
+#endif
+#ifdef LIGHTING
  layout (location = 2) in vec3 aNormal; // Added normal attribute
+#endif
+#ifdef TEXTURE
  layout (location = 3) in vec2 textVert; // Texture Vertexes
+#endif
 
- uniform mat4 model;
- uniform mat4 view;
- uniform mat4 projection;
+#if defined(GPU_DRIVEN)
+ // Index into the GpuScene instance buffer, written by the culling compute shader (SceneInstance on the cpu side)
+ layout (location = 9) in uint aInstanceId;
+ struct SceneInstance {
+     mat4 model;
+     vec4 color;
+     vec4 boundsMin;
+     vec4 boundsMax;
+     uvec4 info;
+ };
+ layout (std430, binding = 0) readonly buffer SceneInstances {
+     SceneInstance sceneInstances[];
+ };
+#elif defined(INSTANCED)
+ // Per instance model matrix (locations 4-7) and tint, from the InstanceBuffer
+ layout (location = 4) in mat4 aInstanceModel;
+ layout (location = 8) in vec4 aInstanceColor;
+#else
+ // Per draw model matrix, a range of the frame's stream buffer (ObjectUniforms on the cpu side)
+ layout (std140) uniform ObjectData {
+     mat4 model;
+ };
+#endif
 
+ // Per frame camera + light state, shared by every program (FrameUniforms on the cpu side)
+ layout (std140) uniform FrameData {
+     mat4 view;
+     mat4 projection;
+     vec4 lightPos;
+     vec4 viewPos;
+     vec4 lightDir;
+     vec4 lightAmbient;
+     vec4 clusterDepth;
+     ivec4 clusterGrid;
+     mat4 shadowMatrices[SHADOW_CASCADES];
+     vec4 cascadeSplits;
+ };
+
+ out vec3 Color; // Pass color to fragment shader
+#ifdef LIGHTING
  out vec3 FragPos; // Pass position to fragment shader
  out vec3 Normal; // Pass normal to fragment shader
- out vec3 Color; // Pass color to fragment shader
+#endif
+#ifdef TEXTURE
  out vec2 textFrag;
+#endif
 
  void main()
  {
-     gl_Position = projection * view * model * vec4(aPos, 1.0);
-     FragPos = vec3(model * vec4(aPos, 1.0));
-     Normal = mat3(transpose(inverse(model))) * aNormal;
-     Color = aColor;
+#if defined(GPU_DRIVEN)
+     mat4 world = sceneInstances[aInstanceId].model;
+#elif defined(INSTANCED)
+     mat4 world = aInstanceModel;
+#else
+     mat4 world = model;
+#endif
+     vec4 worldPos = world * vec4(aPos, 1.0);
+     gl_Position = projection * view * worldPos;
+#ifndef DEPTH_ONLY
+
+     vec3 color = vec3(1.0);
+#ifdef VERTEX_COLOR
+     color = aColor;
+#endif
+#if defined(GPU_DRIVEN)
+     color *= sceneInstances[aInstanceId].color.rgb;
+#elif defined(INSTANCED)
+     color *= aInstanceColor.rgb;
+#endif
+     Color = color;
+
+#ifdef LIGHTING
+     FragPos = worldPos.xyz;
+     Normal = mat3(transpose(inverse(world))) * aNormal;
+#endif
+#ifdef TEXTURE
      textFrag = textVert;
+#endif
+#endif
  }
 )";
 // Frag shader source code
 const char* fragmentShaderSource = R"(
-    #version 330 core
+#ifdef DEPTH_ONLY
+// Shadow casters only write depth
+void main()
+{
+}
+#else
+in vec3 Color; // Received color from vertex shader
+#ifdef LIGHTING
 in vec3 FragPos; // Received position from vertex shader
 in vec3 Normal; // Received normal from vertex shader
-in vec3 Color; // Received color from vertex shader
-in vec2 textFrag;
 
-out vec4 FragColorOutput;
+// Per frame camera + light state, lightPos/viewPos are the light source and camera positions
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec4 lightPos;
+    vec4 viewPos;
+    vec4 lightDir;
+    vec4 lightAmbient;
+    vec4 clusterDepth; // log depth -> slice scale + bias
+    ivec4 clusterGrid; // tiles x, tiles y, slices
+    mat4 shadowMatrices[SHADOW_CASCADES]; // world -> shadow map space per sun cascade
+    vec4 cascadeSplits; // view depth each cascade ends at
+};
+
+// Clustered point lights: (offset, count) per cluster into the index list, then 2 texels per light
+uniform usamplerBuffer clusterCells;
+uniform usamplerBuffer clusterLightIndices;
+uniform samplerBuffer clusterLights;
+
+// Sun shadow cascades, one depth layer each, compared in hardware
+uniform sampler2DArrayShadow shadowCascades;
 
-uniform vec3 lightPos; // Position of the light source
-uniform vec3 viewPos; // Position of the camera/viewer
+float sunShadow(float depth)
+{
+    int cascade = SHADOW_CASCADES;
+    for (int i = SHADOW_CASCADES - 1; i >= 0; --i) {
+        if (depth < cascadeSplits[i]) {
+            cascade = i;
+        }
+    }
+    // Past the last cascade nothing is shadowed
+    if (cascade == SHADOW_CASCADES) {
+        return 1.0;
+    }
+
+    vec4 shadowPos = shadowMatrices[cascade] * vec4(FragPos, 1.0);
+    float bias = 0.0015 * float(cascade + 1);
+    vec2 texel = 1.0 / vec2(textureSize(shadowCascades, 0).xy);
+    // 4 taps a texel apart on top of the 2x2 linear compare
+    float lit = 0.0;
+    lit += texture(shadowCascades, vec4(shadowPos.xy + vec2(-0.5, -0.5) * texel, float(cascade), shadowPos.z - bias));
+    lit += texture(shadowCascades, vec4(shadowPos.xy + vec2(0.5, -0.5) * texel, float(cascade), shadowPos.z - bias));
+    lit += texture(shadowCascades, vec4(shadowPos.xy + vec2(-0.5, 0.5) * texel, float(cascade), shadowPos.z - bias));
+    lit += texture(shadowCascades, vec4(shadowPos.xy + vec2(0.5, 0.5) * texel, float(cascade), shadowPos.z - bias));
+    return lit * 0.25;
+}
+#endif
+#ifdef TEXTURE
+in vec2 textFrag;
 uniform sampler2D texture_main;
+#endif
+
+out vec4 FragColorOutput;
 
 void main()
 {
-    // Ambient lighting
+    // Ambient lighting, all an unlit variant keeps
     float ambientStrength = 1.0;
-    vec3 ambient = ambientStrength * Color;
+    vec3 result = ambientStrength * Color;
 
+#ifdef LIGHTING
     // Diffuse lighting
-    vec3 lightDir = normalize(lightPos - FragPos);
-    float diff = max(dot(Normal, lightDir), 0.0);
+    vec3 toLight = normalize(lightPos.xyz - FragPos);
+    float diff = max(dot(Normal, toLight), 0.0);
     vec3 diffuse = diff * Color;
 
     // Specular lighting
     float specularStrength = 1.0;
-    vec3 viewDir = normalize(viewPos - FragPos);
-    vec3 reflectDir = reflect(-lightDir, Normal);
+    vec3 viewDir = normalize(viewPos.xyz - FragPos);
+    vec3 reflectDir = reflect(-toLight, Normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32.0);
     vec3 specular = specularStrength * spec * vec3(1.0, 1.0, 1.0);
 
+    result += diffuse + specular;
+
+    // Sun (or moon) light, shadowed by the cascades
+    vec4 viewPosition = view * vec4(FragPos, 1.0);
+    float sunDiffuse = max(dot(Normal, -lightDir.xyz), 0.0);
+    result += sunShadow(-viewPosition.z) * sunDiffuse * lightDir.w * Color;
+
+    // Point lights touching this fragment's cluster, the rest of the scene's lights cost nothing here
+    vec4 clipPosition = projection * viewPosition;
+    vec2 tile = clamp((clipPosition.xy / clipPosition.w) * 0.5 + 0.5, 0.0, 0.999) * vec2(clusterGrid.xy);
+    int slice = int(floor(log(max(-viewPosition.z, 1e-4)) * clusterDepth.x + clusterDepth.y));
+    slice = clamp(slice, 0, clusterGrid.z - 1);
+    int cluster = (slice * clusterGrid.y + int(tile.y)) * clusterGrid.x + int(tile.x);
+
+    uvec2 cell = texelFetch(clusterCells, cluster).xy;
+    for (uint i = 0u; i < cell.y; ++i) {
+        int light = int(texelFetch(clusterLightIndices, int(cell.x + i)).r);
+        vec4 positionRadius = texelFetch(clusterLights, light * 2);
+        vec3 lightColor = texelFetch(clusterLights, light * 2 + 1).rgb;
+
+        vec3 toLamp = positionRadius.xyz - FragPos;
+        float distance = length(toLamp);
+        float falloff = clamp(1.0 - distance / positionRadius.w, 0.0, 1.0);
+        falloff *= falloff;
+        toLamp /= max(distance, 1e-4);
+
+        float lampDiffuse = max(dot(Normal, toLamp), 0.0);
+        float lampSpec = pow(max(dot(viewDir, reflect(-toLamp, Normal)), 0.0), 32.0);
+        result += falloff * lightColor * (lampDiffuse * Color + specularStrength * lampSpec);
+    }
+#endif
+
     // Final color
-    vec3 result = ambient + diffuse + specular;
-    FragColorOutput = texture(texture_main, textFrag) * vec4(result, 1.0);
-    //FragColorOutput = texture(texture_main, textFrag);
+    FragColorOutput = vec4(result, 1.0);
+#ifdef TEXTURE
+    FragColorOutput *= texture(texture_main, textFrag);
+#endif
 }
-)";
\ No newline at end of file
+#endif
+)";
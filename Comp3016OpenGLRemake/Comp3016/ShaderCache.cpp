@@ -0,0 +1,124 @@
+#include "ShaderCache.h"
+
+#include "MappedFile.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+//file layout: ShaderCacheHeader then binarySize bytes of driver specific program binary
+struct ShaderCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t binaryFormat;
+    uint32_t binarySize;
+};
+
+static const char ShaderCacheMagic[4] = { 'S', 'H', 'C', 'H' };
+
+std::string shaderCachePath(const std::string& name)
+{
+    return name + ".shadercache";
+}
+
+uint64_t shaderCacheKey(const char* vertexSource, const char* fragmentSource)
+{
+    std::string driver;
+    driver += (const char*)glGetString(GL_VENDOR);
+    driver += '\n';
+    driver += (const char*)glGetString(GL_RENDERER);
+    driver += '\n';
+    driver += (const char*)glGetString(GL_VERSION);
+    return hashPath(driver + '\n' + vertexSource + '\n' + fragmentSource);
+}
+
+bool programBinariesSupported()
+{
+    if (!GLEW_ARB_get_program_binary) {
+        return false;
+    }
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+GLuint loadProgramBinary(const std::string& name, uint64_t key)
+{
+    MappedFile file;
+    if (!file.open(shaderCachePath(name)) || file.size() < sizeof(ShaderCacheHeader)) {
+        return 0;
+    }
+
+    ShaderCacheHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, ShaderCacheMagic, 4) != 0 ||
+        header.version != ShaderCacheVersion ||
+        header.key != key) {
+        return 0;
+    }
+    if (sizeof(header) + (size_t)header.binarySize > file.size()) {
+        std::cerr << "Shader cache " << shaderCachePath(name) << " is truncated" << std::endl;
+        return 0;
+    }
+
+    //drivers may still refuse a binary with a matching key (e.g. a different GPU on the same driver)
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.binaryFormat, file.data() + sizeof(header), (GLsizei)header.binarySize);
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+bool saveProgramBinary(const std::string& name, uint64_t key, GLuint program)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return false;
+    }
+
+    std::vector<unsigned char> bytes(sizeof(ShaderCacheHeader) + length);
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, bytes.data() + sizeof(ShaderCacheHeader));
+    if (written <= 0) {
+        return false;
+    }
+
+    ShaderCacheHeader header;
+    std::memcpy(header.magic, ShaderCacheMagic, 4);
+    header.version = ShaderCacheVersion;
+    header.key = key;
+    header.binaryFormat = format;
+    header.binarySize = (uint32_t)written;
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    bytes.resize(sizeof(header) + written);
+
+    //write to a temp file first so a crash never leaves a half written cache behind
+    std::string cachePath = shaderCachePath(name);
+    std::string tempPath = cachePath + ".tmp";
+    bool saved = false;
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (out) {
+            out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+            saved = (bool)out;
+        }
+    }
+    if (saved) {
+        std::remove(cachePath.c_str());
+        saved = std::rename(tempPath.c_str(), cachePath.c_str()) == 0;
+    }
+    if (!saved) {
+        std::remove(tempPath.c_str());
+        std::cerr << "Could not write shader cache " << cachePath << std::endl;
+    }
+    return saved;
+}
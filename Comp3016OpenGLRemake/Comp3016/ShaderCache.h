@@ -0,0 +1,24 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <string>
+
+//bump whenever the cache layout changes
+const unsigned int ShaderCacheVersion = 1;
+
+//cache file for a named program, stored in the working directory
+std::string shaderCachePath(const std::string& name);
+
+//hash of both sources plus the vendor, renderer and version strings of the current context,
+//a driver update or a source edit gives a new key and the stale binary is ignored
+uint64_t shaderCacheKey(const char* vertexSource, const char* fragmentSource);
+
+//true when the context can hand out and accept program binaries at all
+bool programBinariesSupported();
+
+//creates a program from the cached binary, 0 when there is no cache, the key differs or the driver rejects it
+GLuint loadProgramBinary(const std::string& name, uint64_t key);
+//writes the binary of a program linked with the retrievable hint
+bool saveProgramBinary(const std::string& name, uint64_t key, GLuint program);
@@ -0,0 +1,190 @@
+#include "ShaderManager.h"
+
+#include "Profiler.h"
+#include "Shader.h"
+#include "ShaderCache.h"
+
+#include <chrono>
+#include <iostream>
+
+static const char* ShaderFeatureNames[ShaderFeatureCount] = { "color", "texture", "lighting", "instanced", "depth", "gpu" };
+static const char* ShaderFeatureDefines[ShaderFeatureCount] = { "VERTEX_COLOR", "TEXTURE", "LIGHTING", "INSTANCED", "DEPTH_ONLY", "GPU_DRIVEN" };
+
+std::string shaderVariantName(unsigned features)
+{
+    std::string name;
+    for (int bit = 0; bit < ShaderFeatureCount; ++bit) {
+        if (features & (1u << bit)) {
+            name += name.empty() ? "" : "_";
+            name += ShaderFeatureNames[bit];
+        }
+    }
+    return name.empty() ? "plain" : name;
+}
+
+std::string shaderVariantHeader(unsigned features)
+{
+    //the gpu driven variants read a shader storage buffer, everything else stays on 3.30
+    std::string header = (features & ShaderGpuDriven) ? "#version 430 core\n" : "#version 330 core\n";
+    header += "#define SHADOW_CASCADES " + std::to_string(ShadowCascadeCount) + "\n";
+    for (int bit = 0; bit < ShaderFeatureCount; ++bit) {
+        if (features & (1u << bit)) {
+            header += "#define ";
+            header += ShaderFeatureDefines[bit];
+            header += "\n";
+        }
+    }
+    return header;
+}
+
+ShaderManager::~ShaderManager()
+{
+    stop();
+}
+
+void ShaderManager::start(GLFWwindow* mainWindow)
+{
+    binaries = programBinariesSupported();
+
+    //same hints as the main window are still set, only hide this one
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    workerContext = glfwCreateWindow(1, 1, "Shader compiler", nullptr, mainWindow);
+    if (!workerContext) {
+        std::cerr << "No shared context for shader compilation, compiling on the main thread" << std::endl;
+        return;
+    }
+    worker = std::thread(&ShaderManager::workerLoop, this);
+}
+
+void ShaderManager::stop()
+{
+    if (worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(jobsMutex);
+            stopping = true;
+        }
+        jobsReady.notify_all();
+        worker.join();
+    }
+    if (workerContext) {
+        glfwDestroyWindow(workerContext);
+        workerContext = nullptr;
+    }
+    for (auto& variant : variants) {
+        variant.second->destroy();
+    }
+    variants.clear();
+}
+
+void ShaderManager::request(ShaderProgram& target, const std::string& name, const std::string& vertexSource, const std::string& fragmentSource)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    CompileJob job = { &target, name, vertexSource, fragmentSource, 0 };
+
+    if (binaries) {
+        job.key = shaderCacheKey(vertexSource.c_str(), fragmentSource.c_str());
+        GLuint program = loadProgramBinary(name, job.key);
+        if (program) {
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            finish(target, name, program, "loaded from cache", elapsed.count());
+            return;
+        }
+    }
+
+    if (!workerContext) {
+        GLuint program = compile(job);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        if (!program) {
+            anyFailed = true;
+            return;
+        }
+        finish(target, name, program, "compiled", elapsed.count());
+        return;
+    }
+
+    ++outstanding;
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        jobs.push_back(job);
+    }
+    jobsReady.notify_one();
+}
+
+ShaderProgram& ShaderManager::variant(unsigned features)
+{
+    std::unique_ptr<ShaderProgram>& program = variants[features];
+    if (!program) {
+        program.reset(new ShaderProgram());
+        std::string header = shaderVariantHeader(features);
+        request(*program, shaderVariantName(features), header + vertexShaderSource, header + fragmentShaderSource);
+    }
+    return *program;
+}
+
+int ShaderManager::poll()
+{
+    return completed.drain();
+}
+
+void ShaderManager::workerLoop()
+{
+    glfwMakeContextCurrent(workerContext);
+    setProfilerThreadName("Shader compiler");
+    for (;;) {
+        CompileJob job;
+        {
+            std::unique_lock<std::mutex> lock(jobsMutex);
+            jobsReady.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (stopping) {
+                break;
+            }
+            job = jobs.front();
+            jobs.pop_front();
+        }
+
+        CpuScope scope("compile shader");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        GLuint program = compile(job);
+        //the main context may only use the program once this context has finished building it
+        glFinish();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        if (!program) {
+            anyFailed = true;
+            --outstanding;
+            continue;
+        }
+        double milliseconds = elapsed.count();
+        completed.push([this, job, program, milliseconds]() {
+            finish(*job.target, job.name, program, "compiled on the worker", milliseconds);
+            --outstanding;
+        });
+    }
+    glfwMakeContextCurrent(nullptr);
+}
+
+GLuint ShaderManager::compile(const CompileJob& job)
+{
+    GLuint program = linkProgram(job.vertexSource.c_str(), job.fragmentSource.c_str(), binaries);
+    if (program && binaries) {
+        saveProgramBinary(job.name, job.key, program);
+    }
+    return program;
+}
+
+void ShaderManager::finish(ShaderProgram& target, const std::string& name, GLuint program, const char* how, double milliseconds)
+{
+    //program objects are shared between the contexts, but block bindings and uniform lookups are done here on the GL thread
+    target.adopt(program);
+    if (!samplerUnits.empty()) {
+        glUseProgram(program);
+        for (const auto& sampler : samplerUnits) {
+            GLint location = target.uniform(sampler.first);
+            if (location >= 0) {
+                glUniform1i(location, sampler.second);
+            }
+        }
+        glUseProgram(0);
+    }
+    std::cout << "Shader " << name << " " << how << " in " << milliseconds << " ms" << std::endl;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "JobSystem.h"
+#include "ShaderProgram.h"
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+//feature bits a shader variant is compiled with, each one a #define in front of the sources in Shader.h
+//draws pick the cheapest set their material needs
+enum ShaderFeature : unsigned {
+    ShaderVertexColor = 1 << 0, //VERTEX_COLOR, colour attribute at location 1 (white without it)
+    ShaderTexture = 1 << 1,     //TEXTURE, uvs at location 3 modulate texture_main
+    ShaderLighting = 1 << 2,    //LIGHTING, diffuse + specular on top of the ambient term
+    ShaderInstanced = 1 << 3,   //INSTANCED, model matrix and tint per instance instead of ObjectData
+    ShaderDepthOnly = 1 << 4,   //DEPTH_ONLY, position only and an empty fragment stage, for shadow casters
+    ShaderGpuDriven = 1 << 5    //GPU_DRIVEN, model matrix and tint from the GpuScene instance buffer, needs GLSL 4.30
+};
+const int ShaderFeatureCount = 6;
+
+//"color_texture" etc, also the variant's shader cache name
+std::string shaderVariantName(unsigned features);
+//#version line, the shadow cascade count and one #define per feature bit, prepended to both stages
+std::string shaderVariantHeader(unsigned features);
+
+//builds programs without stalling the GL thread: a matching binary from the shader cache is loaded
+//straight away, anything else is compiled on a worker thread that owns a hidden context sharing
+//objects with the main one, then handed back through poll()
+class ShaderManager {
+public:
+    ShaderManager() = default;
+    ~ShaderManager();
+
+    ShaderManager(const ShaderManager&) = delete;
+    ShaderManager& operator=(const ShaderManager&) = delete;
+
+    //creates the worker context sharing mainWindow's objects, call on the main thread
+    //without one (e.g. no second context available) request() compiles synchronously instead
+    void start(GLFWwindow* mainWindow);
+    //joins the worker, destroys its context and every variant, call on the main thread before glfwTerminate
+    void stop();
+
+    //sampler uniforms are pointed at their texture unit whenever a program becomes ready
+    void bindSampler(const std::string& name, GLint unit) { samplerUnits[name] = unit; }
+
+    //target becomes ready on a cache hit right away, otherwise after a later poll()
+    void request(ShaderProgram& target, const std::string& name, const std::string& vertexSource, const std::string& fragmentSource);
+    //the program for a feature set, requested the first time it is asked for
+    //check ready() before drawing with it, a cache miss is still compiling
+    ShaderProgram& variant(unsigned features);
+
+    //adopts every program the worker has finished, returns how many became ready
+    int poll();
+    //nothing queued or compiling
+    bool idle() const { return outstanding == 0; }
+    bool failed() const { return anyFailed; }
+
+private:
+    struct CompileJob {
+        ShaderProgram* target;
+        std::string name;
+        std::string vertexSource;
+        std::string fragmentSource;
+        uint64_t key;
+    };
+
+    void workerLoop();
+    //compiles and links one job on the current context and saves its binary, returns 0 on failure
+    GLuint compile(const CompileJob& job);
+    void finish(ShaderProgram& target, const std::string& name, GLuint program, const char* how, double milliseconds);
+
+    GLFWwindow* workerContext = nullptr;
+    std::thread worker;
+    std::deque<CompileJob> jobs;
+    std::mutex jobsMutex;
+    std::condition_variable jobsReady;
+    bool stopping = false;
+
+    //finished programs travel back to the GL thread here
+    CompletionQueue completed;
+    std::atomic<int> outstanding{ 0 };
+    std::atomic<bool> anyFailed{ false };
+    bool binaries = false;
+
+    std::unordered_map<unsigned, std::unique_ptr<ShaderProgram>> variants;
+    std::unordered_map<std::string, GLint> samplerUnits;
+};
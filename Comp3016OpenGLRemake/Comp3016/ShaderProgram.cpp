@@ -0,0 +1,150 @@
+#include "ShaderProgram.h"
+
+#include <iostream>
+#include <vector>
+
+//compiles one stage, returns 0 and prints the log on failure
+static GLuint compileStage(GLenum stage, const char* source, const char* stageName)
+{
+    GLuint shader = glCreateShader(stage);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+
+    GLint success;
+    GLchar infoLog[512];
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        glGetShaderInfoLog(shader, 512, nullptr, infoLog);
+        std::cerr << stageName << " shader compilation failed:\n" << infoLog << std::endl;
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+GLuint linkProgram(const char* vertexSource, const char* fragmentSource, bool retrievable)
+{
+    GLuint vertexShader = compileStage(GL_VERTEX_SHADER, vertexSource, "Vertex");
+    if (!vertexShader) {
+        return 0;
+    }
+    GLuint fragmentShader = compileStage(GL_FRAGMENT_SHADER, fragmentSource, "Fragment");
+    if (!fragmentShader) {
+        glDeleteShader(vertexShader);
+        return 0;
+    }
+
+    //create and link shader program
+    GLuint program = glCreateProgram();
+    if (retrievable) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
+
+    //clean up shader objects after linking
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    //check for shader program link errors
+    GLint success;
+    GLchar infoLog[512];
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glGetProgramInfoLog(program, 512, nullptr, infoLog);
+        std::cerr << "Shader program linking failed:\n" << infoLog << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+GLuint linkComputeProgram(const char* computeSource)
+{
+    GLuint computeShader = compileStage(GL_COMPUTE_SHADER, computeSource, "Compute");
+    if (!computeShader) {
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, computeShader);
+    glLinkProgram(program);
+    glDeleteShader(computeShader);
+
+    GLint success;
+    GLchar infoLog[512];
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glGetProgramInfoLog(program, 512, nullptr, infoLog);
+        std::cerr << "Compute program linking failed:\n" << infoLog << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+bool ShaderProgram::build(const char* vertexSource, const char* fragmentSource)
+{
+    GLuint linked = linkProgram(vertexSource, fragmentSource, false);
+    if (!linked) {
+        return false;
+    }
+    adopt(linked);
+    return true;
+}
+
+void ShaderProgram::adopt(GLuint linkedProgram)
+{
+    destroy();
+    program = linkedProgram;
+
+    //resolve every active uniform once, so nothing is looked up by name per frame
+    GLint uniformCount = 0;
+    GLint maxNameLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniformCount);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+    std::vector<GLchar> name(maxNameLength + 1);
+    for (GLint i = 0; i < uniformCount; ++i) {
+        GLint size;
+        GLenum type;
+        GLsizei length;
+        glGetActiveUniform(program, i, (GLsizei)name.size(), &length, &size, &type, name.data());
+
+        //block members have no location, they come from the uniform buffer
+        GLint location = glGetUniformLocation(program, name.data());
+        if (location < 0) {
+            continue;
+        }
+        //arrays are reported as "name[0]", store them under "name" too
+        std::string uniformName(name.data(), length);
+        uniformLocations[uniformName] = location;
+        size_t bracket = uniformName.find('[');
+        if (bracket != std::string::npos) {
+            uniformLocations[uniformName.substr(0, bracket)] = location;
+        }
+    }
+
+    //attach the shared per frame and per draw blocks if this program uses them
+    GLuint frameBlock = glGetUniformBlockIndex(program, "FrameData");
+    if (frameBlock != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program, frameBlock, FrameUniformBinding);
+    }
+    GLuint objectBlock = glGetUniformBlockIndex(program, "ObjectData");
+    if (objectBlock != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program, objectBlock, ObjectUniformBinding);
+    }
+}
+
+void ShaderProgram::destroy()
+{
+    glDeleteProgram(program);
+    program = 0;
+    uniformLocations.clear();
+}
+
+GLint ShaderProgram::uniform(const std::string& name) const
+{
+    std::unordered_map<std::string, GLint>::const_iterator found = uniformLocations.find(name);
+    return found == uniformLocations.end() ? -1 : found->second;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <unordered_map>
+
+//binding points every program's FrameData and ObjectData blocks are attached to
+const GLuint FrameUniformBinding = 0;
+const GLuint ObjectUniformBinding = 1;
+
+//sun shadow cascades, FrameData carries a light matrix for each
+const int ShadowCascadeCount = 3;
+
+//per frame camera + light state, std140 layout matching the FrameData block in Shader.h
+struct FrameUniforms {
+    glm::mat4 view;
+    glm::mat4 projection;
+    //xyz used, w is padding so every member stays 16 byte aligned
+    glm::vec4 lightPos;
+    glm::vec4 viewPos;
+    //xyz = sun (or moon) direction, w = its intensity
+    glm::vec4 lightDir;
+    glm::vec4 lightAmbient;
+    //clustered point lights: x = slice scale, y = slice bias (see LightClusters::sliceParams)
+    glm::vec4 clusterDepth;
+    //tiles x, tiles y, depth slices, unused
+    glm::ivec4 clusterGrid;
+    //world -> shadow map texture space (xy in 0..1, depth in z) for each sun cascade
+    glm::mat4 shadowMatrices[ShadowCascadeCount];
+    //view depth each cascade ends at, w is padding
+    glm::vec4 cascadeSplits;
+};
+
+//per draw state, std140 layout matching the ObjectData block in Shader.h
+struct ObjectUniforms {
+    glm::mat4 model;
+};
+
+//compiles + links a program, prints the info log and returns 0 on failure
+//retrievable asks the driver to keep the binary around for glGetProgramBinary
+GLuint linkProgram(const char* vertexSource, const char* fragmentSource, bool retrievable);
+//same for a single compute stage, needs a GL 4.3 context
+GLuint linkComputeProgram(const char* computeSource);
+
+//linked GL program with every active uniform location resolved at link time
+class ShaderProgram {
+public:
+    //compiles + links, prints the info log and returns false on failure
+    bool build(const char* vertexSource, const char* fragmentSource);
+    //takes ownership of an already linked program (binary cache or the compile worker)
+    void adopt(GLuint linkedProgram);
+    void destroy();
+
+    GLuint id() const { return program; }
+    //false until build() or adopt() has run, draws using the program are skipped until then
+    bool ready() const { return program != 0; }
+    //cached location, -1 when the program has no such active uniform
+    GLint uniform(const std::string& name) const;
+
+private:
+    GLuint program = 0;
+    std::unordered_map<std::string, GLint> uniformLocations;
+};
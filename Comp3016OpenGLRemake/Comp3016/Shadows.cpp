@@ -0,0 +1,154 @@
+#include "Shadows.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+//0 splits the cascades evenly, 1 logarithmically, in between keeps the near cascade tight without starving the far ones
+static const float CascadeSplitBlend = 0.75f;
+//how far (as a fraction of its radius) the camera may drift before a cascade is re-centred
+static const float CascadeMargin = 0.25f;
+
+void CascadeFitter::fit(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& lightDirection,
+    const Aabb& casters, ShadowCascadeSet& cascades)
+{
+    float nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+    float farPlane = std::min(projection[3][2] / (projection[2][2] + 1.0f), ShadowDistance);
+    float tanHalfX = 1.0f / projection[0][0];
+    float tanHalfY = 1.0f / projection[1][1];
+    glm::mat4 inverseView = glm::inverse(view);
+
+    //rotation into light space, the light looks down its -z
+    glm::vec3 up = std::abs(lightDirection.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), lightDirection, up);
+    bool lightMoved = lightDirection != fittedDirection;
+    fittedDirection = lightDirection;
+
+    //caster depth range along the light, the same for every cascade
+    float casterNear = 1e30f, casterFar = -1e30f;
+    for (int corner = 0; corner < 8; ++corner) {
+        glm::vec3 point((corner & 1) ? casters.max.x : casters.min.x,
+            (corner & 2) ? casters.max.y : casters.min.y,
+            (corner & 4) ? casters.max.z : casters.min.z);
+        float depth = -(lightRotation * glm::vec4(point, 1.0f)).z;
+        casterNear = std::min(casterNear, depth);
+        casterFar = std::max(casterFar, depth);
+    }
+
+    float sliceNear = nearPlane;
+    for (int i = 0; i < ShadowCascadeCount; ++i) {
+        float fraction = (float)(i + 1) / ShadowCascadeCount;
+        float uniformSplit = nearPlane + (farPlane - nearPlane) * fraction;
+        float logSplit = nearPlane * std::pow(farPlane / nearPlane, fraction);
+        float sliceFar = uniformSplit + (logSplit - uniformSplit) * CascadeSplitBlend;
+
+        //bounding sphere of the slice's 8 corners, radius rounded so it doesn't flicker with float noise
+        glm::vec3 corners[8];
+        glm::vec3 centre(0.0f);
+        for (int corner = 0; corner < 8; ++corner) {
+            float depth = (corner & 4) ? sliceFar : sliceNear;
+            glm::vec4 viewCorner((corner & 1 ? 1.0f : -1.0f) * tanHalfX * depth,
+                (corner & 2 ? 1.0f : -1.0f) * tanHalfY * depth, -depth, 1.0f);
+            corners[corner] = glm::vec3(inverseView * viewCorner);
+            centre += corners[corner] / 8.0f;
+        }
+        float radius = 0.0f;
+        for (const glm::vec3& corner : corners) {
+            radius = std::max(radius, glm::length(corner - centre));
+        }
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+
+        Cascade& cascade = fitted[i];
+        if (lightMoved || radius != cascade.radius || glm::length(centre - cascade.centre) > radius * CascadeMargin) {
+            cascade.centre = centre;
+            cascade.radius = radius;
+        }
+
+        //snap the centre to whole texels in light space so a re-centre never shifts the texel grid
+        float extent = cascade.radius * (1.0f + CascadeMargin);
+        float texel = 2.0f * extent / ShadowMapSize;
+        glm::vec3 lightCentre = glm::vec3(lightRotation * glm::vec4(cascade.centre, 1.0f));
+        lightCentre.x = std::floor(lightCentre.x / texel) * texel;
+        lightCentre.y = std::floor(lightCentre.y / texel) * texel;
+
+        cascades.lightView[i] = glm::translate(glm::mat4(1.0f), glm::vec3(-lightCentre.x, -lightCentre.y, 0.0f)) * lightRotation;
+        float zNear = std::min(casterNear, -lightCentre.z - extent);
+        float zFar = std::max(casterFar, -lightCentre.z + extent);
+        cascades.lightProjection[i] = glm::ortho(-extent, extent, -extent, extent, zNear, zFar);
+        cascades.splitDepth[i] = sliceFar;
+
+        sliceNear = sliceFar;
+    }
+}
+
+void ShadowMaps::create()
+{
+    glGenTextures(1, &depthArray);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, depthArray);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, ShadowMapSize, ShadowMapSize, ShadowCascadeCount,
+        0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    //linear + compare gives 2x2 filtered lookups for free
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    GLint previous = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+    glGenFramebuffers(ShadowCascadeCount, framebuffers);
+    for (int i = 0; i < ShadowCascadeCount; ++i) {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0, i);
+        //depth only, no colour attachment to write
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "Shadow cascade framebuffer is incomplete" << std::endl;
+        }
+        valid[i] = false;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, previous);
+}
+
+void ShadowMaps::destroy()
+{
+    glDeleteFramebuffers(ShadowCascadeCount, framebuffers);
+    glDeleteTextures(1, &depthArray);
+    depthArray = 0;
+    for (int i = 0; i < ShadowCascadeCount; ++i) {
+        framebuffers[i] = 0;
+        valid[i] = false;
+    }
+}
+
+bool ShadowMaps::needsRender(int cascade, const glm::mat4& lightViewProjection) const
+{
+    return !valid[cascade] || std::memcmp(&rendered[cascade], &lightViewProjection, sizeof(glm::mat4)) != 0;
+}
+
+void ShadowMaps::beginCascade(int cascade)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[cascade]);
+    glViewport(0, 0, ShadowMapSize, ShadowMapSize);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void ShadowMaps::markRendered(int cascade, const glm::mat4& lightViewProjection)
+{
+    rendered[cascade] = lightViewProjection;
+    valid[cascade] = true;
+}
+
+int ShadowMaps::bind() const
+{
+    glActiveTexture(GL_TEXTURE0 + ShadowCascadesUnit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, depthArray);
+    glActiveTexture(GL_TEXTURE0);
+    return 1;
+}
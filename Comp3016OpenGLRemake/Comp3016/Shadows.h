@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Culling.h"
+#include "ShaderProgram.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+//square depth map per cascade
+const int ShadowMapSize = 1024;
+//the cascades only cover this far in front of the camera, past it nothing is shadowed
+const float ShadowDistance = 12.0f;
+//texture unit the LIGHTING shader variants sample the cascade array from
+const GLint ShadowCascadesUnit = 4;
+
+//light matrices of every cascade plus where each one ends in view depth
+struct ShadowCascadeSet {
+    glm::mat4 lightView[ShadowCascadeCount];
+    glm::mat4 lightProjection[ShadowCascadeCount];
+    float splitDepth[ShadowCascadeCount] = {};
+};
+
+//fits the cascades to the camera frustum on the cpu side
+//each cascade is a sphere around its slice of the frustum, so its size never changes as the camera turns,
+//snapped to whole shadow map texels and only re-centred once the camera leaves a margin around it:
+//while the camera stays inside and the sun does not step the matrices are bit for bit the same,
+//which is what lets ShadowMaps keep the static casters it already rendered
+class CascadeFitter {
+public:
+    //casters bounds every shadow caster so nothing between the light and a cascade is clipped
+    void fit(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& lightDirection,
+        const Aabb& casters, ShadowCascadeSet& cascades);
+
+private:
+    struct Cascade {
+        glm::vec3 centre = glm::vec3(0.0f);
+        float radius = 0.0f;
+    };
+
+    Cascade fitted[ShadowCascadeCount];
+    glm::vec3 fittedDirection = glm::vec3(0.0f);
+};
+
+//depth texture array with one layer per cascade, sampled with hardware depth compare
+class ShadowMaps {
+public:
+    void create();
+    void destroy();
+
+    //true when the cascade has never been rendered or its matrices changed since it last was
+    bool needsRender(int cascade, const glm::mat4& lightViewProjection) const;
+    //binds the cascade's layer as the depth target and clears it, remember to restore the framebuffer after
+    void beginCascade(int cascade);
+    void markRendered(int cascade, const glm::mat4& lightViewProjection);
+
+    //binds the array to ShadowCascadesUnit and leaves texture unit 0 active, returns how many textures it bound
+    int bind() const;
+
+private:
+    GLuint depthArray = 0;
+    GLuint framebuffers[ShadowCascadeCount] = {};
+    glm::mat4 rendered[ShadowCascadeCount];
+    bool valid[ShadowCascadeCount] = {};
+};
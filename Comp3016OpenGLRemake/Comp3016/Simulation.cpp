@@ -0,0 +1,45 @@
+#include "Simulation.h"
+
+#include <algorithm>
+#include <cmath>
+
+SimulationState interpolateState(const SimulationState& previous, const SimulationState& current, float alpha)
+{
+    SimulationState blended;
+    blended.cameraPos = glm::mix(previous.cameraPos, current.cameraPos, alpha);
+    blended.time = previous.time + (current.time - previous.time) * alpha;
+    return blended;
+}
+
+int FixedTimestep::advance(double frameSeconds)
+{
+    accumulator += frameSeconds;
+
+    //tiny slack so a 1/60 frame doesn't come out as 1.9999 steps from rounding
+    int steps = (int)(accumulator / SimulationStep + 1e-6);
+    if (steps > MaxSimulationSteps) {
+        steps = MaxSimulationSteps;
+        accumulator = MaxSimulationSteps * SimulationStep + std::fmod(accumulator, SimulationStep);
+    }
+    accumulator -= steps * SimulationStep;
+    if (accumulator < 0.0) {
+        accumulator = 0.0;
+    }
+    return steps;
+}
+
+glm::vec4 sunLight(double time)
+{
+    double degrees = 45.0 + 360.0 * std::fmod(time, DayLengthSeconds) / DayLengthSeconds;
+    degrees = std::floor(degrees / SunStepDegrees) * SunStepDegrees;
+    float angle = glm::radians((float)degrees);
+
+    //the sun arcs east to west, tilted towards -z
+    glm::vec3 sunPosition = glm::normalize(glm::vec3(std::cos(angle), std::sin(angle), 0.55f));
+    if (sunPosition.y > 0.0f) {
+        //fades in over the first few degrees above the horizon
+        return glm::vec4(-sunPosition, std::min(sunPosition.y * 4.0f, 1.0f));
+    }
+    //the moon is opposite the sun and much dimmer
+    return glm::vec4(sunPosition, std::min(-sunPosition.y * 4.0f, 1.0f) * 0.2f);
+}
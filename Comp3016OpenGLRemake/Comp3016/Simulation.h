@@ -0,0 +1,37 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+//simulation rate, input + camera movement + collision always advance in steps of this size
+const double SimulationStep = 1.0 / 120.0;
+//most steps run for one rendered frame, time past that is dropped so a stall can't snowball
+const int MaxSimulationSteps = 8;
+
+//everything the renderer reads from the simulation
+struct SimulationState {
+    glm::vec3 cameraPos = glm::vec3(0.0f);
+    double time = 0.0;
+};
+
+//blends the last two states, alpha 0 is previous and 1 is current
+SimulationState interpolateState(const SimulationState& previous, const SimulationState& current, float alpha);
+
+//turns real frame times into a whole number of fixed simulation steps
+class FixedTimestep {
+public:
+    //adds the frame's elapsed time, returns how many steps to run now
+    int advance(double frameSeconds);
+    //fraction of a step left over, how far between the last two states the frame should be drawn
+    float alpha() const { return (float)(accumulator / SimulationStep); }
+
+private:
+    double accumulator = 0.0;
+};
+
+//length of a full day/night cycle, time 0 is mid morning with the sun up to the top left
+const double DayLengthSeconds = 240.0;
+//the sun moves in steps of this size, cached shadow cascades only re-render when it steps
+const float SunStepDegrees = 0.5f;
+
+//direction the sun shines in, or the moon's once the sun is below the horizon, w = intensity
+glm::vec4 sunLight(double time);
@@ -0,0 +1,95 @@
+#include "StreamBuffer.h"
+
+#include <cstring>
+
+void StreamBuffer::create(GLsizeiptr frameSize)
+{
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    uniformOffsetAlignment = alignment;
+
+    //regions start on a uniform aligned boundary so offsets inside them only need aligning once
+    regionSize = (frameSize + uniformOffsetAlignment - 1) / uniformOffsetAlignment * uniformOffsetAlignment;
+    GLsizeiptr size = regionSize * RegionCount;
+
+    //created through the copy target so no VAO or uniform binding is disturbed
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    if (GLEW_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+        mapped = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+    }
+    else {
+        glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    region = RegionCount - 1;
+    cursor = 0;
+}
+
+void StreamBuffer::destroy()
+{
+    for (int i = 0; i < RegionCount; ++i) {
+        if (fences[i]) {
+            glDeleteSync(fences[i]);
+            fences[i] = nullptr;
+        }
+    }
+    if (mapped) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        mapped = nullptr;
+    }
+    glDeleteBuffers(1, &buffer);
+    buffer = 0;
+}
+
+void StreamBuffer::beginFrame()
+{
+    region = (region + 1) % RegionCount;
+    cursor = region * regionSize;
+
+    //only blocks if the gpu is a full three frames behind
+    if (fences[region]) {
+        while (glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {
+        }
+        glDeleteSync(fences[region]);
+        fences[region] = nullptr;
+    }
+}
+
+GLintptr StreamBuffer::allocate(const void* data, GLsizeiptr size, GLsizeiptr alignment)
+{
+    GLintptr offset = (cursor + alignment - 1) / alignment * alignment;
+    if (offset + size > (region + 1) * regionSize) {
+        return -1;
+    }
+    cursor = offset + size;
+
+    if (mapped) {
+        std::memcpy(mapped + offset, data, size);
+    }
+    else if (size > 0) {
+        //the fence already guarantees the gpu is done with this range, so skip the driver's own sync
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        void* range = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size,
+            GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+        if (range) {
+            std::memcpy(range, data, size);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    return offset;
+}
+
+void StreamBuffer::endFrame()
+{
+    if (fences[region]) {
+        glDeleteSync(fences[region]);
+    }
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
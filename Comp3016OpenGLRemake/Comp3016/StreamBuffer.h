@@ -0,0 +1,36 @@
+#pragma once
+
+#include <GL/glew.h>
+
+//ring of per frame regions in one GL buffer that dynamic data is sub-allocated from
+//a region is only written again once the fence placed after its frame has passed, three frames later
+//persistently mapped when ARB_buffer_storage is available, otherwise every allocation is an
+//unsynchronized glMapBufferRange (safe for the same reason), so nothing is reallocated per frame
+class StreamBuffer {
+public:
+    //frameSize bytes per region, sized for the heaviest frame
+    void create(GLsizeiptr frameSize);
+    void destroy();
+
+    //moves to the next region, waiting for the gpu if it is still reading it
+    void beginFrame();
+    //copies data into this frame's region, returns its byte offset or -1 when the region is full
+    GLintptr allocate(const void* data, GLsizeiptr size, GLsizeiptr alignment = 16);
+    //fences the region so it is not reused while the gpu still needs it
+    void endFrame();
+
+    GLuint id() const { return buffer; }
+    //minimum offset alignment for glBindBufferRange(GL_UNIFORM_BUFFER, ...)
+    GLsizeiptr uniformAlignment() const { return uniformOffsetAlignment; }
+
+private:
+    static const int RegionCount = 3;
+
+    GLuint buffer = 0;
+    unsigned char* mapped = nullptr;
+    GLsync fences[RegionCount] = {};
+    GLsizeiptr regionSize = 0;
+    GLsizeiptr uniformOffsetAlignment = 256;
+    int region = 0;
+    GLintptr cursor = 0;
+};
@@ -0,0 +1,215 @@
+#include "TextureCache.h"
+
+#include "BlockCompression.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+//file layout, all little endian, modelled on KTX2:
+//  TextureCacheHeader
+//  CachedLevel[levelCount]  (level index, level 0 first)
+//  level data               (smallest mip first, each level 16 byte aligned)
+struct TextureCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourcePathHash;
+    int64_t sourceModified;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    uint64_t levelIndexOffset;
+};
+
+struct CachedLevel {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t width;
+    uint32_t height;
+};
+
+static const char TextureCacheMagic[4] = { 'T', 'X', 'C', 'H' };
+
+std::string textureCachePath(const std::string& sourcePath)
+{
+    return sourcePath + ".texcache";
+}
+
+//checks the header against the source and fills image with levels pointing into bytes
+static bool parseTextureCache(const unsigned char* bytes, size_t size, const std::string& sourcePath,
+    long long sourceModified, CompressedImage& image)
+{
+    if (size < sizeof(TextureCacheHeader)) {
+        return false;
+    }
+
+    //stale or foreign caches are ignored and rebaked
+    TextureCacheHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+    if (std::memcmp(header.magic, TextureCacheMagic, 4) != 0 ||
+        header.version != TextureCacheVersion ||
+        header.sourcePathHash != hashPath(sourcePath) ||
+        header.sourceModified != sourceModified ||
+        header.levelCount == 0) {
+        return false;
+    }
+    if (!rangeFits(header.levelIndexOffset, header.levelCount, sizeof(CachedLevel), size)) {
+        std::cerr << "Texture cache " << textureCachePath(sourcePath) << " is truncated" << std::endl;
+        return false;
+    }
+
+    image.format = header.format;
+    image.levels.resize(header.levelCount);
+    for (uint32_t i = 0; i < header.levelCount; ++i) {
+        CachedLevel cached;
+        std::memcpy(&cached, bytes + header.levelIndexOffset + i * sizeof(CachedLevel), sizeof(cached));
+        if (!rangeFits(cached.offset, cached.size, 1, size)) {
+            std::cerr << "Texture cache " << textureCachePath(sourcePath) << " is truncated" << std::endl;
+            return false;
+        }
+
+        CompressedLevel& level = image.levels[i];
+        level.data = bytes + cached.offset;
+        level.size = (size_t)cached.size;
+        level.width = (int)cached.width;
+        level.height = (int)cached.height;
+    }
+    return true;
+}
+
+bool loadTextureCache(const std::string& sourcePath, LoadedTexture& texture)
+{
+    long long sourceModified = fileModifiedTime(sourcePath);
+    if (sourceModified < 0) {
+        return false;
+    }
+
+    MappedFile file;
+    if (!file.open(textureCachePath(sourcePath)) ||
+        !parseTextureCache(file.data(), file.size(), sourcePath, sourceModified, texture.image)) {
+        return false;
+    }
+
+    texture.mapping = std::move(file);
+    texture.fromCache = true;
+    return true;
+}
+
+//expands 1-3 channel pixels to rgba the same way GL_RED/GL_RG/GL_RGB uploads would read them
+static std::vector<uint8_t> expandToRgba(const DecodedImage& image)
+{
+    size_t pixelCount = (size_t)image.width * image.height;
+    std::vector<uint8_t> rgba(pixelCount * 4);
+    for (size_t i = 0; i < pixelCount; ++i) {
+        for (int c = 0; c < 4; ++c) {
+            uint8_t fill = c == 3 ? 255 : 0;
+            rgba[i * 4 + c] = c < image.channels ? image.pixels[i * image.channels + c] : fill;
+        }
+    }
+    return rgba;
+}
+
+bool bakeTexture(const std::string& sourcePath, LoadedTexture& texture)
+{
+    long long sourceModified = fileModifiedTime(sourcePath);
+    DecodedImage decoded;
+    if (sourceModified < 0 || !decodeTexture(sourcePath, decoded)) {
+        return false;
+    }
+
+    //only 4 channel images carry alpha worth the bigger BC3 blocks
+    bool withAlpha = decoded.channels == 4;
+    int width = decoded.width;
+    int height = decoded.height;
+    std::vector<uint8_t> rgba = expandToRgba(decoded);
+    freeImage(decoded);
+
+    //full chain down to 1x1, each level filtered from the one above before it is compressed
+    std::vector<std::vector<uint8_t>> levels;
+    std::vector<CachedLevel> levelIndex;
+    while (true) {
+        levels.push_back(compressImage(rgba.data(), width, height, withAlpha));
+        CachedLevel level;
+        level.offset = 0;
+        level.size = levels.back().size();
+        level.width = (uint32_t)width;
+        level.height = (uint32_t)height;
+        levelIndex.push_back(level);
+
+        if (width == 1 && height == 1) {
+            break;
+        }
+        int halfWidth, halfHeight;
+        rgba = downsampleImage(rgba.data(), width, height, halfWidth, halfHeight);
+        width = halfWidth;
+        height = halfHeight;
+    }
+
+    TextureCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, TextureCacheMagic, 4);
+    header.version = TextureCacheVersion;
+    header.sourcePathHash = hashPath(sourcePath);
+    header.sourceModified = sourceModified;
+    header.format = withAlpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    header.width = levelIndex[0].width;
+    header.height = levelIndex[0].height;
+    header.levelCount = (uint32_t)levelIndex.size();
+    header.levelIndexOffset = sizeof(TextureCacheHeader);
+
+    //smallest level first so a partial read still has the low mips
+    uint64_t offset = header.levelIndexOffset + levelIndex.size() * sizeof(CachedLevel);
+    for (size_t i = levelIndex.size(); i-- > 0;) {
+        offset = (offset + 15) & ~uint64_t(15);
+        levelIndex[i].offset = offset;
+        offset += levelIndex[i].size;
+    }
+
+    std::vector<unsigned char> bytes((size_t)offset, 0);
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    std::memcpy(bytes.data() + header.levelIndexOffset, levelIndex.data(), levelIndex.size() * sizeof(CachedLevel));
+    for (size_t i = 0; i < levels.size(); ++i) {
+        std::memcpy(bytes.data() + levelIndex[i].offset, levels[i].data(), levels[i].size());
+    }
+
+    //write to a temp file first so a crash never leaves a half written cache behind
+    std::string cachePath = textureCachePath(sourcePath);
+    std::string tempPath = cachePath + ".tmp";
+    bool written = false;
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (out) {
+            out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+            written = (bool)out;
+        }
+    }
+    if (written) {
+        std::remove(cachePath.c_str());
+        written = std::rename(tempPath.c_str(), cachePath.c_str()) == 0;
+    }
+    if (!written) {
+        std::remove(tempPath.c_str());
+        std::cerr << "Could not write texture cache " << cachePath << std::endl;
+    }
+
+    //upload from the file like a warm start would, or from memory if it could not be written
+    if (written && loadTextureCache(sourcePath, texture)) {
+        texture.fromCache = false;
+        return true;
+    }
+    texture.baked = std::move(bytes);
+    texture.fromCache = false;
+    return parseTextureCache(texture.baked.data(), texture.baked.size(), sourcePath, sourceModified, texture.image);
+}
+
+bool loadTextureCached(const std::string& sourcePath, LoadedTexture& texture)
+{
+    if (loadTextureCache(sourcePath, texture)) {
+        std::cout << "Loaded texture " << sourcePath.c_str() << " from cache" << std::endl;
+        return true;
+    }
+    return bakeTexture(sourcePath, texture);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "TextureLoader.h"
+
+#include <string>
+#include <vector>
+
+//bump whenever the cache layout or the encoder output changes
+const unsigned int TextureCacheVersion = 1;
+
+//block compressed mip chain, either mapped from its cache file or freshly baked in memory
+struct LoadedTexture {
+    //open when the texture came from the cache, image levels point into it
+    MappedFile mapping;
+    //holds the baked file when the cache could not be written, image levels point into it instead
+    std::vector<unsigned char> baked;
+
+    //what gets uploaded
+    CompressedImage image;
+    bool fromCache = false;
+};
+
+//cache file stored next to the source image
+std::string textureCachePath(const std::string& sourcePath);
+
+//maps the cache if it matches the source path, modified time and version
+bool loadTextureCache(const std::string& sourcePath, LoadedTexture& texture);
+//decodes the source image, builds every mip level, block compresses them and writes the cache
+bool bakeTexture(const std::string& sourcePath, LoadedTexture& texture);
+
+//uses a fresh cache when there is one, otherwise bakes it, safe to call from worker threads
+bool loadTextureCached(const std::string& sourcePath, LoadedTexture& texture);
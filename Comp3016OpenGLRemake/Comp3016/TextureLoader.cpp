@@ -0,0 +1,62 @@
+#include "TextureLoader.h"
+
+#include <iostream>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+// Number of Colour Channels to OpenGL
+const int ColourChanels[]{ 0 , GL_RED, GL_RG, GL_RGB, GL_RGBA };
+
+bool decodeTexture(const std::string& texturePath, DecodedImage& image)
+{
+    // tell stb_image.h to flip loaded texture's on the y-axis, per thread so workers don't race
+    stbi_set_flip_vertically_on_load_thread(true);
+    image.pixels = stbi_load(texturePath.c_str(), &image.width, &image.height, &image.channels, 0);
+    if (!image.pixels)
+    {
+        std::cout << "Failed to load texture " << texturePath.c_str() << std::endl;
+        return false;
+    }
+    std::cout << "Loaded texture " << texturePath.c_str() << std::endl;
+    return true;
+}
+
+void freeImage(DecodedImage& image)
+{
+    stbi_image_free(image.pixels);
+    image = DecodedImage();
+}
+
+void uploadTexture(GLuint& texture, const DecodedImage& image)
+{
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	// set the texture wrapping parameters
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// set texture wrapping to GL_REPEAT (default wrapping method)
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	// set texture filtering parameters
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	// rows of 1 or 3 channel images are not always 4 byte aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0, ColourChanels[image.channels], GL_UNSIGNED_BYTE, image.pixels);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void uploadCompressedTexture(GLuint& texture, const CompressedImage& image)
+{
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	// the whole chain is there, so minification can actually use it
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+	for (size_t level = 0; level < image.levels.size(); ++level) {
+		const CompressedLevel& mip = image.levels[level];
+		glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, image.format, mip.width, mip.height, 0, (GLsizei)mip.size, mip.data);
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+
+//pixels decoded by stb_image, waiting to be uploaded on the GL thread
+struct DecodedImage {
+    unsigned char* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+};
+
+//decodes an image file, safe to call from worker threads
+bool decodeTexture(const std::string& texturePath, DecodedImage& image);
+void freeImage(DecodedImage& image);
+
+//creates the GL texture + mipmaps from decoded pixels, GL thread only
+void uploadTexture(GLuint& texture, const DecodedImage& image);
+
+//one block compressed mip level, data usually points into a mapped texture cache
+struct CompressedLevel {
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    int width = 0;
+    int height = 0;
+};
+
+//a full prebuilt mip chain in one S3TC format, level 0 first
+struct CompressedImage {
+    GLenum format = 0;
+    std::vector<CompressedLevel> levels;
+};
+
+//creates the GL texture straight from compressed levels, no decode and no glGenerateMipmap, GL thread only
+void uploadCompressedTexture(GLuint& texture, const CompressedImage& image);
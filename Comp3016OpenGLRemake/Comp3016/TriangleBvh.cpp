@@ -0,0 +1,689 @@
+#include "TriangleBvh.h"
+
+#include "MappedFile.h"
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define TRIANGLEBVH_SSE 1
+#include <xmmintrin.h>
+#endif
+
+//centroid bins the surface area heuristic is evaluated over on each axis
+const int SahBins = 12;
+//past this depth nodes are split at the median, which keeps the traversal stack bounded
+const uint32_t MaxSahDepth = 48;
+//median splits halve a 32 bit triangle count, so no built tree is deeper than this
+//the traversals' fixed stacks are sized from it and cached trees deeper than it are rejected
+const uint32_t MaxTreeDepth = MaxSahDepth + 32;
+
+//file layout, all little endian:
+//  TriangleBvhCacheHeader
+//  nodes   (nodeCount Nodes)
+//  packets (packetCount TrianglePackets, 16 byte aligned)
+struct TriangleBvhCacheHeader {
+    char magic[4];
+    uint32_t version;
+    //the triangles and their numbering come from the imported mesh, so its cache version and import flags count too
+    uint32_t meshVersion;
+    uint32_t importFlags;
+    uint64_t sourcePathHash;
+    int64_t sourceModified;
+    uint32_t nodeCount;
+    uint32_t packetCount;
+    uint64_t triangleCount;
+    uint32_t depth;
+    uint32_t padding;
+    uint64_t nodeOffset;
+    uint64_t packetOffset;
+};
+
+static const char TriangleBvhMagic[4] = { 'T', 'B', 'V', 'H' };
+
+static float surfaceArea(const Aabb& box)
+{
+    glm::vec3 size = box.max - box.min;
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+static glm::vec3 laneVector(const float (&values)[3][4], int lane)
+{
+    return glm::vec3(values[0][lane], values[1][lane], values[2][lane]);
+}
+
+//Moller-Trumbore on all 4 lanes against a ray from each lane's own origin, so sphere sweeps can offset it per triangle
+//returns a mask of the lanes hit in 0..limit with their distance and barycentrics
+static int intersectPacket(const float (&v0)[3][4], const float (&edge1)[3][4], const float (&edge2)[3][4],
+    const float (&origin)[3][4], const glm::vec3& direction, float limit, float* t, float* u, float* v)
+{
+#ifdef TRIANGLEBVH_SSE
+    __m128 dx = _mm_set1_ps(direction.x);
+    __m128 dy = _mm_set1_ps(direction.y);
+    __m128 dz = _mm_set1_ps(direction.z);
+    __m128 e1x = _mm_load_ps(edge1[0]);
+    __m128 e1y = _mm_load_ps(edge1[1]);
+    __m128 e1z = _mm_load_ps(edge1[2]);
+    __m128 e2x = _mm_load_ps(edge2[0]);
+    __m128 e2y = _mm_load_ps(edge2[1]);
+    __m128 e2z = _mm_load_ps(edge2[2]);
+
+    __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+    __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+    __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+    __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+    //empty lanes have det 0, dividing gives inf and every test below fails on the NaNs
+    __m128 inverseDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+    __m128 sx = _mm_sub_ps(_mm_loadu_ps(origin[0]), _mm_load_ps(v0[0]));
+    __m128 sy = _mm_sub_ps(_mm_loadu_ps(origin[1]), _mm_load_ps(v0[1]));
+    __m128 sz = _mm_sub_ps(_mm_loadu_ps(origin[2]), _mm_load_ps(v0[2]));
+    __m128 laneU = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverseDet);
+
+    __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+    __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+    __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+    __m128 laneV = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverseDet);
+    __m128 laneT = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverseDet);
+
+    const __m128 zero = _mm_setzero_ps();
+    __m128 hit = _mm_and_ps(_mm_cmpge_ps(laneU, zero), _mm_cmpge_ps(laneV, zero));
+    hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(laneU, laneV), _mm_set1_ps(1.0f)));
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(laneT, zero));
+    hit = _mm_and_ps(hit, _mm_cmplt_ps(laneT, _mm_set1_ps(limit)));
+    _mm_storeu_ps(t, laneT);
+    _mm_storeu_ps(u, laneU);
+    _mm_storeu_ps(v, laneV);
+    return _mm_movemask_ps(hit);
+#else
+    int mask = 0;
+    for (int lane = 0; lane < 4; ++lane) {
+        glm::vec3 e1 = laneVector(edge1, lane);
+        glm::vec3 e2 = laneVector(edge2, lane);
+        glm::vec3 p = glm::cross(direction, e2);
+        float det = glm::dot(e1, p);
+        if (det == 0.0f) {
+            continue;
+        }
+        float inverseDet = 1.0f / det;
+        glm::vec3 s = glm::vec3(origin[0][lane], origin[1][lane], origin[2][lane]) - laneVector(v0, lane);
+        glm::vec3 q = glm::cross(s, e1);
+        u[lane] = glm::dot(s, p) * inverseDet;
+        v[lane] = glm::dot(direction, q) * inverseDet;
+        t[lane] = glm::dot(e2, q) * inverseDet;
+        if (u[lane] >= 0.0f && v[lane] >= 0.0f && u[lane] + v[lane] <= 1.0f && t[lane] >= 0.0f && t[lane] < limit) {
+            mask |= 1 << lane;
+        }
+    }
+    return mask;
+#endif
+}
+
+//Ericson's closest point on triangle abc
+static glm::vec3 closestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    glm::vec3 ab = b - a;
+    glm::vec3 ac = c - a;
+    glm::vec3 ap = p - a;
+    float d1 = glm::dot(ab, ap);
+    float d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) {
+        return a;
+    }
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp);
+    float d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) {
+        return b;
+    }
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+        return a + ab * (d1 / (d1 - d3));
+    }
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp);
+    float d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) {
+        return c;
+    }
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+        return a + ac * (d2 / (d2 - d6));
+    }
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    }
+    float denominator = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+//first root of a t^2 + b t + c, if it is in 0..limit
+static bool lowestRoot(float a, float b, float c, float limit, float& root)
+{
+    if (std::fabs(a) < 1e-12f) {
+        return false;
+    }
+    float discriminant = b * b - 4.0f * a * c;
+    if (discriminant < 0.0f) {
+        return false;
+    }
+    float squareRoot = std::sqrt(discriminant);
+    float r0 = (-b - squareRoot) / (2.0f * a);
+    float r1 = (-b + squareRoot) / (2.0f * a);
+    if (r0 > r1) {
+        std::swap(r0, r1);
+    }
+    //r0 < 0 means starting inside, overlaps are handled before this
+    if (r0 < 0.0f || r0 >= limit) {
+        return false;
+    }
+    root = r0;
+    return true;
+}
+
+//first time before limit a sphere moving from start touches one of the triangle's corners or edges
+static bool sweepSphereEdges(const glm::vec3& start, const glm::vec3& motion, float radius, const glm::vec3 (&corners)[3],
+    float limit, float& time)
+{
+    bool found = false;
+    float motionLength2 = glm::dot(motion, motion);
+    for (int i = 0; i < 3; ++i) {
+        //corner: |start + motion t - corner| = radius
+        glm::vec3 toStart = start - corners[i];
+        float root;
+        if (lowestRoot(motionLength2, 2.0f * glm::dot(motion, toStart), glm::dot(toStart, toStart) - radius * radius, limit, root)) {
+            limit = root;
+            time = root;
+            found = true;
+        }
+
+        //edge: distance from the centre to the edge's line is radius, at a point within the edge
+        glm::vec3 edge = corners[(i + 1) % 3] - corners[i];
+        glm::vec3 toCorner = corners[i] - start;
+        float edgeLength2 = glm::dot(edge, edge);
+        float edgeDotMotion = glm::dot(edge, motion);
+        float edgeDotCorner = glm::dot(edge, toCorner);
+        float a = edgeLength2 * -motionLength2 + edgeDotMotion * edgeDotMotion;
+        float b = edgeLength2 * (2.0f * glm::dot(motion, toCorner)) - 2.0f * edgeDotMotion * edgeDotCorner;
+        float c = edgeLength2 * (radius * radius - glm::dot(toCorner, toCorner)) + edgeDotCorner * edgeDotCorner;
+        if (lowestRoot(a, b, c, limit, root)) {
+            float along = (edgeDotMotion * root - edgeDotCorner) / edgeLength2;
+            if (along >= 0.0f && along <= 1.0f) {
+                limit = root;
+                time = root;
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+void TriangleBvh::build(const MeshView& mesh)
+{
+    nodes.clear();
+    packets.clear();
+    depth = 0;
+
+    std::vector<BuildTriangle> build;
+    for (size_t s = 0; s < mesh.submeshCount; ++s) {
+        const Submesh& submesh = mesh.submeshes[s];
+        for (GLsizei i = 0; i + 2 < submesh.indexCount; i += 3) {
+            BuildTriangle triangle;
+            for (int corner = 0; corner < 3; ++corner) {
+                size_t index = submesh.indexOffset + i + corner;
+                GLuint vertex = mesh.indexType == GL_UNSIGNED_SHORT ? static_cast<const GLushort*>(mesh.indices)[index] :
+                    static_cast<const GLuint*>(mesh.indices)[index];
+                const GLfloat* position = mesh.vertices + (size_t)(vertex + submesh.baseVertex) * VertexStride;
+                triangle.corners[corner] = glm::vec3(position[0], position[1], position[2]);
+            }
+            glm::vec3 normal = glm::cross(triangle.corners[1] - triangle.corners[0], triangle.corners[2] - triangle.corners[0]);
+            if (glm::dot(normal, normal) == 0.0f) {
+                continue;
+            }
+            triangle.bounds.min = glm::min(triangle.corners[0], glm::min(triangle.corners[1], triangle.corners[2]));
+            triangle.bounds.max = glm::max(triangle.corners[0], glm::max(triangle.corners[1], triangle.corners[2]));
+            triangle.centroid = (triangle.corners[0] + triangle.corners[1] + triangle.corners[2]) / 3.0f;
+            triangle.triangle = (uint32_t)((submesh.indexOffset + i) / 3);
+            build.push_back(triangle);
+        }
+    }
+
+    triangles = build.size();
+    nodes.reserve(build.size() / 2 + 1);
+    packets.reserve(build.size() / 2 + 1);
+    if (!build.empty()) {
+        buildNode(build, 0, (uint32_t)build.size(), 0);
+    }
+}
+
+uint32_t TriangleBvh::buildNode(std::vector<BuildTriangle>& build, uint32_t first, uint32_t count, uint32_t nodeDepth)
+{
+    uint32_t nodeIndex = (uint32_t)nodes.size();
+    nodes.push_back(Node());
+
+    Aabb nodeBounds, centroidBounds;
+    for (uint32_t i = first; i < first + count; ++i) {
+        growAabb(nodeBounds, build[i].bounds);
+        centroidBounds.min = glm::min(centroidBounds.min, build[i].centroid);
+        centroidBounds.max = glm::max(centroidBounds.max, build[i].centroid);
+    }
+    nodes[nodeIndex].bounds = nodeBounds;
+
+    //a leaf is exactly one packet
+    if (count <= 4) {
+        TrianglePacket packet;
+        std::memset(&packet, 0, sizeof(packet));
+        for (uint32_t lane = 0; lane < count; ++lane) {
+            const BuildTriangle& triangle = build[first + lane];
+            glm::vec3 edge1 = triangle.corners[1] - triangle.corners[0];
+            glm::vec3 edge2 = triangle.corners[2] - triangle.corners[0];
+            glm::vec3 normal = glm::normalize(glm::cross(edge1, edge2));
+            for (int axis = 0; axis < 3; ++axis) {
+                packet.v0[axis][lane] = triangle.corners[0][axis];
+                packet.edge1[axis][lane] = edge1[axis];
+                packet.edge2[axis][lane] = edge2[axis];
+                packet.normal[axis][lane] = normal[axis];
+            }
+            packet.triangle[lane] = triangle.triangle;
+        }
+        nodes[nodeIndex].packet = (uint32_t)packets.size();
+        nodes[nodeIndex].count = count;
+        packets.push_back(packet);
+        depth = std::max(depth, nodeDepth);
+        return nodeIndex;
+    }
+
+    //cheapest split between centroid bins on any axis, cost is area * triangles on each side
+    glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+    int bestAxis = -1;
+    int bestSplit = 0;
+    float bestCost = 1e30f;
+    for (int axis = 0; axis < 3 && nodeDepth < MaxSahDepth; ++axis) {
+        if (extent[axis] <= 0.0f) {
+            continue;
+        }
+        Aabb binBounds[SahBins];
+        uint32_t binCounts[SahBins] = {};
+        float scale = SahBins / extent[axis];
+        for (uint32_t i = first; i < first + count; ++i) {
+            int bin = std::min(SahBins - 1, (int)((build[i].centroid[axis] - centroidBounds.min[axis]) * scale));
+            ++binCounts[bin];
+            growAabb(binBounds[bin], build[i].bounds);
+        }
+
+        //left of split s is bins 0..s-1
+        float leftCost[SahBins];
+        Aabb side;
+        uint32_t sideCount = 0;
+        for (int split = 1; split < SahBins; ++split) {
+            growAabb(side, binBounds[split - 1]);
+            sideCount += binCounts[split - 1];
+            leftCost[split] = sideCount > 0 ? surfaceArea(side) * sideCount : 0.0f;
+        }
+        side = Aabb();
+        sideCount = 0;
+        uint32_t leftCount = count;
+        for (int split = SahBins - 1; split > 0; --split) {
+            growAabb(side, binBounds[split]);
+            sideCount += binCounts[split];
+            leftCount -= binCounts[split];
+            if (sideCount == 0 || leftCount == 0) {
+                continue;
+            }
+            float cost = leftCost[split] + surfaceArea(side) * sideCount;
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+
+    uint32_t half;
+    if (bestAxis >= 0) {
+        float low = centroidBounds.min[bestAxis];
+        float scale = SahBins / extent[bestAxis];
+        BuildTriangle* middle = std::partition(build.data() + first, build.data() + first + count,
+            [bestAxis, bestSplit, low, scale](const BuildTriangle& triangle) {
+                return std::min(SahBins - 1, (int)((triangle.centroid[bestAxis] - low) * scale)) < bestSplit;
+            });
+        half = (uint32_t)(middle - (build.data() + first));
+    }
+    else {
+        //centroids all in one spot (or too deep), median split on the widest axis
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        half = count / 2;
+        std::nth_element(build.begin() + first, build.begin() + first + half, build.begin() + first + count,
+            [axis](const BuildTriangle& a, const BuildTriangle& b) { return a.centroid[axis] < b.centroid[axis]; });
+    }
+
+    buildNode(build, first, half, nodeDepth + 1);
+    uint32_t rightChild = buildNode(build, first + half, count - half, nodeDepth + 1);
+    nodes[nodeIndex].rightChild = rightChild;
+    return nodeIndex;
+}
+
+bool TriangleBvh::validTree() const
+{
+    if (nodes.empty()) {
+        return true;
+    }
+
+    //depth first from the root, every node has to be reached exactly once
+    std::vector<std::pair<uint32_t, uint32_t>> stack;
+    stack.push_back(std::make_pair(0u, 0u));
+    size_t visited = 0;
+    while (!stack.empty()) {
+        uint32_t nodeIndex = stack.back().first;
+        uint32_t nodeDepth = stack.back().second;
+        stack.pop_back();
+        if (++visited > nodes.size() || nodeDepth > depth) {
+            return false;
+        }
+
+        const Node& node = nodes[nodeIndex];
+        if (node.rightChild == 0) {
+            if (node.packet >= packets.size() || node.count == 0 || node.count > 4) {
+                return false;
+            }
+            continue;
+        }
+        //left child follows its parent, the right one comes after the whole left subtree
+        if ((size_t)nodeIndex + 1 >= nodes.size() || node.rightChild <= nodeIndex + 1 || node.rightChild >= nodes.size()) {
+            return false;
+        }
+        stack.push_back(std::make_pair(node.rightChild, nodeDepth + 1));
+        stack.push_back(std::make_pair(nodeIndex + 1, nodeDepth + 1));
+    }
+    return visited == nodes.size();
+}
+
+bool TriangleBvh::raycast(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit) const
+{
+    if (nodes.empty()) {
+        return false;
+    }
+    glm::vec3 inverse = inverseDirection(direction);
+    float origins[3][4];
+    for (int axis = 0; axis < 3; ++axis) {
+        std::fill(origins[axis], origins[axis] + 4, origin[axis]);
+    }
+
+    //a node's unvisited siblings on the way down, at most one per level (see MaxTreeDepth)
+    uint32_t stack[MaxTreeDepth + 1];
+    int stackSize = 0;
+    float enter;
+    if (rayEntersAabb(origin, inverse, nodes[0].bounds, 0.0f, hit.distance, enter)) {
+        stack[stackSize++] = 0;
+    }
+    bool found = false;
+    while (stackSize > 0) {
+        uint32_t nodeIndex = stack[--stackSize];
+        const Node& node = nodes[nodeIndex];
+        if (node.rightChild == 0) {
+            const TrianglePacket& packet = packets[node.packet];
+            float t[4], u[4], v[4];
+            int mask = intersectPacket(packet.v0, packet.edge1, packet.edge2, origins, direction, hit.distance, t, u, v);
+            for (uint32_t lane = 0; lane < node.count; ++lane) {
+                if ((mask & (1 << lane)) && t[lane] < hit.distance) {
+                    hit.distance = t[lane];
+                    hit.triangle = packet.triangle[lane];
+                    hit.u = u[lane];
+                    hit.v = v[lane];
+                    found = true;
+                }
+            }
+            continue;
+        }
+
+        //nearer child on top, so its hits shrink the range the other is tested with
+        float leftEnter, rightEnter;
+        bool left = rayEntersAabb(origin, inverse, nodes[nodeIndex + 1].bounds, 0.0f, hit.distance, leftEnter);
+        bool right = rayEntersAabb(origin, inverse, nodes[node.rightChild].bounds, 0.0f, hit.distance, rightEnter);
+        if (left && right && leftEnter > rightEnter) {
+            stack[stackSize++] = nodeIndex + 1;
+            stack[stackSize++] = node.rightChild;
+            continue;
+        }
+        if (right) {
+            stack[stackSize++] = node.rightChild;
+        }
+        if (left) {
+            stack[stackSize++] = nodeIndex + 1;
+        }
+    }
+    return found;
+}
+
+bool TriangleBvh::sweepSphere(const glm::vec3& start, const glm::vec3& motion, float radius, TriangleSweep& hit) const
+{
+    if (nodes.empty()) {
+        return false;
+    }
+    glm::vec3 inverse = inverseDirection(motion);
+
+    uint32_t stack[MaxTreeDepth + 1];
+    int stackSize = 0;
+    float enter;
+    if (rayEntersAabb(start, inverse, nodes[0].bounds, radius, hit.time, enter)) {
+        stack[stackSize++] = 0;
+    }
+    bool found = false;
+    while (stackSize > 0) {
+        uint32_t nodeIndex = stack[--stackSize];
+        const Node& node = nodes[nodeIndex];
+        if (node.rightChild != 0) {
+            float leftEnter, rightEnter;
+            bool left = rayEntersAabb(start, inverse, nodes[nodeIndex + 1].bounds, radius, hit.time, leftEnter);
+            bool right = rayEntersAabb(start, inverse, nodes[node.rightChild].bounds, radius, hit.time, rightEnter);
+            if (left && right && leftEnter > rightEnter) {
+                stack[stackSize++] = nodeIndex + 1;
+                stack[stackSize++] = node.rightChild;
+                continue;
+            }
+            if (right) {
+                stack[stackSize++] = node.rightChild;
+            }
+            if (left) {
+                stack[stackSize++] = nodeIndex + 1;
+            }
+            continue;
+        }
+
+        //approaching a plane from further than radius the first touch is the ray from the sphere's leading point
+        //hitting the face, those are tested as one packet; anything else touches an edge or corner first, or already overlaps
+        const TrianglePacket& packet = packets[node.packet];
+        float origins[3][4];
+        float side[4], startDistance[4], endDistance[4];
+        for (int lane = 0; lane < 4; ++lane) {
+            glm::vec3 normal = laneVector(packet.normal, lane);
+            startDistance[lane] = glm::dot(normal, start - laneVector(packet.v0, lane));
+            endDistance[lane] = startDistance[lane] + glm::dot(normal, motion);
+            side[lane] = startDistance[lane] >= 0.0f ? 1.0f : -1.0f;
+            glm::vec3 leading = start - normal * (side[lane] * radius);
+            for (int axis = 0; axis < 3; ++axis) {
+                origins[axis][lane] = leading[axis];
+            }
+        }
+        float t[4], u[4], v[4];
+        int mask = intersectPacket(packet.v0, packet.edge1, packet.edge2, origins, motion, hit.time, t, u, v);
+
+        for (uint32_t lane = 0; lane < node.count; ++lane) {
+            glm::vec3 normal = laneVector(packet.normal, lane);
+            bool approaching = startDistance[lane] * side[lane] >= radius && endDistance[lane] * side[lane] < startDistance[lane] * side[lane];
+            if (approaching && (mask & (1 << lane))) {
+                if (t[lane] < hit.time) {
+                    hit.time = t[lane];
+                    hit.normal = normal * side[lane];
+                    hit.triangle = packet.triangle[lane];
+                    found = true;
+                }
+                continue;
+            }
+            //never within radius of the plane during the move
+            if ((startDistance[lane] > radius && endDistance[lane] > radius) ||
+                (startDistance[lane] < -radius && endDistance[lane] < -radius)) {
+                continue;
+            }
+
+            glm::vec3 corners[3];
+            corners[0] = laneVector(packet.v0, lane);
+            corners[1] = corners[0] + laneVector(packet.edge1, lane);
+            corners[2] = corners[0] + laneVector(packet.edge2, lane);
+            if (std::fabs(startDistance[lane]) < radius) {
+                glm::vec3 away = start - closestPointOnTriangle(start, corners[0], corners[1], corners[2]);
+                float distance2 = glm::dot(away, away);
+                if (distance2 < radius * radius) {
+                    //already touching: blocks only the part of the move heading further in
+                    glm::vec3 contactNormal = distance2 > 1e-12f ? away / std::sqrt(distance2) : normal * side[lane];
+                    if (glm::dot(motion, contactNormal) < 0.0f && hit.time > 0.0f) {
+                        hit.time = 0.0f;
+                        hit.normal = contactNormal;
+                        hit.triangle = packet.triangle[lane];
+                        found = true;
+                    }
+                    continue;
+                }
+            }
+            float time;
+            if (sweepSphereEdges(start, motion, radius, corners, hit.time, time)) {
+                glm::vec3 centre = start + motion * time;
+                glm::vec3 away = centre - closestPointOnTriangle(centre, corners[0], corners[1], corners[2]);
+                float length = glm::length(away);
+                hit.time = time;
+                hit.normal = length > 1e-6f ? away / length : normal * side[lane];
+                hit.triangle = packet.triangle[lane];
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+std::string triangleBvhCachePath(const std::string& sourcePath)
+{
+    return sourcePath + ".bvhcache";
+}
+
+bool TriangleBvh::loadCache(const std::string& sourcePath)
+{
+    long long sourceModified = fileModifiedTime(sourcePath);
+    if (sourceModified < 0) {
+        return false;
+    }
+
+    MappedFile file;
+    if (!file.open(triangleBvhCachePath(sourcePath)) || file.size() < sizeof(TriangleBvhCacheHeader)) {
+        return false;
+    }
+
+    //stale or foreign caches are ignored and rebuilt
+    TriangleBvhCacheHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, TriangleBvhMagic, 4) != 0 ||
+        header.version != TriangleBvhCacheVersion ||
+        header.depth > MaxTreeDepth ||
+        header.meshVersion != MeshCacheVersion ||
+        header.importFlags != ModelImportFlags ||
+        header.sourcePathHash != hashPath(sourcePath) ||
+        header.sourceModified != sourceModified) {
+        return false;
+    }
+    if (!rangeFits(header.nodeOffset, header.nodeCount, sizeof(Node), file.size()) ||
+        !rangeFits(header.packetOffset, header.packetCount, sizeof(TrianglePacket), file.size())) {
+        std::cerr << "Collision cache " << triangleBvhCachePath(sourcePath) << " is truncated" << std::endl;
+        return false;
+    }
+
+    //small enough to copy out, the packets need their alignment anyway
+    nodes.resize(header.nodeCount);
+    packets.resize(header.packetCount);
+    std::memcpy(nodes.data(), file.data() + header.nodeOffset, nodes.size() * sizeof(Node));
+    std::memcpy(packets.data(), file.data() + header.packetOffset, packets.size() * sizeof(TrianglePacket));
+    triangles = (size_t)header.triangleCount;
+    depth = header.depth;
+
+    //the traversals trust the links and the depth, so a corrupt tree must not get that far
+    if (!validTree()) {
+        std::cerr << "Collision cache " << triangleBvhCachePath(sourcePath) << " has a bad node" << std::endl;
+        nodes.clear();
+        packets.clear();
+        triangles = 0;
+        depth = 0;
+        return false;
+    }
+    return true;
+}
+
+bool TriangleBvh::writeCache(const std::string& sourcePath) const
+{
+    long long sourceModified = fileModifiedTime(sourcePath);
+    if (sourceModified < 0) {
+        return false;
+    }
+
+    TriangleBvhCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, TriangleBvhMagic, 4);
+    header.version = TriangleBvhCacheVersion;
+    header.meshVersion = MeshCacheVersion;
+    header.importFlags = ModelImportFlags;
+    header.sourcePathHash = hashPath(sourcePath);
+    header.sourceModified = sourceModified;
+    header.nodeCount = (uint32_t)nodes.size();
+    header.packetCount = (uint32_t)packets.size();
+    header.triangleCount = triangles;
+    header.depth = depth;
+    header.nodeOffset = sizeof(TriangleBvhCacheHeader);
+    header.packetOffset = (header.nodeOffset + nodes.size() * sizeof(Node) + 15) & ~uint64_t(15);
+
+    std::vector<unsigned char> bytes((size_t)(header.packetOffset + packets.size() * sizeof(TrianglePacket)), 0);
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    std::memcpy(bytes.data() + header.nodeOffset, nodes.data(), nodes.size() * sizeof(Node));
+    std::memcpy(bytes.data() + header.packetOffset, packets.data(), packets.size() * sizeof(TrianglePacket));
+
+    //write to a temp file first so a crash never leaves a half written cache behind
+    std::string cachePath = triangleBvhCachePath(sourcePath);
+    std::string tempPath = cachePath + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "Could not write collision cache " << cachePath << std::endl;
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        if (!out) {
+            std::cerr << "Could not write collision cache " << cachePath << std::endl;
+            return false;
+        }
+    }
+    std::remove(cachePath.c_str());
+    if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool loadTriangleBvhCached(const std::string& sourcePath, const MeshView& mesh, TriangleBvh& bvh)
+{
+    if (bvh.loadCache(sourcePath)) {
+        std::cout << "Loading collision mesh " << sourcePath.c_str() << " from cache\n";
+        return true;
+    }
+
+    bvh.build(mesh);
+    if (bvh.triangleCount() == 0) {
+        std::cerr << "No triangles to collide with in " << sourcePath << std::endl;
+        return false;
+    }
+    bvh.writeCache(sourcePath);
+    return true;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "Culling.h"
+#include "ModelLoader.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//bump whenever the bvh cache layout or the build changes
+const unsigned int TriangleBvhCacheVersion = 2;
+
+//nearest triangle a ray hits
+struct RayHit {
+    //along the ray in units of its direction, only hits nearer than this are reported so it starts as the limit
+    float distance = 1e30f;
+    //first index of the triangle in the mesh's index buffer / 3
+    uint32_t triangle = 0;
+    //weights of the triangle's 2nd and 3rd vertex at the hit, the 1st gets 1 - u - v
+    float u = 0.0f;
+    float v = 0.0f;
+};
+
+//where a swept sphere first touches the mesh
+struct TriangleSweep {
+    //fraction of the motion covered before touching, only contacts before this are reported
+    float time = 1.0f;
+    //out of the surface towards the sphere's centre
+    glm::vec3 normal = glm::vec3(0.0f);
+    uint32_t triangle = 0;
+};
+
+//static bounding volume hierarchy over a mesh's triangles, split by surface area heuristic
+//leaves hold up to 4 triangles stored lane by lane so a leaf is tested against a ray or sphere in one SSE pass
+class TriangleBvh {
+public:
+    //every triangle of the mesh's full detail level, degenerate ones are skipped
+    void build(const MeshView& mesh);
+
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit) const;
+    //a sphere already touching a triangle only hits it while moving further in
+    bool sweepSphere(const glm::vec3& start, const glm::vec3& motion, float radius, TriangleSweep& hit) const;
+
+    //reads the cache next to sourcePath if it matches the source's path, modified time and import
+    bool loadCache(const std::string& sourcePath);
+    bool writeCache(const std::string& sourcePath) const;
+
+    Aabb bounds() const { return nodes.empty() ? Aabb() : nodes[0].bounds; }
+    size_t triangleCount() const { return triangles; }
+
+private:
+    //every node covers a run of leaves, left child is always the next node, 0 marks a leaf
+    struct Node {
+        Aabb bounds;
+        uint32_t packet = 0;
+        //triangles in the leaf's packet
+        uint32_t count = 0;
+        uint32_t rightChild = 0;
+    };
+
+    //4 triangles a lane each as a corner, two edges and a unit normal, unused lanes are all zero
+    struct alignas(16) TrianglePacket {
+        float v0[3][4];
+        float edge1[3][4];
+        float edge2[3][4];
+        float normal[3][4];
+        uint32_t triangle[4];
+    };
+
+    struct BuildTriangle {
+        glm::vec3 corners[3];
+        glm::vec3 centroid;
+        Aabb bounds;
+        uint32_t triangle;
+    };
+
+    uint32_t buildNode(std::vector<BuildTriangle>& build, uint32_t first, uint32_t count, uint32_t nodeDepth);
+    //walks the tree checking every link points forward and in range, and that no leaf is deeper than depth
+    bool validTree() const;
+
+    std::vector<Node> nodes;
+    std::vector<TrianglePacket> packets;
+    size_t triangles = 0;
+    //deepest leaf, the root is 0, the traversal stack needs one entry more than this
+    uint32_t depth = 0;
+};
+
+//cache file stored next to the source asset
+std::string triangleBvhCachePath(const std::string& sourcePath);
+
+//uses a fresh cache when there is one, otherwise builds from mesh and rewrites the cache
+bool loadTriangleBvhCached(const std::string& sourcePath, const MeshView& mesh, TriangleBvh& bvh);